@@ -9,6 +9,8 @@
 #include <sys/stat.h>
 #include <sys/select.h>
 #include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <poll.h>
@@ -475,6 +477,65 @@ static int check_terminal(terminal* term)
 
 
 
+/*
+	A host socket is a Unix-domain stream socket. A connection is handled by
+	a pair of io_devices on the same fd; a listener only uses its rx device,
+	which is ready when a connection is pending. 
+
+	The table is shared by the cores and the PIC daemon, so it is protected
+	by a mutex. The cores call the host socket functions with interrupts 
+	disabled, so they cannot be switched out while holding it.
+ */
+typedef struct host_socket
+{
+	int used;                 /* slot in use */
+	int listener;             /* listening socket */
+	io_device rx, tx;         /* the two directions of the fd */
+	char path[sizeof(((struct sockaddr_un*)0)->sun_path)];  /* listener path */
+} host_socket;
+
+static host_socket HSOCK[MAX_HOST_SOCKETS];
+static pthread_mutex_t hostsock_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* Take a free slot for a new fd, or return -1. Called with the mutex held. */
+static int hostsock_alloc(int fd, int listener)
+{
+	for(int i=0; i<MAX_HOST_SOCKETS; i++) {
+		host_socket* hs = & HSOCK[i];
+		if(hs->used) continue;
+
+		hs->used = 1;
+		hs->listener = listener;
+		hs->path[0] = '\0';
+		io_device_init(& hs->rx, fd, IODIR_RX);
+		io_device_init(& hs->tx, fd, IODIR_TX);
+		return i;
+	}
+	return -1;
+}
+
+
+/* Called with the mutex held */
+static void hostsock_free(host_socket* hs)
+{
+	int rc;
+	while((rc = close(hs->rx.fd))==-1 && errno==EINTR);
+	if(hs->listener) unlink(hs->path);
+	hs->used = 0;
+}
+
+
+/* A not-ready device failed a transfer */
+static void io_device_unready(io_device* this)
+{
+	if(this->ready) {
+		this->ready = 0;
+		interrupt_pic_thread();
+	}
+}
+
+
 /* Helper for PIC_daemon */
 static void pic_drain_sigusr1(int sigusr1fd)
 {
@@ -544,6 +605,15 @@ static void PIC_daemon(uint serialno)
 			if(! term->con.ready) fdset_add(&writefds, term->con.fd, &maxfd);
 		}
 
+		CHECKRC(pthread_mutex_lock(&hostsock_mutex));
+		for(uint i=0; i<MAX_HOST_SOCKETS; i++) {
+			host_socket* hs = & HSOCK[i];
+			if(! hs->used) continue;
+			if(! hs->rx.ready) fdset_add(&readfds, hs->rx.fd, &maxfd);
+			if(! hs->listener && ! hs->tx.ready) fdset_add(&writefds, hs->tx.fd, &maxfd);
+		}
+		CHECKRC(pthread_mutex_unlock(&hostsock_mutex));
+
 		fdset_add(&readfds, sigalrmfd, &maxfd);
 		fdset_add(&readfds, sigusr1fd, &maxfd);
 
@@ -606,6 +676,33 @@ static void PIC_daemon(uint serialno)
 				raise_interrupt(core, SERIAL_RX_READY);
 			}
 		}
+
+		/* 
+			Host sockets raise one interrupt for all of them. A socket that
+			was closed during select() may show up as ready, which is harmless.
+		 */
+		int hostsock_int = 0;
+		CHECKRC(pthread_mutex_lock(&hostsock_mutex));
+		for(uint i=0; i<MAX_HOST_SOCKETS; i++) {
+			host_socket* hs = & HSOCK[i];
+			if(! hs->used) continue;
+
+			io_device* dev[2] = { &hs->rx, &hs->tx };
+			fd_set* set[2] = { &readfds, &writefds };
+			for(int d = 0; d < (hs->listener ? 1 : 2); d++) {
+				if(dev[d]->ready) continue;
+				if( FD_ISSET(dev[d]->fd, set[d]) 
+					|| (system_clock-dev[d]->last_int)>SERIAL_TIMEOUT ) 
+				{
+					dev[d]->ready = 1;
+					dev[d]->last_int = system_clock;
+					hostsock_int = 1;
+				}
+			}
+		}
+		CHECKRC(pthread_mutex_unlock(&hostsock_mutex));
+		if(hostsock_int)
+			raise_interrupt(& CORE[0], HOST_SOCKET_READY);
 	}
 
 	/* sync with all cores */
@@ -624,6 +721,12 @@ static void PIC_daemon(uint serialno)
 		close_terminal(& TERM[i]);
 	nterm = 0;
 
+	/* close the host sockets left open */
+	CHECKRC(pthread_mutex_lock(&hostsock_mutex));
+	for(uint i=0; i<MAX_HOST_SOCKETS; i++)
+		if(HSOCK[i].used) hostsock_free(& HSOCK[i]);
+	CHECKRC(pthread_mutex_unlock(&hostsock_mutex));
+
 	/* Reset name */
 	CHECKRC(pthread_setname_np(pthread_self(), oldname));
 }
@@ -877,6 +980,13 @@ TimerDuration bios_clock()
 	return system_clock * 1000ul;
 }	
 
+TimerDuration bios_cpu_clock()
+{
+	struct timespec curtime;
+	CHECK(clock_gettime(CLOCK_MONOTONIC, &curtime));
+	return curtime.tv_sec*1000000ul + curtime.tv_nsec / 1000;
+}
+
 
 
 uint bios_serial_ports()
@@ -924,3 +1034,138 @@ int bios_write_serial(uint serial, char value)
 }
 
 
+/*
+	Host sockets
+ */
+
+int bios_hostsock_listen(const char* path)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	if(strlen(path) >= sizeof(addr.sun_path)) return -1;
+	strcpy(addr.sun_path, path);
+
+	/* Replace a stale socket, but nothing else */
+	struct stat st;
+	if(stat(path, &st)==0 && S_ISSOCK(st.st_mode)) unlink(path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+	if(fd==-1) return -1;
+	if(bind(fd, (struct sockaddr*) &addr, sizeof(addr))==-1) {
+		close(fd);
+		return -1;
+	}
+
+	CHECKRC(pthread_mutex_lock(&hostsock_mutex));
+	int hsock = -1;
+	if(listen(fd, SOMAXCONN)==0)
+		hsock = hostsock_alloc(fd, 1);
+	if(hsock == -1) {
+		close(fd);
+		unlink(path);
+	} else
+		strcpy(HSOCK[hsock].path, path);
+	CHECKRC(pthread_mutex_unlock(&hostsock_mutex));
+
+	/* Let the PIC daemon watch it */
+	if(hsock != -1) interrupt_pic_thread();
+	return hsock;
+}
+
+
+int bios_hostsock_accept(int hsock)
+{
+	assert(hsock>=0 && hsock<MAX_HOST_SOCKETS);
+	CHECKRC(pthread_mutex_lock(&hostsock_mutex));
+	host_socket* hs = & HSOCK[hsock];
+	assert(hs->used && hs->listener);
+
+	int ret = -1;
+	while(1) {
+		int fd = accept4(hs->rx.fd, NULL, NULL, SOCK_CLOEXEC);
+		if(fd == -1) {
+			if(errno==EINTR || errno==ECONNABORTED) continue;
+			io_device_unready(& hs->rx);
+			break;
+		}
+
+		/* Refuse connections when the table is full */
+		ret = hostsock_alloc(fd, 0);
+		if(ret != -1) break;
+		close(fd);
+	}
+	CHECKRC(pthread_mutex_unlock(&hostsock_mutex));
+	return ret;
+}
+
+
+int bios_hostsock_recv(int hsock, char* buf, unsigned int size)
+{
+	assert(hsock>=0 && hsock<MAX_HOST_SOCKETS);
+	CHECKRC(pthread_mutex_lock(&hostsock_mutex));
+	host_socket* hs = & HSOCK[hsock];
+	assert(hs->used && !hs->listener);
+
+	ssize_t rc;
+	while((rc = recv(hs->rx.fd, buf, size, 0))==-1 && errno==EINTR);
+	if(rc==-1 && (errno==EAGAIN || errno==EWOULDBLOCK))
+		io_device_unready(& hs->rx);
+	else if(rc==-1)
+		rc = 0;      /* An error ends the data */
+
+	CHECKRC(pthread_mutex_unlock(&hostsock_mutex));
+	return rc;
+}
+
+
+int bios_hostsock_send(int hsock, const char* buf, unsigned int size)
+{
+	assert(hsock>=0 && hsock<MAX_HOST_SOCKETS);
+	CHECKRC(pthread_mutex_lock(&hostsock_mutex));
+	host_socket* hs = & HSOCK[hsock];
+	assert(hs->used && !hs->listener);
+
+	ssize_t rc;
+	while((rc = send(hs->tx.fd, buf, size, MSG_NOSIGNAL))==-1 && errno==EINTR);
+	if(rc==-1 && (errno==EAGAIN || errno==EWOULDBLOCK))
+		io_device_unready(& hs->tx);
+	else if(rc==-1)
+		rc = 0;      /* The peer is gone */
+
+	CHECKRC(pthread_mutex_unlock(&hostsock_mutex));
+	return rc;
+}
+
+
+int bios_hostsock_poll(int hsock)
+{
+	assert(hsock>=0 && hsock<MAX_HOST_SOCKETS);
+	CHECKRC(pthread_mutex_lock(&hostsock_mutex));
+	host_socket* hs = & HSOCK[hsock];
+	assert(hs->used);
+
+	io_device* dev[2] = { &hs->rx, &hs->tx };
+	int flag[2] = { HOSTSOCK_RX, HOSTSOCK_TX };
+	int ret = 0;
+	for(int d = 0; d < (hs->listener ? 1 : 2); d++) {
+		/* Hangups and errors do not block a transfer either */
+		struct pollfd pfd = { .fd = dev[d]->fd, .events = (d==0) ? POLLIN : POLLOUT };
+		CHECK(poll(&pfd, 1, 0));
+		if(pfd.revents)
+			ret |= flag[d];
+		else
+			io_device_unready(dev[d]);
+	}
+
+	CHECKRC(pthread_mutex_unlock(&hostsock_mutex));
+	return ret;
+}
+
+
+void bios_hostsock_close(int hsock)
+{
+	assert(hsock>=0 && hsock<MAX_HOST_SOCKETS);
+	CHECKRC(pthread_mutex_lock(&hostsock_mutex));
+	assert(HSOCK[hsock].used);
+	hostsock_free(& HSOCK[hsock]);
+	CHECKRC(pthread_mutex_unlock(&hostsock_mutex));
+}
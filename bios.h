@@ -51,8 +51,9 @@
 
 	The peripherals are managed via the 'bios_...' functions. 
 
-	There are two types of simulated peripherals:  _timers_ and _serial ports_ 
-	(connected to terminals). Each type of peripheral is documented below.
+	There are three types of simulated peripherals:  _timers_, _serial ports_ 
+	(connected to terminals) and _host sockets_. Each type of peripheral is 
+	documented below.
 
 	Timers
 	-------
@@ -98,6 +99,23 @@
 	Also, each interrupt is sent if the serial device timeouts (is inactive for
 	about 300 msec).
 
+	Host sockets
+	------------
+
+	A host socket is a Unix-domain stream socket of the host. It lets 
+	programs outside the VM connect to it, e.g., to generate load.
+
+	A listening host socket is bound to a path in the host file system.
+	Each connection accepted on it is a new host socket, which can send 
+	and receive blocks of bytes. As with serial ports, an operation may
+	fail if the device is not ready. When a non-ready host socket becomes 
+	ready, a @c HOST_SOCKET_READY interrupt is raised on core 0. The
+	interrupt does not tell which host socket became ready, and it is also
+	sent on timeouts.
+
+	The host socket functions are not reentrant: they must be called with
+	interrupts disabled.
+
  */
 
 
@@ -123,6 +141,8 @@ typedef enum Interrupt
 						   from a serial port */
 	SERIAL_TX_READY,	/**< Raised when a serial port is ready to accept 
 						   data */
+	HOST_SOCKET_READY,	/**< Raised when a host socket is ready for an 
+						   operation that failed */
 
 	maximum_interrupt_no 
 } Interrupt;
@@ -343,6 +363,19 @@ TimerDuration bios_cancel_timer();
 TimerDuration bios_clock();
 
 
+/**
+	@brief Get the current time from a fine-grained monotonic clock.
+
+	This function returns a monotonic clock value, in usec, with
+	(roughly) microsecond resolution. Unlike @c bios_clock, it is
+	suitable for measuring short intervals, such as time-slices, but
+	its value is not related to the real-time clock.
+
+	@see bios_clock
+ */
+TimerDuration bios_cpu_clock();
+
+
 
 
 /**
@@ -403,4 +436,82 @@ int bios_read_serial(uint serial, char* ptr);
 int bios_write_serial(uint serial, char value);
 
 
+/** @brief Maximum number of host sockets, listening or connected. */
+#define MAX_HOST_SOCKETS 64
+
+/**
+	@brief Create a listening host socket.
+
+	A Unix-domain stream socket is bound to @c path, which is replaced if
+	it is a stale socket. The path is removed when the host socket is closed.
+
+	@param path the path of the socket in the host
+	@return the number of the host socket, or -1 on error
+ */
+int bios_hostsock_listen(const char* path);
+
+/**
+	@brief Accept a connection on a listening host socket.
+
+	If no connection is pending, -1 is returned, and a @c HOST_SOCKET_READY
+	interrupt will be raised when one arrives. Connections that arrive while
+	all host sockets are in use are refused.
+
+	@param hsock a listening host socket
+	@return the number of the host socket of the new connection, or -1
+ */
+int bios_hostsock_accept(int hsock);
+
+/**
+	@brief Receive bytes from a connected host socket.
+
+	If no data is available, -1 is returned, and a @c HOST_SOCKET_READY
+	interrupt will be raised when there are.
+
+	@param hsock a connected host socket
+	@param buf the buffer to store the data
+	@param size the size of @c buf, greater than 0
+	@return the number of bytes received, 0 at the end of data (or on
+		error), or -1 if the device is not ready
+ */
+int bios_hostsock_recv(int hsock, char* buf, unsigned int size);
+
+/**
+	@brief Send bytes to a connected host socket.
+
+	If no data can be sent, -1 is returned, and a @c HOST_SOCKET_READY
+	interrupt will be raised when some can.
+
+	@param hsock a connected host socket
+	@param buf the data
+	@param size the number of bytes, greater than 0
+	@return the number of bytes sent, 0 if the peer has closed the
+		connection (or on error), or -1 if the device is not ready
+ */
+int bios_hostsock_send(int hsock, const char* buf, unsigned int size);
+
+/** @brief A host socket can receive, or accept, without returning -1. */
+#define HOSTSOCK_RX 1
+/** @brief A host socket can send without returning -1. */
+#define HOSTSOCK_TX 2
+
+/**
+	@brief Check which directions of a host socket are ready.
+
+	A direction is ready when a transfer would not return -1, which 
+	includes the end of data and errors. For each direction that is not
+	ready, a @c HOST_SOCKET_READY interrupt will be raised when it becomes
+	ready. A listener only has the @c HOSTSOCK_RX direction.
+
+	@param hsock a host socket
+	@return a combination of @c HOSTSOCK_RX and @c HOSTSOCK_TX
+ */
+int bios_hostsock_poll(int hsock);
+
+/**
+	@brief Close a host socket.
+ */
+void bios_hostsock_close(int hsock);
+
+
 #endif
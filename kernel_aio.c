@@ -0,0 +1,326 @@
+
+#include <assert.h>
+#include "tinyos.h"
+#include "kernel_cc.h"
+#include "kernel_aio.h"
+#include "kernel_streams.h"
+
+
+/*
+  The ready list is updated by poll callbacks, which may run in interrupt
+  handlers, therefore the context lock is always taken with preemption off.
+  All other fields are protected by the kernel lock.
+ */
+
+static int aio_close(void* this);
+
+static file_ops aio_fops = {
+  .Open = NULL,
+  .Read = NULL,
+  .Write = NULL,
+  .Close = aio_close
+};
+
+
+/* Put a request on the ready list, unless it is already there */
+static void aio_enqueue(AIO_REQ* req)
+{
+  AIOCB* ctx = req->ctx;
+
+  int pre = preempt_off;
+  Mutex_Lock(&ctx->lock);
+  if(! req->queued) {
+    req->queued = 1;
+    rlist_push_back(&ctx->ready, &req->node);
+  }
+  Mutex_Unlock(&ctx->lock);
+  Cond_Broadcast(&ctx->has_events);
+  if(pre) preempt_on;
+}
+
+
+static void aio_notify(poll_entry* pe, unsigned int events)
+{
+  aio_enqueue((AIO_REQ*) pe->data);
+}
+
+
+/* Take a request off the ready list, if it is there */
+static void aio_dequeue(AIO_REQ* req)
+{
+  AIOCB* ctx = req->ctx;
+
+  int pre = preempt_off;
+  Mutex_Lock(&ctx->lock);
+  if(req->queued) {
+    req->queued = 0;
+    rlist_remove(&req->node);
+  }
+  Mutex_Unlock(&ctx->lock);
+  if(pre) preempt_on;
+}
+
+
+/* Try a request in non-blocking mode, returning its result */
+static int aio_try(AIO_REQ* req)
+{
+  aio_sqe* sqe = &req->sqe;
+  TCB* tcb = CURTHREAD;
+  unsigned int io_mode = tcb->io_mode;
+  int rc = -1;
+
+  tcb->io_mode = IO_MODE_NONBLOCK;
+  switch(sqe->opcode) {
+    case AIO_READ:
+      if(req->fcb->streamfunc->Read)
+        rc = req->fcb->streamfunc->Read(req->fcb->streamobj, sqe->buf, sqe->len);
+      break;
+    case AIO_WRITE:
+      if(req->fcb->streamfunc->Write)
+        rc = req->fcb->streamfunc->Write(req->fcb->streamobj, sqe->buf, sqe->len);
+      break;
+    case AIO_ACCEPT:
+      rc = sys_Accept(sqe->fid);
+      break;
+    case AIO_CONNECT:
+      rc = sys_Connect(sqe->fid, sqe->port, sqe->timeout);
+      break;
+    case AIO_CLOSE:
+      rc = sys_Close(sqe->fid);
+      break;
+  }
+  tcb->io_mode = io_mode;
+
+  if(sqe->opcode == AIO_READ || sqe->opcode == AIO_WRITE)
+    FCB_account(req->fcb, sqe->opcode == AIO_WRITE, rc);
+  return rc;
+}
+
+
+/* Register a request that would block on its stream */
+static void aio_arm(AIO_REQ* req)
+{
+  FCB* fcb = req->fcb;
+  unsigned int mask = (req->sqe.opcode == AIO_READ || req->sqe.opcode == AIO_ACCEPT)
+    ? POLL_READ : POLL_WRITE;
+  mask |= POLL_ERROR|POLL_HANGUP;
+
+  poll_entry_init(&req->pe, mask, aio_notify, req);
+  unsigned int events = fcb->streamfunc->Poll(fcb->streamobj, &req->pe);
+
+  /* It may have become ready in the meantime */
+  if(events & mask)
+    aio_enqueue(req);
+}
+
+
+static void aio_complete(AIO_REQ* req, int result)
+{
+  AIOCB* ctx = req->ctx;
+
+  poll_remove(&req->pe);
+  aio_dequeue(req);
+  if(req->fcb) {
+    FCB_decref(req->fcb);
+    req->fcb = NULL;
+  }
+
+  req->result = result;
+  rlist_remove(&req->ctx_node);
+  rlist_push_back(&ctx->done, &req->ctx_node);
+  ctx->ndone++;
+}
+
+
+/* Start a new request */
+static void aio_start(AIOCB* ctx, const aio_sqe* sqe)
+{
+  AIO_REQ* req = xmalloc(sizeof(AIO_REQ));
+  req->sqe = *sqe;
+  req->ctx = ctx;
+  req->fcb = NULL;
+  req->queued = 0;
+  req->deadline = (sqe->opcode == AIO_CONNECT && sqe->timeout != TIMEOUT_INFINITE)
+    ? bios_clock() + sqe->timeout*1000ul : NO_TIMEOUT;
+  poll_entry_init(&req->pe, 0, aio_notify, req);
+  rlnode_init(&req->node, req);
+  rlnode_init(&req->ctx_node, req);
+  ctx->count++;
+
+  /* All but AIO_CLOSE need an open stream */
+  if(sqe->opcode != AIO_CLOSE) {
+    req->fcb = get_fcb(sqe->fid);
+    if(req->fcb == NULL) {
+      aio_complete(req, -1);
+      return;
+    }
+    FCB_incref(req->fcb);
+  }
+
+  int rc = aio_try(req);
+  if(rc == IO_WOULDBLOCK && req->fcb->streamfunc->Poll) {
+    rlist_push_back(&ctx->inflight, &req->ctx_node);
+    aio_arm(req);
+  }
+  else
+    aio_complete(req, rc);
+}
+
+
+/* Retry the requests of the ready list */
+static void aio_progress(AIOCB* ctx)
+{
+  while(1) {
+    AIO_REQ* req = NULL;
+
+    int pre = preempt_off;
+    Mutex_Lock(&ctx->lock);
+    if(! is_rlist_empty(&ctx->ready)) {
+      req = rlist_pop_front(&ctx->ready)->obj;
+      req->queued = 0;
+    }
+    Mutex_Unlock(&ctx->lock);
+    if(pre) preempt_on;
+
+    if(req == NULL) break;
+
+    /* If it still would block, it stays registered for the next notification */
+    int rc = aio_try(req);
+    if(rc != IO_WOULDBLOCK)
+      aio_complete(req, rc);
+  }
+}
+
+
+/* Queue the requests in progress that have expired, and return the next deadline */
+static TimerDuration aio_expire(AIOCB* ctx, TimerDuration deadline)
+{
+  TimerDuration now = bios_clock();
+  for(rlnode* p = ctx->inflight.next; p != &ctx->inflight; p = p->next) {
+    AIO_REQ* req = p->obj;
+    if(req->deadline == NO_TIMEOUT) continue;
+    if(req->deadline <= now)
+      aio_enqueue(req);
+    else if(deadline == NO_TIMEOUT || req->deadline < deadline)
+      deadline = req->deadline;
+  }
+  return deadline;
+}
+
+
+static int aio_close(void* this)
+{
+  AIOCB* ctx = this;
+
+  /* Cancel the requests in progress */
+  while(! is_rlist_empty(&ctx->inflight)) {
+    AIO_REQ* req = rlist_pop_front(&ctx->inflight)->obj;
+    poll_remove(&req->pe);
+    aio_dequeue(req);
+    FCB_decref(req->fcb);
+    free(req);
+  }
+  while(! is_rlist_empty(&ctx->done))
+    free(rlist_pop_front(&ctx->done)->obj);
+
+  free(ctx);
+  return 0;
+}
+
+
+/* Return the context of a fid, or NULL */
+static FCB* get_aio_fcb(Fid_t fid)
+{
+  FCB* fcb = get_fcb(fid);
+  return (fcb && fcb->streamfunc == &aio_fops) ? fcb : NULL;
+}
+
+
+
+Fid_t sys_AioCreate()
+{
+  Fid_t fid;
+  FCB* fcb;
+
+  if(! FCB_reserve(1, &fid, &fcb))
+    return NOFILE;
+
+  AIOCB* ctx = xmalloc(sizeof(AIOCB));
+  ctx->lock = MUTEX_INIT;
+  rlnode_init(&ctx->ready, NULL);
+  ctx->has_events = COND_INIT;
+  rlnode_init(&ctx->inflight, NULL);
+  rlnode_init(&ctx->done, NULL);
+  ctx->ndone = 0;
+  ctx->count = 0;
+
+  fcb->streamobj = ctx;
+  fcb->streamfunc = &aio_fops;
+  return fid;
+}
+
+
+int sys_AioSubmit(Fid_t ctxfid, const aio_sqe* sqe, unsigned int n)
+{
+  FCB* ctxfcb = get_aio_fcb(ctxfid);
+  if(ctxfcb == NULL || (n > 0 && sqe == NULL))
+    return -1;
+  AIOCB* ctx = ctxfcb->streamobj;
+
+  /* An AIO_CLOSE request may close the context itself */
+  FCB_incref(ctxfcb);
+
+  unsigned int i;
+  for(i=0; i<n && ctx->count < MAX_AIO_INFLIGHT; i++)
+    aio_start(ctx, &sqe[i]);
+
+  FCB_decref(ctxfcb);
+  return i;
+}
+
+
+int sys_AioReap(Fid_t ctxfid, aio_cqe* cqe, unsigned int max, unsigned int min, timeout_t timeout)
+{
+  FCB* ctxfcb = get_aio_fcb(ctxfid);
+  if(ctxfcb == NULL || min > max || (max > 0 && cqe == NULL))
+    return -1;
+  AIOCB* ctx = ctxfcb->streamobj;
+
+  /* Make sure that the context is not closed while we sleep */
+  FCB_incref(ctxfcb);
+
+  /* Do not wait for requests that were never submitted */
+  if(min > ctx->count) min = ctx->count;
+
+  TimerDuration deadline = (timeout == TIMEOUT_INFINITE) ? NO_TIMEOUT : bios_clock() + timeout*1000ul;
+
+  while(1) {
+    TimerDuration wakeup = aio_expire(ctx, deadline);
+    aio_progress(ctx);
+    if(ctx->ndone >= min) break;
+
+    TimerDuration now = bios_clock();
+    if(deadline != NO_TIMEOUT && now >= deadline) break;
+
+    /* As in Poll, keep interrupts off between checking the ready list and sleeping */
+    preempt_off;
+    if(is_rlist_empty(&ctx->ready))
+      kernel_timedwait(&ctx->has_events, SCHED_POLL,
+        wakeup == NO_TIMEOUT ? NO_TIMEOUT : (wakeup > now ? wakeup - now : 0));
+    preempt_on;
+  }
+
+  unsigned int count = 0;
+  while(count < max && ! is_rlist_empty(&ctx->done)) {
+    AIO_REQ* req = rlist_pop_front(&ctx->done)->obj;
+    cqe[count].user_data = req->sqe.user_data;
+    cqe[count].result = req->result;
+    count++;
+    ctx->ndone--;
+    ctx->count--;
+    free(req);
+  }
+
+  FCB_decref(ctxfcb);
+  return count;
+}
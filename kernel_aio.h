@@ -0,0 +1,65 @@
+#ifndef __KERNEL_AIO_H
+#define __KERNEL_AIO_H
+
+#include "tinyos.h"
+#include "kernel_poll.h"
+#include "kernel_streams.h"
+
+/**
+	@file kernel_aio.h
+	@brief Asynchronous I/O.
+
+	@defgroup aio Asynchronous I/O.
+	@ingroup kernel
+	@brief Asynchronous I/O.
+
+	The requests of an asynchronous I/O context are executed by the thread
+	that submits them, in non-blocking mode (see @ref stream_wait). A request
+	that would block stays in progress: its poll entry is registered on the
+	stream, and when the stream notifies it, the request is put on the ready
+	list of the context. The next @c AioReap() retries the ready requests
+	only.
+
+	A stream whose requests may block must implement the @c Poll method.
+	On a stream without it, a request that would block completes with
+	@c IO_WOULDBLOCK.
+
+	A timed @c AIO_CONNECT request is not notified when its timeout expires,
+	so @c AioReap() retries it once its @c deadline has passed.
+
+	@{
+*/
+
+typedef struct aio_context AIOCB;
+
+/** @brief An asynchronous I/O request in the kernel. */
+typedef struct aio_request
+{
+  aio_sqe sqe;          /**< @brief A copy of the submitted request */
+  AIOCB* ctx;           /**< @brief The context */
+  FCB* fcb;             /**< @brief The stream, pinned while in progress */
+  poll_entry pe;        /**< @brief Registered on the stream while in progress */
+  int queued;           /**< @brief Set while in the ready list */
+  int result;           /**< @brief The result, when completed */
+  TimerDuration deadline; /**< @brief When a timed @c AIO_CONNECT expires, else @c NO_TIMEOUT */
+  rlnode node;          /**< @brief Node in the ready list */
+  rlnode ctx_node;      /**< @brief Node in the in-progress or completed list */
+} AIO_REQ;
+
+
+/** @brief The asynchronous I/O context stream object. */
+struct aio_context
+{
+  Mutex lock;           /**< @brief Protects the ready list, taken with preemption off */
+  rlnode ready;         /**< @brief Requests whose stream may be ready */
+  CondVar has_events;   /**< @brief Reapers sleep here */
+
+  rlnode inflight;      /**< @brief Requests in progress */
+  rlnode done;          /**< @brief Completed requests, not yet reaped */
+  unsigned int ndone;   /**< @brief The length of @c done */
+  unsigned int count;   /**< @brief Requests in progress or completed */
+};
+
+/** @} */
+
+#endif
@@ -126,6 +126,72 @@ int get_core_preemption();
 #define preempt_on  (set_core_preemption(1))
 
 
+
+/**
+	@brief Begin a write section of a sequence count.
+
+	A sequence count lets readers take consistent snapshots of some data
+	without locking: the count is odd while a write is in progress, and
+	a reader retries if the count changed while it was reading.
+
+	Writers must be serialized by other means (usually the kernel lock). 
+	Readers must only access memory that stays valid while they read, 
+	such as the static process table.
+
+	A typical read section is
+	@code
+	unsigned int s;
+	do {
+		s = seq_read_begin(&seq);
+		// copy the data
+	} while(seq_read_retry(&seq, s));
+	@endcode
+  */
+static inline void seq_write_begin(unsigned int* seq)
+{
+	__atomic_store_n(seq, *seq+1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/**
+	@brief End a write section of a sequence count.
+	@see seq_write_begin
+  */
+static inline void seq_write_end(unsigned int* seq)
+{
+	__atomic_store_n(seq, *seq+1, __ATOMIC_RELEASE);
+}
+
+/**
+	@brief Begin a read section of a sequence count.
+	@see seq_write_begin
+  */
+static inline unsigned int seq_read_begin(unsigned int* seq)
+{
+	unsigned int s;
+	while((s = __atomic_load_n(seq, __ATOMIC_ACQUIRE)) & 1) {
+#if defined(__x86_64__) || defined(__i386__)
+		__builtin_ia32_pause();
+#else
+		__asm__ volatile("" ::: "memory");
+#endif
+	}
+	return s;
+}
+
+/**
+	@brief End a read section of a sequence count.
+	@returns non-zero if the data read may be inconsistent and the read
+	section must be retried.
+	@see seq_write_begin
+  */
+static inline int seq_read_retry(unsigned int* seq, unsigned int s)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(seq, __ATOMIC_RELAXED) != s;
+}
+
+
 #endif
 
 
@@ -37,6 +37,44 @@ int nulldev_write(void* dev, const char* buf, unsigned int size)
 }
 
 
+int nulldev_readv(void* dev, const iovec_t* iov, unsigned int iovcnt)
+{
+  int count = 0;
+  for(unsigned int i=0; i<iovcnt; i++) {
+    memset(iov[i].base, 0, iov[i].len);
+    count += iov[i].len;
+  }
+  return count;
+}
+
+int nulldev_writev(void* dev, const iovec_t* iov, unsigned int iovcnt)
+{
+  int count = 0;
+  for(unsigned int i=0; i<iovcnt; i++)
+    count += iov[i].len;
+  return count;
+}
+
+int nulldev_splice(void* dev, int (*sink)(void*, const char*, unsigned int), 
+  void* sinkobj, unsigned int len)
+{
+  static const char zeros[SPLICE_BUFFER_SIZE];
+  int count = 0;
+  while(count < len) {
+    unsigned int n = (len - count < SPLICE_BUFFER_SIZE) ? len - count : SPLICE_BUFFER_SIZE;
+    int rc = sink(sinkobj, zeros, n);
+    if(rc <= 0) return count > 0 ? count : (rc < 0 ? rc : -1);
+    count += rc;
+    if(rc < n) break;
+  }
+  return count;
+}
+
+unsigned int nulldev_poll(void* dev, poll_entry* pe)
+{
+  return POLL_READ|POLL_WRITE;
+}
+
 int nulldev_close(void* dev) 
 {
   return 0;
@@ -51,7 +89,11 @@ static file_ops nulldev_fops = {
   .Open = nulldev_open,
   .Read = nulldev_read,
   .Write = nulldev_write,
-  .Close = nulldev_close
+  .Close = nulldev_close,
+  .Readv = nulldev_readv,
+  .Writev = nulldev_writev,
+  .Splice = nulldev_splice,
+  .Poll = nulldev_poll
 };
 
 
@@ -70,6 +112,9 @@ typedef struct serial_device_control_block {
   uint devno;
   Mutex spinlock;
   CondVar rx_ready;
+  poll_head rx_poll;    /* Notified on rx interrupts */
+  int rx_peeked;        /* Set if rx_char was read ahead by serial_poll */
+  char rx_char;
 } serial_dcb_t;
 
 serial_dcb_t serial_dcb[MAX_TERMINALS];
@@ -91,14 +136,29 @@ void serial_rx_handler()
   for(int i=0;i<bios_serial_ports();i++) {
     serial_dcb_t* dcb = &serial_dcb[i];
     Cond_Broadcast(&dcb->rx_ready);
+    poll_notify(&dcb->rx_poll, POLL_READ);
   }
   if(pre) preempt_on;
 }
 
 /*
-  Read from the device, sleeping if needed.
+  Read a byte from the device, if one is available, taking first any byte
+  read ahead by serial_poll.
  */
-int serial_read(void* dev, char *buf, unsigned int size)
+static int serial_getc(serial_dcb_t* dcb, char* c)
+{
+  if(dcb->rx_peeked) {
+    dcb->rx_peeked = 0;
+    *c = dcb->rx_char;
+    return 1;
+  }
+  return bios_read_serial(dcb->devno, c);
+}
+
+/*
+  Read from the device into a list of segments, sleeping if needed.
+ */
+int serial_readv(void* dev, const iovec_t* iov, unsigned int iovcnt)
 {
   serial_dcb_t* dcb = (serial_dcb_t*)dev;
 
@@ -106,24 +166,44 @@ int serial_read(void* dev, char *buf, unsigned int size)
 
   uint count =  0;
 
-  while(count<size) {
-    int valid = bios_read_serial(dcb->devno, &buf[count]);
+  for(uint i=0; i<iovcnt; i++) {
+    char* buf = iov[i].base;
+    uint pos = 0;
+
+    while(pos < iov[i].len) {
+      int valid = serial_getc(dcb, &buf[pos]);
     
-    if (valid) {
-      count++;
-    }
-    else if(count==0) {
-      kernel_wait(&dcb->rx_ready, SCHED_IO);
+      if (valid) {
+        pos++;
+        count++;
+      }
+      else if(count==0) {
+        int rc = stream_wait(&dcb->rx_ready, SCHED_IO);
+        if(rc < 0) {
+          preempt_on;
+          return rc;
+        }
+      }
+      else
+        goto done;
     }
-    else
-      break;
   }
 
+done:
   preempt_on;           /* Restart preemption */
 
   return count;
 }
 
+/*
+  Read from the device, sleeping if needed.
+ */
+int serial_read(void* dev, char *buf, unsigned int size)
+{
+  iovec_t iov = { buf, size };
+  return serial_readv(dev, &iov, 1);
+}
+
 
 /*
   A polling driver for serial writes
@@ -139,28 +219,66 @@ void serial_tx_handler()
   Write call 
   This is currently a polling driver.
 */
-int serial_write(void* dev, const char* buf, unsigned int size)
+int serial_writev(void* dev, const iovec_t* iov, unsigned int iovcnt)
 {
   serial_dcb_t* dcb = (serial_dcb_t*)dev;
 
   unsigned int count = 0;
-  while(count < size) {
-    int success = bios_write_serial(dcb->devno, buf[count] );
-
-    if(success) {
-      count++;
-    } 
-    else if(count==0)
-    {
-      yield(SCHED_IO);
+  for(uint i=0; i<iovcnt; i++) {
+    const char* buf = iov[i].base;
+    uint pos = 0;
+
+    while(pos < iov[i].len) {
+      int success = bios_write_serial(dcb->devno, buf[pos] );
+
+      if(success) {
+        pos++;
+        count++;
+      } 
+      else if(count==0)
+      {
+        int rc = stream_yield(SCHED_IO);
+        if(rc < 0) return rc;
+      }
+      else
+        return count;
     }
-    else
-      break;
   }
 
   return count;  
 }
 
+int serial_write(void* dev, const char* buf, unsigned int size)
+{
+  iovec_t iov = { (void*) buf, size };
+  return serial_writev(dev, &iov, 1);
+}
+
+
+/*
+  The device cannot tell if a byte is available without reading it,
+  therefore a byte is read ahead and kept until the next read.
+  Writes never block for long, as the driver is polling.
+ */
+unsigned int serial_poll(void* dev, poll_entry* pe)
+{
+  serial_dcb_t* dcb = (serial_dcb_t*)dev;
+  unsigned int events = POLL_WRITE;
+
+  int pre = preempt_off;
+
+  /* Register before checking, so that no rx interrupt is missed */
+  if(pe) poll_add(&dcb->rx_poll, pe);
+
+  if(dcb->rx_peeked || bios_read_serial(dcb->devno, &dcb->rx_char)) {
+    dcb->rx_peeked = 1;
+    events |= POLL_READ;
+  }
+
+  if(pre) preempt_on;
+  return events;
+}
+
 
 int serial_close(void* dev) 
 {
@@ -180,11 +298,220 @@ file_ops serial_fops = {
   .Open = serial_open,
   .Read = serial_read,
   .Write = serial_write,
-  .Close = serial_close
+  .Close = serial_close,
+  .Readv = serial_readv,
+  .Writev = serial_writev,
+  .Poll = serial_poll
 };
 
 
 
+/*============================================
+
+  The host socket driver
+
+ ============================================*/
+
+/*
+  A host socket stream is either a listener or a connection. Like the
+  serial driver, it sleeps when the BIOS reports that the device is not 
+  ready, until the next interrupt. Since the interrupt does not say which
+  host socket is ready, all of them share one condition variable and one
+  poll head.
+ */
+typedef struct host_socket_control_block {
+  int hsock;            /* The BIOS host socket */
+} hostsock_cb;
+
+/* All host socket streams wait here */
+static CondVar hostsock_ready = COND_INIT;
+static poll_head hostsock_poll_head;
+
+
+/* 
+  We do not know which host socket is ready, so we must signal them all!
+ */
+void hostsock_handler()
+{
+  int pre = preempt_off;
+  Cond_Broadcast(&hostsock_ready);
+  poll_notify(&hostsock_poll_head, POLL_READ|POLL_WRITE);
+  if(pre) preempt_on;
+}
+
+
+int hostsock_read(void* dev, char *buf, unsigned int size)
+{
+  hostsock_cb* hs = dev;
+  if(size == 0) return 0;
+
+  int pre = preempt_off;
+  int rc;
+  while((rc = bios_hostsock_recv(hs->hsock, buf, size)) == -1) {
+    int wrc = stream_wait(&hostsock_ready, SCHED_IO);
+    if(wrc < 0) { rc = wrc; break; }
+  }
+  if(pre) preempt_on;
+  return rc;
+}
+
+
+int hostsock_write(void* dev, const char* buf, unsigned int size)
+{
+  hostsock_cb* hs = dev;
+
+  int pre = preempt_off;
+  unsigned int count = 0;
+  int rc = 0;
+  while(count < size) {
+    rc = bios_hostsock_send(hs->hsock, buf+count, size-count);
+    if(rc > 0)
+      count += rc;
+    else if(rc == 0 || count > 0)
+      break;
+    else {
+      rc = stream_wait(&hostsock_ready, SCHED_IO);
+      if(rc < 0) break;
+    }
+  }
+  if(pre) preempt_on;
+
+  /* The host program is gone */
+  if(count == 0 && size > 0)
+    return (rc < 0) ? rc : -1;
+  return count;
+}
+
+
+int hostsock_close(void* dev)
+{
+  hostsock_cb* hs = dev;
+  int pre = preempt_off;
+  bios_hostsock_close(hs->hsock);
+  if(pre) preempt_on;
+  free(hs);
+  return 0;
+}
+
+
+/*
+  A listener is readable when a connection is pending. The BIOS raises an
+  interrupt later for each direction that is not ready now.
+ */
+unsigned int hostsock_poll(void* dev, poll_entry* pe)
+{
+  hostsock_cb* hs = dev;
+
+  int pre = preempt_off;
+
+  /* Register before checking, so that no interrupt is missed */
+  if(pe) poll_add(&hostsock_poll_head, pe);
+  int ready = bios_hostsock_poll(hs->hsock);
+
+  if(pre) preempt_on;
+
+  unsigned int events = 0;
+  if(ready & HOSTSOCK_RX) events |= POLL_READ;
+  if(ready & HOSTSOCK_TX) events |= POLL_WRITE;
+  return events;
+}
+
+
+static file_ops hostsock_fops = {
+  .Open = NULL,
+  .Read = hostsock_read,
+  .Write = hostsock_write,
+  .Close = hostsock_close,
+  .Poll = hostsock_poll
+};
+
+static file_ops hostsock_listener_fops = {
+  .Open = NULL,
+  .Read = NULL,
+  .Write = NULL,
+  .Close = hostsock_close,
+  .Poll = hostsock_poll
+};
+
+
+/* Make a stream for a BIOS host socket */
+static Fid_t hostsock_open(int hsock, file_ops* fops)
+{
+  Fid_t fid;
+  FCB* fcb;
+  if(! FCB_reserve(1, &fid, &fcb))
+    return NOFILE;
+
+  hostsock_cb* hs = xmalloc(sizeof(hostsock_cb));
+  hs->hsock = hsock;
+  fcb->streamobj = hs;
+  fcb->streamfunc = fops;
+  fcb->devtype = DEV_HOST;
+  return fid;
+}
+
+
+Fid_t sys_HostListen(const char* path)
+{
+  if(path == NULL)
+    return NOFILE;
+
+  int pre = preempt_off;
+  int hsock = bios_hostsock_listen(path);
+  if(pre) preempt_on;
+  if(hsock == -1)
+    return NOFILE;
+
+  Fid_t fid = hostsock_open(hsock, &hostsock_listener_fops);
+  if(fid == NOFILE) {
+    pre = preempt_off;
+    bios_hostsock_close(hsock);
+    if(pre) preempt_on;
+  }
+  return fid;
+}
+
+
+Fid_t sys_HostAccept(Fid_t lsock)
+{
+  FCB* lfcb = get_fcb(lsock);
+  if(lfcb == NULL || lfcb->streamfunc != &hostsock_listener_fops)
+    return NOFILE;
+  hostsock_cb* ls = lfcb->streamobj;
+
+  /* A non-blocking listener returns IO_WOULDBLOCK instead of waiting */
+  TCB* tcb = CURTHREAD;
+  unsigned int io_mode = tcb->io_mode;
+  if(lfcb->flags & FID_NONBLOCK) tcb->io_mode |= IO_MODE_NONBLOCK;
+
+  /* The listener must not go away while we sleep */
+  FCB_incref(lfcb);
+
+  int pre = preempt_off;
+  int hsock;
+  Fid_t fid = NOFILE;
+  while((hsock = bios_hostsock_accept(ls->hsock)) == -1) {
+    int rc = stream_wait(&hostsock_ready, SCHED_IO);
+    if(rc < 0) { fid = rc; break; }
+  }
+  if(pre) preempt_on;
+
+  if(hsock != -1) {
+    fid = hostsock_open(hsock, &hostsock_fops);
+    if(fid == NOFILE) {
+      pre = preempt_off;
+      bios_hostsock_close(hsock);
+      if(pre) preempt_on;
+    }
+  }
+
+  FCB_decref(lfcb);
+  tcb->io_mode = io_mode;
+  return fid;
+}
+
+
+
 /***********************************
 
   The device table
@@ -195,8 +522,25 @@ DCB devtable[DEV_MAX];
 
 
 
+static const char* devnames[DEV_MAX] = {
+  [DEV_NULL] = "null",
+  [DEV_SERIAL] = "serial",
+  [DEV_PIPE] = "pipe",
+  [DEV_SOCKET] = "socket",
+  [DEV_HOST] = "host",
+  [DEV_KERNEL] = "kernel"
+};
+
+
 void initialize_devices()
 {
+  /* Devices not opened by device_open have no minor numbers */
+  for(int d=0; d<DEV_MAX; d++) {
+    devtable[d].type = d;
+    devtable[d].devnum = 0;
+    devtable[d].name = devnames[d];
+    devtable[d].stats = (io_stats){ 0 };
+  }
 
   devtable[DEV_NULL].type = DEV_NULL;
   devtable[DEV_NULL].devnum = 1;
@@ -211,10 +555,15 @@ void initialize_devices()
     serial_dcb[i].devno = i;
     serial_dcb[i].rx_ready = COND_INIT;
     serial_dcb[i].spinlock = MUTEX_INIT;
+    poll_head_init(&serial_dcb[i].rx_poll);
+    serial_dcb[i].rx_peeked = 0;
   }
 
+  poll_head_init(&hostsock_poll_head);
+
   cpu_interrupt_handler(SERIAL_RX_READY, serial_rx_handler);
   cpu_interrupt_handler(SERIAL_TX_READY, serial_tx_handler);
+  cpu_interrupt_handler(HOST_SOCKET_READY, hostsock_handler);
 }
 
 
@@ -233,4 +582,10 @@ uint device_no(Device_type major)
   return devtable[major].devnum;
 }
 
+DCB* device_dcb(Device_type major)
+{
+  assert(major < DEV_MAX);
+  return &devtable[major];
+}
+
 
@@ -9,6 +9,8 @@
 
 #include "util.h"
 #include "bios.h"
+#include "tinyos.h"
+#include "kernel_poll.h"
 
 /**
   @file kernel_dev.h
@@ -92,6 +94,48 @@ typedef struct file_operations {
     - There was a I/O runtime problem.
      */
     int (*Close)(void* this);
+
+  /** @brief Vectored read operation (optional).
+
+    Read into the @c iovcnt segments of @c iov, with the semantics of @c Read
+    over their concatenation. If this is NULL, @c ReadV() calls @c Read 
+    once per segment.
+   */
+    int (*Readv)(void* this, const iovec_t* iov, unsigned int iovcnt);
+
+  /** @brief Vectored write operation (optional).
+
+    Write the @c iovcnt segments of @c iov, with the semantics of @c Write
+    over their concatenation. If this is NULL, @c WriteV() calls @c Write 
+    once per segment.
+   */
+    int (*Writev)(void* this, const iovec_t* iov, unsigned int iovcnt);
+
+  /** @brief Splice operation (optional).
+
+    Pass up to @c len bytes of the stream to the @c sink function (the Write
+    method of another stream), directly from the stream's own buffers. The
+    stream should block like @c Read, until some bytes are available. Only
+    the bytes accepted by the sink are consumed from the stream.
+
+    The function should return the number of bytes consumed, 0 at end of data,
+    or -1 on error. If this is NULL, @c Splice() copies through a buffer.
+   */
+    int (*Splice)(void* this, int (*sink)(void* sinkobj, const char* buf, unsigned int size),
+      void* sinkobj, unsigned int len);
+
+  /** @brief Poll operation (optional).
+
+    Return the events of @c POLL_READ, @c POLL_WRITE, @c POLL_ERROR and @c POLL_HANGUP
+    for which the stream is currently ready. If @c pe is not NULL, also 
+    register it on the poll heads of the stream, so that it is notified
+    when the stream becomes ready. The entry is unregistered by the caller,
+    with @c poll_remove.
+
+    If this is NULL, the stream is always ready for reading and writing.
+    @see poll_entry
+   */
+    unsigned int (*Poll)(void* this, poll_entry* pe);
 } file_ops;
 
 
@@ -104,6 +148,10 @@ typedef struct file_operations {
 typedef enum { 
 	DEV_NULL,    /**< @brief Null device */
 	DEV_SERIAL,  /**< @brief Serial device */
+	DEV_PIPE,    /**< @brief Pipes (not opened by @c device_open) */
+	DEV_SOCKET,  /**< @brief Sockets (not opened by @c device_open) */
+	DEV_HOST,    /**< @brief Host sockets (not opened by @c device_open) */
+	DEV_KERNEL,  /**< @brief Other kernel objects, e.g., information streams */
 	DEV_MAX      /**< @brief placeholder for maximum device number */
 }  Device_type;
 
@@ -126,6 +174,9 @@ typedef struct device_control_block
   file_ops dev_fops;	/**< @brief Device operations
 
   							This structure is provided by the device driver. */
+
+  const char* name;     /**< @brief The name of the device type */
+  io_stats stats;       /**< @brief I/O counters for all streams of this type */
 } DCB;
 
 
@@ -156,6 +207,11 @@ int device_open(Device_type major, uint minor, void** obj, file_ops** ops);
   */
 uint device_no(Device_type major);
 
+/**
+  @brief Get the device control block of a major number.
+  */
+DCB* device_dcb(Device_type major);
+
 /** @} */
 
 #endif
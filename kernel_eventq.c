@@ -0,0 +1,277 @@
+
+#include <assert.h>
+#include "tinyos.h"
+#include "kernel_cc.h"
+#include "kernel_eventq.h"
+#include "kernel_streams.h"
+
+
+/*
+  The ready list is updated by poll callbacks, which may run in interrupt
+  handlers, therefore the queue lock is always taken with preemption off.
+  All other fields of the queue and its items are protected by the kernel lock.
+ */
+
+static unsigned int evq_poll(void* this, poll_entry* pe);
+static int evq_close(void* this);
+
+static file_ops evq_fops = {
+  .Open = NULL,
+  .Read = NULL,
+  .Write = NULL,
+  .Close = evq_close,
+  .Poll = evq_poll
+};
+
+
+/* Append an item to the ready list, unless it is already there */
+static void evq_enqueue(EVQ_ITEM* item)
+{
+  EVQ* evq = item->evq;
+  int wake = 0;
+
+  int pre = preempt_off;
+  Mutex_Lock(&evq->lock);
+  if(! item->queued) {
+    item->queued = 1;
+    wake = is_rlist_empty(&evq->ready);
+    rlist_push_back(&evq->ready, &item->ready_node);
+  }
+  Mutex_Unlock(&evq->lock);
+
+  /* Only the first ready item needs to wake up the waiters */
+  if(wake) {
+    Cond_Broadcast(&evq->has_events);
+    poll_notify(&evq->poll, POLL_READ);
+  }
+  if(pre) preempt_on;
+}
+
+
+/* The poll callback of an item */
+static void evq_item_notify(poll_entry* pe, unsigned int events)
+{
+  evq_enqueue((EVQ_ITEM*) pe->data);
+}
+
+
+/* Return the current events of the stream of an item */
+static unsigned int evq_item_events(EVQ_ITEM* item, poll_entry* pe)
+{
+  FCB* fcb = item->fcb;
+  unsigned int events = fcb->streamfunc->Poll
+    ? fcb->streamfunc->Poll(fcb->streamobj, pe)
+    : POLL_READ|POLL_WRITE;
+  return events & (item->events|POLL_ERROR|POLL_HANGUP);
+}
+
+
+static EVQ_ITEM* evq_item_get(EVQ* evq, Fid_t fid)
+{
+  return (fid >= 0 && fid < evq->size) ? evq->item[fid] : NULL;
+}
+
+
+static EVQ_ITEM* evq_item_add(EVQ* evq, Fid_t fid, FCB* fcb, unsigned int events)
+{
+  if(fid >= evq->size) {
+    unsigned int size = evq->size;
+    while(size <= fid) size *= 2;
+    if(size > MAX_FILEID) size = MAX_FILEID;
+    evq->item = xrealloc(evq->item, size*sizeof(EVQ_ITEM*));
+    for(unsigned int i=evq->size; i<size; i++) evq->item[i] = NULL;
+    evq->size = size;
+  }
+
+  EVQ_ITEM* item = xmalloc(sizeof(EVQ_ITEM));
+  item->evq = evq;
+  item->fcb = fcb;
+  item->fid = fid;
+  item->events = events;
+  item->queued = 0;
+  rlnode_init(&item->ready_node, item);
+  rlnode_init(&item->watch_node, item);
+  poll_entry_init(&item->pe, events|POLL_ERROR|POLL_HANGUP, evq_item_notify, item);
+
+  rlist_push_back(&fcb->watchers, &item->watch_node);
+  evq->item[fid] = item;
+
+  /* Register on the stream, and catch the current state */
+  if(evq_item_events(item, &item->pe))
+    evq_enqueue(item);
+
+  return item;
+}
+
+
+static void evq_item_free(EVQ_ITEM* item)
+{
+  EVQ* evq = item->evq;
+
+  poll_remove(&item->pe);
+
+  int pre = preempt_off;
+  Mutex_Lock(&evq->lock);
+  if(item->queued) rlist_remove(&item->ready_node);
+  Mutex_Unlock(&evq->lock);
+  if(pre) preempt_on;
+
+  rlist_remove(&item->watch_node);
+  evq->item[item->fid] = NULL;
+  free(item);
+}
+
+
+void evq_release_stream(FCB* fcb)
+{
+  while(! is_rlist_empty(&fcb->watchers))
+    evq_item_free(fcb->watchers.next->obj);
+}
+
+
+static unsigned int evq_poll(void* this, poll_entry* pe)
+{
+  EVQ* evq = this;
+
+  int pre = preempt_off;
+  if(pe) poll_add(&evq->poll, pe);
+  unsigned int events = is_rlist_empty(&evq->ready) ? 0 : POLL_READ;
+  if(pre) preempt_on;
+
+  return events;
+}
+
+
+static int evq_close(void* this)
+{
+  EVQ* evq = this;
+
+  for(unsigned int fid=0; fid<evq->size; fid++)
+    if(evq->item[fid]) evq_item_free(evq->item[fid]);
+
+  poll_head_close(&evq->poll);
+  free(evq->item);
+  free(evq);
+  return 0;
+}
+
+
+/* Return the event queue of a fid, or NULL */
+static FCB* get_evq_fcb(Fid_t fid)
+{
+  FCB* fcb = get_fcb(fid);
+  return (fcb && fcb->streamfunc == &evq_fops) ? fcb : NULL;
+}
+
+
+
+Fid_t sys_EventQueueCreate()
+{
+  Fid_t fid;
+  FCB* fcb;
+
+  if(! FCB_reserve(1, &fid, &fcb))
+    return NOFILE;
+
+  EVQ* evq = xmalloc(sizeof(EVQ));
+  evq->lock = MUTEX_INIT;
+  rlnode_init(&evq->ready, NULL);
+  evq->has_events = COND_INIT;
+  poll_head_init(&evq->poll);
+  evq->size = 16;
+  evq->item = xmalloc(evq->size*sizeof(EVQ_ITEM*));
+  for(unsigned int i=0; i<evq->size; i++) evq->item[i] = NULL;
+
+  fcb->streamobj = evq;
+  fcb->streamfunc = &evq_fops;
+  return fid;
+}
+
+
+int sys_EventQueueCtl(Fid_t evqfid, evq_op op, Fid_t fid, unsigned int events)
+{
+  FCB* evqfcb = get_evq_fcb(evqfid);
+  if(evqfcb == NULL) return -1;
+  EVQ* evq = evqfcb->streamobj;
+
+  EVQ_ITEM* item = evq_item_get(evq, fid);
+
+  switch(op) {
+    case EVQ_ADD: {
+      FCB* fcb = get_fcb(fid);
+      /* Event queues cannot watch event queues */
+      if(fcb == NULL || item != NULL || fcb->streamfunc == &evq_fops)
+        return -1;
+      evq_item_add(evq, fid, fcb, events);
+      return 0;
+    }
+
+    case EVQ_MOD:
+      if(item == NULL) return -1;
+      item->events = events;
+      item->pe.mask = events|POLL_ERROR|POLL_HANGUP;
+      /* Report again the events which are already pending */
+      if(evq_item_events(item, NULL))
+        evq_enqueue(item);
+      return 0;
+
+    case EVQ_DEL:
+      if(item == NULL) return -1;
+      evq_item_free(item);
+      return 0;
+
+    default:
+      return -1;
+  }
+}
+
+
+int sys_EventQueueWait(Fid_t evqfid, pollfd_t* events, unsigned int max, timeout_t timeout)
+{
+  if(events == NULL || max == 0 || max > MAX_POLLFD)
+    return -1;
+
+  FCB* evqfcb = get_evq_fcb(evqfid);
+  if(evqfcb == NULL) return -1;
+  EVQ* evq = evqfcb->streamobj;
+
+  /* Make sure that the queue is not closed while we sleep */
+  FCB_incref(evqfcb);
+
+  TimerDuration deadline = (timeout == TIMEOUT_INFINITE) ? NO_TIMEOUT : bios_clock() + timeout*1000ul;
+  unsigned int count = 0;
+
+  /* As in Poll, keep interrupts off between checking the ready list and sleeping */
+  preempt_off;
+
+  while(1) {
+    /* Take the ready items, dropping those whose events have already been consumed */
+    while(count < max) {
+      Mutex_Lock(&evq->lock);
+      EVQ_ITEM* item = is_rlist_empty(&evq->ready) ? NULL : rlist_pop_front(&evq->ready)->obj;
+      if(item) item->queued = 0;
+      Mutex_Unlock(&evq->lock);
+      if(item == NULL) break;
+
+      unsigned int revents = evq_item_events(item, NULL);
+      if(revents) {
+        events[count].fid = item->fid;
+        events[count].events = item->events;
+        events[count].revents = revents;
+        count++;
+      }
+    }
+
+    if(count > 0 || timeout == 0) break;
+
+    TimerDuration now = bios_clock();
+    if(deadline != NO_TIMEOUT && now >= deadline) break;
+    if(! is_rlist_empty(&evq->ready)) continue;
+    kernel_timedwait(&evq->has_events, SCHED_POLL, deadline == NO_TIMEOUT ? NO_TIMEOUT : deadline - now);
+  }
+
+  preempt_on;
+
+  FCB_decref(evqfcb);
+  return count;
+}
@@ -0,0 +1,68 @@
+#ifndef __KERNEL_EVENTQ_H
+#define __KERNEL_EVENTQ_H
+
+#include "tinyos.h"
+#include "kernel_poll.h"
+#include "kernel_streams.h"
+
+/**
+	@file kernel_eventq.h
+	@brief Event queues.
+
+	@defgroup eventq Event queues.
+	@ingroup kernel
+	@brief Event queues.
+
+	An event queue holds a set of streams of interest, each registered
+	once with @c EventQueueCtl(). Each registered stream has an item,
+	whose poll entry is registered on the stream. When the stream notifies
+	its poll head, the item is appended to the ready list of the queue.
+	Therefore, @c EventQueueWait() only looks at the items that have
+	become ready since the last wait (edge-triggered), and its cost does
+	not depend on the number of registered streams.
+
+	Items do not hold a reference to their stream. Instead, each FCB keeps
+	a list of the items watching it, and they are removed when the FCB is
+	released.
+
+	@{
+*/
+
+typedef struct event_queue EVQ;
+
+/** @brief The registration of a stream on an event queue. */
+typedef struct event_queue_item
+{
+  EVQ* evq;               /**< @brief The event queue */
+  FCB* fcb;               /**< @brief The stream watched */
+  Fid_t fid;              /**< @brief The fid passed at registration */
+  unsigned int events;    /**< @brief The events of interest */
+  poll_entry pe;          /**< @brief Registered on the stream */
+  int queued;             /**< @brief Set while the item is in the ready list */
+  rlnode ready_node;      /**< @brief Node in the ready list of the queue */
+  rlnode watch_node;      /**< @brief Node in the watchers list of the FCB */
+} EVQ_ITEM;
+
+
+/** @brief The event queue stream object. */
+struct event_queue
+{
+  Mutex lock;             /**< @brief Protects the ready list, taken with preemption off */
+  rlnode ready;           /**< @brief Items which may be ready */
+  CondVar has_events;     /**< @brief Waiters sleep here */
+  poll_head poll;         /**< @brief For polling the queue itself */
+
+  EVQ_ITEM** item;        /**< @brief The items, indexed by fid */
+  unsigned int size;      /**< @brief The size of the item array */
+};
+
+
+/** @brief Remove a stream from all the event queues watching it.
+
+	This is called when the FCB of the stream is released.
+  */
+void evq_release_stream(FCB* fcb);
+
+/** @} */
+
+#endif
@@ -1,9 +1,712 @@
 
+#include <sys/mman.h>
+#include <limits.h>
 #include "tinyos.h"
+#include "kernel_pipe.h"
+#include "kernel_socket.h"
+#include "kernel_sched.h"
+
+
+/*
+  All pipe state is protected by the kernel lock.
+ */
+
+/* The total capacity of all pipes */
+static unsigned long pipe_memory = 0;
+
+static file_ops pipe_reader_fops = {
+  .Open = NULL,
+  .Read = sys_Pipe_Read,
+  .Write = NULL,
+  .Close = sys_Pipe_Reader_Close,
+  .Readv = sys_Pipe_Readv,
+  .Splice = sys_Pipe_Splice,
+  .Poll = pipe_reader_poll
+};
+
+static file_ops pipe_writer_fops = {
+  .Open = NULL,
+  .Read = NULL,
+  .Write = sys_Pipe_Write,
+  .Close = sys_Pipe_Writer_Close,
+  .Writev = sys_Pipe_Writev,
+  .Poll = pipe_writer_poll
+};
+
+
+static inline uint pipe_count(PIPE_CB* pipe)
+{
+  return pipe->write_pos - pipe->read_pos;
+}
+
+/* The data available to readers, including a direct write */
+static inline uint pipe_avail(PIPE_CB* pipe)
+{
+  return pipe_count(pipe) + pipe->direct_len;
+}
+
+/* The space available to writers, none while a direct write is pending */
+static inline uint pipe_space(PIPE_CB* pipe)
+{
+  return pipe->direct_buf ? 0 : pipe->size - pipe_count(pipe);
+}
+
+static inline uint min_uint(uint a, uint b) { return a < b ? a : b; }
+
+
+/* Copy bytes out of the ring, starting at a position */
+static void ring_get(PIPE_CB* pipe, uint pos, char* buf, uint n)
+{
+  /* At most two spans: up to the end of the buffer, and from its start */
+  pos &= pipe->size-1;
+  uint first = pipe->size - pos;
+  if(first > n) first = n;
+  memcpy(buf, pipe->buffer + pos, first);
+  memcpy(buf + first, pipe->buffer, n - first);
+}
+
+
+/* Copy bytes into the ring, starting at a position */
+static void ring_put(PIPE_CB* pipe, uint pos, const char* buf, uint n)
+{
+  pos &= pipe->size-1;
+  uint first = pipe->size - pos;
+  if(first > n) first = n;
+  memcpy(pipe->buffer + pos, buf, first);
+  memcpy(pipe->buffer, buf + first, n - first);
+}
+
+
+/* Wake up the readers, if there are enough data for one of them */
+static void pipe_wake_readers(PIPE_CB* pipe)
+{
+  uint count = pipe_avail(pipe);
+  if(count >= pipe->read_need) {
+    pipe->read_need = UINT_MAX;
+    Cond_Broadcast(&pipe->has_data);
+  }
+  if(count >= min_uint(pipe->read_lowat, pipe->size))
+    poll_notify(pipe->reader_poll, POLL_READ);
+}
+
+
+/* Wake up the writers, if there is enough space for one of them */
+static void pipe_wake_writers(PIPE_CB* pipe)
+{
+  uint space = pipe_space(pipe);
+  if(space >= pipe->write_need) {
+    pipe->write_need = UINT_MAX;
+    Cond_Broadcast(&pipe->has_space);
+  }
+  if(space >= min_uint(pipe->write_lowat, pipe->size))
+    poll_notify(pipe->writer_poll, POLL_WRITE);
+}
+
+
+/* 
+  What blocked callers wait for depends on the size and the watermarks. 
+  When these change, they all wake up to check again.
+ */
+static void pipe_recheck_waiters(PIPE_CB* pipe)
+{
+  pipe->read_need = UINT_MAX;
+  pipe->write_need = UINT_MAX;
+  Cond_Broadcast(&pipe->has_data);
+  Cond_Broadcast(&pipe->has_space);
+  pipe_wake_readers(pipe);
+  pipe_wake_writers(pipe);
+}
+
+
+static char* pipe_buffer_alloc(uint size)
+{
+  pipe_memory += size;
+  if(size <= PIPE_MMAP_THRESHOLD)
+    return xmalloc(size);
+
+  /* The host commits the pages on first touch */
+  void* ptr = mmap(NULL, size, PROT_READ|PROT_WRITE, 
+    MAP_ANONYMOUS|MAP_PRIVATE|MAP_NORESERVE, -1, 0);
+  if(ptr == MAP_FAILED) {
+    perror("pipe_buffer_alloc");
+    abort();
+  }
+  return ptr;
+}
+
+
+static void pipe_buffer_free(char* buffer, uint size)
+{
+  pipe_memory -= size;
+  if(size <= PIPE_MMAP_THRESHOLD)
+    free(buffer);
+  else
+    CHECK(munmap(buffer, size));
+}
+
+
+uint pipe_round_size(unsigned int size)
+{
+  if(size == 0) return PIPE_DEFAULT_SIZE;
+  if(size > PIPE_MAX_SIZE) return 0;
+
+  uint rsize = PIPE_MIN_SIZE;
+  while(rsize < size) rsize <<= 1;
+  return rsize;
+}
+
+
+int pipe_resize(PIPE_CB* pipe, uint size)
+{
+  uint count = pipe_count(pipe);
+  if(size == pipe->size) return 0;
+  if(count > size) return -1;
+  if(size > pipe->size && pipe_memory - pipe->size + size > PIPE_MEMORY_LIMIT)
+    return -1;
+  if(! kmem_recharge(CURPROC, &pipe->kmem, size))
+    return -1;
+
+  /* Move the data to the start of the new buffer */
+  char* buffer = pipe_buffer_alloc(size);
+  ring_get(pipe, pipe->read_pos, buffer, count);
+
+  pipe_buffer_free(pipe->buffer, pipe->size);
+  pipe->buffer = buffer;
+  pipe->size = size;
+  pipe->read_pos = 0;
+  pipe->write_pos = count;
+
+  /* A packet writer whose message no longer fits fails */
+  pipe_recheck_waiters(pipe);
+  return 0;
+}
+
+
+PIPE_CB* construct_Pipe()
+{
+  PIPE_CB* pipe = xmalloc(sizeof(PIPE_CB));
+  if(! kmem_charge(CURPROC, &pipe->kmem, PIPE_DEFAULT_SIZE)) {
+    free(pipe);
+    return NULL;
+  }
+  pipe->size = PIPE_DEFAULT_SIZE;
+  pipe->buffer = pipe_buffer_alloc(pipe->size);
+  pipe->read = NULL;
+  pipe->write = NULL;
+  pipe->write_pos = 0;
+  pipe->read_pos = 0;
+  pipe->has_space = COND_INIT;
+  pipe->has_data = COND_INIT;
+  pipe->users = 0;
+  pipe->packet = 0;
+  pipe->direct = 0;
+  pipe->direct_buf = NULL;
+  pipe->direct_len = 0;
+  pipe->direct_done = COND_INIT;
+  pipe->read_lowat = 1;
+  pipe->write_lowat = 1;
+  pipe->read_need = UINT_MAX;
+  pipe->write_need = UINT_MAX;
+  poll_head_init(&pipe->read_poll);
+  poll_head_init(&pipe->write_poll);
+  pipe->reader_poll = &pipe->read_poll;
+  pipe->writer_poll = &pipe->write_poll;
+  return pipe;
+}
+
+
+void pipe_set_watermarks(PIPE_CB* pipe, uint read_lowat, uint write_lowat)
+{
+  pipe->read_lowat = read_lowat;
+  pipe->write_lowat = write_lowat;
+  pipe_recheck_waiters(pipe);
+}
+
+
+void pipe_free(PIPE_CB* pipe)
+{
+  poll_head_close(&pipe->read_poll);
+  poll_head_close(&pipe->write_poll);
+  pipe_buffer_free(pipe->buffer, pipe->size);
+  kmem_uncharge(&pipe->kmem);
+  free(pipe);
+}
+
+
+/* Free the pipe when both ends are closed, and no call is still in it */
+static void pipe_release(PIPE_CB* pipe)
+{
+  if(pipe->read == NULL && pipe->write == NULL && pipe->users == 0)
+    pipe_free(pipe);
+}
+
+
+/* The total length of a segment list, checked by the caller */
+static uint iov_total(const iovec_t* iov, unsigned int iovcnt)
+{
+  uint total = 0;
+  for(unsigned int i=0; i<iovcnt; i++)
+    total += iov[i].len;
+  return total;
+}
+
+
+static int pipe_read_packet(PIPE_CB* pipe, const iovec_t* iov, unsigned int iovcnt)
+{
+  while(pipe_count(pipe) == 0) {
+    if(pipe->write == NULL) return 0;
+    if(pipe->read_need > 1) pipe->read_need = 1;
+    int rc = stream_wait(&pipe->has_data, SCHED_PIPE);
+    if(pipe->read == NULL) return -1;
+    if(rc < 0) return rc;
+  }
+
+  /* Messages are written whole, so this one is all there */
+  uint len;
+  ring_get(pipe, pipe->read_pos, (char*) &len, sizeof(len));
+  uint pos = pipe->read_pos + sizeof(len);
+  uint n = 0;
+  for(unsigned int i=0; i<iovcnt && n < len; i++) {
+    uint m = min_uint(iov[i].len, len - n);
+    ring_get(pipe, pos + n, iov[i].base, m);
+    n += m;
+  }
+
+  /* The rest of the message is discarded */
+  pipe->read_pos = pos + len;
+
+  pipe_wake_writers(pipe);
+  return n;
+}
+
+
+static int pipe_write_packet(PIPE_CB* pipe, const iovec_t* iov, unsigned int iovcnt)
+{
+  uint size = iov_total(iov, iovcnt);
+  uint need = sizeof(uint) + size;
+
+  while(pipe_space(pipe) < need) {
+    /* The pipe may have shrunk */
+    if(need > pipe->size) return -1;
+    if(pipe->write_need > need) pipe->write_need = need;
+    int rc = stream_wait(&pipe->has_space, SCHED_PIPE);
+    if(pipe->read == NULL || pipe->write == NULL) return -1;
+    if(rc < 0) return rc;
+  }
+
+  ring_put(pipe, pipe->write_pos, (const char*) &size, sizeof(uint));
+  uint pos = pipe->write_pos + sizeof(uint);
+  for(unsigned int i=0; i<iovcnt; i++) {
+    ring_put(pipe, pos, iov[i].base, iov[i].len);
+    pos += iov[i].len;
+  }
+  pipe->write_pos += need;
+
+  pipe_wake_readers(pipe);
+  return size;
+}
+
+
+/* 
+  How much data a reader waits for, and how much space a writer waits for. 
+  They depend on the size and the watermarks, which may change while the
+  caller sleeps, so they are recomputed after each wakeup.
+ */
+static uint pipe_read_need(PIPE_CB* pipe, uint size)
+{
+  uint need = pipe->read_lowat;
+  if(need < stream_read_min()) need = stream_read_min();
+  return min_uint(need, min_uint(size, pipe->size));
+}
+
+static uint pipe_write_need(PIPE_CB* pipe, uint size)
+{
+  return min_uint(pipe->write_lowat, min_uint(size, pipe->size));
+}
+
+
+/* Wait until a read of @c size bytes can go on. Return 0, or a negative error */
+static int pipe_wait_data(PIPE_CB* pipe, uint size)
+{
+  uint need;
+  while(pipe_avail(pipe) < (need = pipe_read_need(pipe, size)) && pipe->write != NULL) {
+    if(pipe->read_need > need) pipe->read_need = need;
+    int rc = stream_wait(&pipe->has_data, SCHED_PIPE);
+    if(pipe->read == NULL) return -1;
+    /* If we cannot wait, take what is there */
+    if(rc < 0) {
+      if(pipe_avail(pipe) > 0) break;
+      return rc;
+    }
+  }
+  return 0;
+}
+
+
+/* Consume bytes, first from the ring and then from a direct writer */
+static void pipe_consume(PIPE_CB* pipe, char* buf, uint n)
+{
+  uint m = min_uint(pipe_count(pipe), n);
+  if(buf) ring_get(pipe, pipe->read_pos, buf, m);
+  pipe->read_pos += m;
+
+  if(m < n) {
+    if(buf) memcpy(buf + m, pipe->direct_buf, n - m);
+    pipe->direct_buf += n - m;
+    pipe->direct_len -= n - m;
+    if(pipe->direct_len == 0)
+      Cond_Broadcast(&pipe->direct_done);
+  }
+}
+
+
+static int pipe_read(PIPE_CB* pipe, const iovec_t* iov, unsigned int iovcnt)
+{
+  int rc = pipe_wait_data(pipe, iov_total(iov, iovcnt));
+  if(rc < 0) return rc;
+
+  /* Fill the segments in order, until the data run out */
+  uint n = 0;
+  for(unsigned int i=0; i<iovcnt && pipe_avail(pipe) > 0; i++) {
+    uint m = min_uint(pipe_avail(pipe), iov[i].len);
+    pipe_consume(pipe, iov[i].base, m);
+    n += m;
+  }
+
+  pipe_wake_writers(pipe);
+  return n;
+}
+
+
+int sys_Pipe_Readv(void* stream_object, const iovec_t* iov, unsigned int iovcnt)
+{
+  PIPE_CB* pipe = stream_object;
+
+  /* A socket may close this end while we sleep */
+  pipe->users++;
+  int rc = pipe->packet ? pipe_read_packet(pipe, iov, iovcnt) : pipe_read(pipe, iov, iovcnt);
+  pipe->users--;
+  pipe_release(pipe);
+  return rc;
+}
+
+
+int sys_Pipe_Read(void* stream_object, char *buf, unsigned int size)
+{
+  iovec_t iov = { buf, size };
+  return sys_Pipe_Readv(stream_object, &iov, 1);
+}
+
+
+/*
+  Pass the data to the sink straight from the ring (or from a direct 
+  writer). The sink must not sleep while it holds a pointer to them, since
+  other calls may consume them or resize the ring meanwhile, so it is 
+  called in non-blocking mode. If it would block and we may, we copy a 
+  chunk out and wait on the sink with that.
+ */
+static int pipe_splice(PIPE_CB* pipe, int (*sink)(void*, const char*, unsigned int),
+  void* sinkobj, uint len)
+{
+  int rc = pipe_wait_data(pipe, len);
+  if(rc < 0) return rc;
+  if(pipe_avail(pipe) == 0) return 0;
+
+  unsigned int io_mode = CURTHREAD->io_mode;
+  CURTHREAD->io_mode |= IO_MODE_NONBLOCK;
+  uint count = 0;
+  while(count < len && pipe_avail(pipe) > 0) {
+    /* The next contiguous span */
+    const char* span;
+    uint n;
+    if(pipe_count(pipe) > 0) {
+      uint pos = pipe->read_pos & (pipe->size-1);
+      span = pipe->buffer + pos;
+      n = min_uint(pipe_count(pipe), pipe->size - pos);
+    } else {
+      span = pipe->direct_buf;
+      n = pipe->direct_len;
+    }
+    n = min_uint(n, len - count);
+
+    rc = sink(sinkobj, span, n);
+    if(rc <= 0) break;
+    pipe_consume(pipe, NULL, rc);
+    count += rc;
+    if(rc < n) break;
+  }
+  CURTHREAD->io_mode = io_mode;
+
+  if(count == 0 && rc == IO_WOULDBLOCK && !(io_mode & IO_MODE_NONBLOCK)) {
+    char buffer[SPLICE_BUFFER_SIZE];
+    uint n = min_uint(min_uint(pipe_avail(pipe), len), SPLICE_BUFFER_SIZE);
+    pipe_consume(pipe, buffer, n);
+    pipe_wake_writers(pipe);
+    return stream_splice_copy(sink, sinkobj, buffer, n);
+  }
+
+  pipe_wake_writers(pipe);
+  if(count > 0) return count;
+  return rc < 0 ? rc : -1;
+}
+
+
+int sys_Pipe_Splice(void* stream_object, int (*sink)(void*, const char*, unsigned int),
+  void* sinkobj, unsigned int len)
+{
+  PIPE_CB* pipe = stream_object;
+
+  pipe->users++;
+  int rc;
+  if(pipe->packet) {
+    /* One message, which is cut to the size of the buffer */
+    char buffer[SPLICE_BUFFER_SIZE];
+    iovec_t iov = { buffer, min_uint(len, SPLICE_BUFFER_SIZE) };
+    rc = pipe_read_packet(pipe, &iov, 1);
+    if(rc > 0) rc = stream_splice_copy(sink, sinkobj, buffer, rc);
+  }
+  else
+    rc = pipe_splice(pipe, sink, sinkobj, len);
+  pipe->users--;
+  pipe_release(pipe);
+  return rc;
+}
+
+
+/* Hand the buffer of a blocking writer to the readers */
+static int pipe_write_direct(PIPE_CB* pipe, const char *buf, unsigned int size)
+{
+  /* One direct write at a time */
+  while(pipe->direct_buf != NULL) {
+    stream_wait(&pipe->direct_done, SCHED_PIPE);
+    if(pipe->read == NULL || pipe->write == NULL) return -1;
+  }
+
+  pipe->direct_buf = buf;
+  pipe->direct_len = size;
+  pipe_wake_readers(pipe);
+
+  while(pipe->direct_len > 0 && pipe->read != NULL && pipe->write != NULL)
+    stream_wait(&pipe->direct_done, SCHED_PIPE);
+
+  /* If either end was closed, return what was read, if anything */
+  uint n = size - pipe->direct_len;
+  pipe->direct_buf = NULL;
+  pipe->direct_len = 0;
+  Cond_Broadcast(&pipe->direct_done);
+  pipe_wake_writers(pipe);
+  return (n > 0) ? (int) n : -1;
+}
+
+
+static int pipe_write(PIPE_CB* pipe, const iovec_t* iov, unsigned int iovcnt)
+{
+  uint size = iov_total(iov, iovcnt);
+
+  /* Only a blocking write of one buffer can lend it */
+  if(pipe->direct && iovcnt == 1 && size >= PIPE_DIRECT_MIN && size > pipe_space(pipe) 
+      && CURTHREAD->io_mode == 0)
+    return pipe_write_direct(pipe, iov[0].base, size);
+
+  uint need;
+  while(pipe_space(pipe) < (need = pipe_write_need(pipe, size))) {
+    if(pipe->write_need > need) pipe->write_need = need;
+    int rc = stream_wait(&pipe->has_space, SCHED_PIPE);
+    if(pipe->read == NULL || pipe->write == NULL) return -1;
+    /* If we cannot wait, put what fits */
+    if(rc < 0) {
+      if(pipe_space(pipe) > 0) break;
+      return rc;
+    }
+  }
+
+  /* Put the segments in order, until the space runs out */
+  uint n = min_uint(pipe_space(pipe), size);
+  uint done = 0;
+  for(unsigned int i=0; i<iovcnt && done < n; i++) {
+    uint m = min_uint(iov[i].len, n - done);
+    ring_put(pipe, pipe->write_pos + done, iov[i].base, m);
+    done += m;
+  }
+  pipe->write_pos += n;
+
+  pipe_wake_readers(pipe);
+  return n;
+}
+
+
+int sys_Pipe_Writev(void* stream_object, const iovec_t* iov, unsigned int iovcnt)
+{
+  PIPE_CB* pipe = stream_object;
+
+  if(pipe->read == NULL) return -1;
+  if(iov_total(iov, iovcnt) == 0) return 0;
+
+  /* A socket may close this end while we sleep */
+  pipe->users++;
+  int rc = pipe->packet ? pipe_write_packet(pipe, iov, iovcnt) : pipe_write(pipe, iov, iovcnt);
+  pipe->users--;
+  pipe_release(pipe);
+  return rc;
+}
+
+
+int sys_Pipe_Write(void* stream_object, const char *buf, unsigned int size)
+{
+  iovec_t iov = { (void*) buf, size };
+  return sys_Pipe_Writev(stream_object, &iov, 1);
+}
+
+
+int sys_Pipe_Writer_Close(void* streamobj)
+{
+  PIPE_CB* pipe = streamobj;
+  pipe->write = NULL;
+
+  /* Writers still inside, which a socket allows, fail */
+  pipe->write_need = UINT_MAX;
+  Cond_Broadcast(&pipe->has_space);
+  Cond_Broadcast(&pipe->direct_done);
+
+  if(pipe->read == NULL) {
+    pipe_release(pipe);
+  } else {
+    /* Readers get the end of data */
+    pipe->read_need = UINT_MAX;
+    Cond_Broadcast(&pipe->has_data);
+    poll_notify(pipe->reader_poll, POLL_READ|POLL_HANGUP);
+  }
+  return 0;
+}
+
+
+int sys_Pipe_Reader_Close(void* streamobj)
+{
+  PIPE_CB* pipe = streamobj;
+  pipe->read = NULL;
+
+  /* Nobody will read the data, so drop them without copying. Readers 
+     still inside, which a socket allows, fail */
+  pipe->read_pos = pipe->write_pos;
+  pipe->read_need = UINT_MAX;
+  Cond_Broadcast(&pipe->has_data);
+
+  if(pipe->write == NULL) {
+    pipe_release(pipe);
+  } else {
+    /* Writers fail */
+    pipe->write_need = UINT_MAX;
+    Cond_Broadcast(&pipe->has_space);
+    Cond_Broadcast(&pipe->direct_done);
+    poll_notify(pipe->writer_poll, POLL_ERROR);
+  }
+  return 0;
+}
+
+
+unsigned int pipe_reader_poll(void* streamobj, poll_entry* pe)
+{
+  PIPE_CB* pipe = streamobj;
+  if(pe) poll_add(pipe->reader_poll, pe);
+
+  unsigned int events = 0;
+  if(pipe_avail(pipe) >= min_uint(pipe->read_lowat, pipe->size)) events |= POLL_READ;
+  if(pipe->write == NULL) events |= POLL_READ|POLL_HANGUP;
+  return events;
+}
+
+
+unsigned int pipe_writer_poll(void* streamobj, poll_entry* pe)
+{
+  PIPE_CB* pipe = streamobj;
+  if(pe) poll_add(pipe->writer_poll, pe);
+
+  unsigned int events = 0;
+  if(pipe_space(pipe) >= min_uint(pipe->write_lowat, pipe->size)) events |= POLL_WRITE;
+  if(pipe->read == NULL) events |= POLL_ERROR;
+  return events;
+}
+
+
+/* Return the pipe of either end, or NULL */
+static PIPE_CB* get_pipe(Fid_t fid)
+{
+  FCB* fcb = get_fcb(fid);
+  if(fcb == NULL) return NULL;
+  if(fcb->streamfunc != &pipe_reader_fops && fcb->streamfunc != &pipe_writer_fops)
+    return NULL;
+  return fcb->streamobj;
+}
+
+
+int sys_PipeEx(pipe_t* pipe, unsigned int size, unsigned int flags)
+{
+  Fid_t fid[2];
+  FCB* fcb[2];
+
+  uint rsize = pipe_round_size(size);
+  if(pipe == NULL || rsize == 0 || (flags & ~PIPE_PACKET))
+    return -1;
+
+  if(! FCB_reserve(2, fid, fcb))
+    return -1;
+
+  PIPE_CB* p = construct_Pipe();
+  if(p == NULL || pipe_resize(p, rsize) != 0) {
+    if(p) pipe_free(p);
+    FCB_unreserve(2, fid, fcb);
+    return -1;
+  }
+  p->packet = (flags & PIPE_PACKET) ? 1 : 0;
+  p->read = fcb[0];
+  p->write = fcb[1];
+
+  fcb[0]->streamobj = p;
+  fcb[0]->streamfunc = &pipe_reader_fops;
+  fcb[0]->devtype = DEV_PIPE;
+  fcb[1]->streamobj = p;
+  fcb[1]->streamfunc = &pipe_writer_fops;
+  fcb[1]->devtype = DEV_PIPE;
+
+  pipe->read = fid[0];
+  pipe->write = fid[1];
+  return 0;
+}
 
 
 int sys_Pipe(pipe_t* pipe)
 {
-	return -1;
+  return sys_PipeEx(pipe, PIPE_DEFAULT_SIZE, 0);
 }
 
+
+int sys_PipeSetSize(Fid_t fid, unsigned int size)
+{
+  PIPE_CB* pipe = get_pipe(fid);
+  uint rsize = pipe_round_size(size);
+  if(pipe == NULL || rsize == 0)
+    return -1;
+  return pipe_resize(pipe, rsize);
+}
+
+
+int sys_PipeGetSize(Fid_t fid)
+{
+  PIPE_CB* pipe = get_pipe(fid);
+  return pipe ? (int) pipe->size : -1;
+}
+
+
+int sys_SetWatermarks(Fid_t fid, unsigned int read_lowat, unsigned int write_lowat)
+{
+  if(read_lowat == 0 || write_lowat == 0)
+    return -1;
+
+  PIPE_CB* pipe = get_pipe(fid);
+  if(pipe == NULL)
+    return socket_set_watermarks(fid, read_lowat, write_lowat);
+  if(pipe->packet)
+    return -1;
+  pipe_set_watermarks(pipe, read_lowat, write_lowat);
+  return 0;
+}
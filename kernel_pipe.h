@@ -5,35 +5,195 @@
 #include "kernel_dev.h"
 #include "kernel_cc.h"
 #include "kernel_streams.h"
+#include "kernel_poll.h"
 
-#define BUFF_SIZE 8192
+/**
+	@file kernel_pipe.h
+	@brief Pipes.
 
+	@defgroup pipes Pipes.
+	@ingroup kernel
+	@brief Pipes.
 
+	A pipe is a ring buffer whose size is a power of 2. The read and write
+	positions are free-running counters: the number of bytes in the buffer
+	is always @c write_pos-read_pos, and a position is mapped into the
+	buffer by masking. Therefore, no separate count is kept, the full and
+	empty states are not ambiguous, and each end only updates its own
+	position.
+
+	A read or write copies the largest contiguous spans it can, that is, at
+	most two @c memcpy calls per buffer, and blocks only when it cannot 
+	transfer anything at all. A splice from the read end passes the spans
+	of the ring straight to the destination; since the destination must 
+	not sleep while it holds them, it is called in non-blocking mode, and 
+	only when it would block does the splice copy the data out first.
+
+	In a packet pipe, each message is stored in the ring buffer as a 
+	header with its length, followed by its bytes.
+
+	Blocked readers and writers are woken up only when there is enough 
+	data or space for at least one of them. How much is enough depends on
+	the watermarks of the pipe and on the size of each call (see 
+	@c SetWatermarks() and @c ReadAtLeast()).
+
+	A pipe may also allow direct writes. Then, a blocking write of at
+	least @c PIPE_DIRECT_MIN bytes that does not fit in the ring is not
+	copied into it. Instead, the writer publishes its own buffer and 
+	sleeps, and readers copy from that buffer straight into theirs, after
+	the data in the ring. Thus, the data are copied once instead of twice.
+	Other writers wait until the direct write is consumed, so that the 
+	order of the data is kept. Smaller, non-blocking and timed writes 
+	always go through the ring.
+
+	The capacity of a pipe can be changed at any time, as long as the data
+	in it fit. Buffers larger than @c PIPE_MMAP_THRESHOLD are mapped from
+	the host, which commits their pages only as they are touched. The total
+	capacity of all pipes is accounted, and it cannot be increased past
+	@c PIPE_MEMORY_LIMIT.
+
+	The pipe functions below are also used by sockets, which keep a pipe
+	for each direction. A socket has one poll head for both of its pipes,
+	so it redirects the notifications of its ends there (see 
+	@c reader_poll and @c writer_poll), and restores them before it lets
+	go of an end.
+
+	A socket may close an end of a pipe with @c ShutDown() while other 
+	threads are blocked on it. These threads are woken up and fail, and the
+	pipe is not freed until the last of them has left. When the read end 
+	is closed, the data in the pipe are dropped at once.
+
+	@{
+*/
+
+/** @brief Buffers larger than this are allocated with @c mmap. */
+#define PIPE_MMAP_THRESHOLD (64u<<10)
+
+/** @brief The smallest write that may be done directly. */
+#define PIPE_DIRECT_MIN (16u<<10)
+
+_Static_assert((PIPE_DEFAULT_SIZE & (PIPE_DEFAULT_SIZE-1)) == 0,
+	"PIPE_DEFAULT_SIZE must be a power of 2");
+
+
+/** @brief The pipe control block. */
 typedef struct pipe_control_block {
-  char buffer[BUFF_SIZE];
+  char* buffer;       /**< @brief The ring buffer */
+  uint size;          /**< @brief The capacity, a power of 2 */
+  kmem_account kmem;  /**< @brief The charge for @c buffer */
+
+  FCB* read;          /**< @brief The read end, or NULL when closed */
+  FCB* write;         /**< @brief The write end, or NULL when closed */
+
+  uint users;         /**< @brief Reads and writes in progress */
+  int packet;         /**< @brief Set for a packet pipe */
+  int direct;         /**< @brief Set if large writes may be done directly */
 
-  FCB* read;
-  FCB* write;
+  const char* direct_buf; /**< @brief The rest of the direct write, or NULL */
+  uint direct_len;    /**< @brief The bytes left in @c direct_buf */
+  CondVar direct_done;  /**< @brief Direct writers wait here */
 
-  uint write_pos;
-  uint read_pos;
+  uint write_pos;     /**< @brief Total bytes written (free-running) */
+  uint read_pos;      /**< @brief Total bytes read (free-running) */
 
-  CondVar has_space; 
-  CondVar has_data;	
+  CondVar has_space;  /**< @brief Writers wait here */
+  CondVar has_data;   /**< @brief Readers wait here */
 
- 
+  uint read_lowat;    /**< @brief Readers are woken when this many bytes are in */
+  uint write_lowat;   /**< @brief Writers are woken when this many bytes are free */
+  uint read_need;     /**< @brief The least data a blocked reader waits for, or UINT_MAX */
+  uint write_need;    /**< @brief The least space a blocked writer waits for, or UINT_MAX */
+
+  poll_head read_poll;  /**< @brief Poll entries of the read end */
+  poll_head write_poll; /**< @brief Poll entries of the write end */
+  poll_head* reader_poll; /**< @brief Notified for the read end, normally @c read_poll */
+  poll_head* writer_poll; /**< @brief Notified for the write end, normally @c write_poll */
 } PIPE_CB;
 
+
+/** @brief Allocate a pipe of the default capacity, with both ends closed.
+
+	The buffer is charged to the current process.
+
+	@returns the pipe, or NULL if the kernel memory limit would be exceeded.
+  */
+PIPE_CB* construct_Pipe();
+
+/** @brief Free a pipe, returning its charge. 
+
+	This is only for pipes that no stream uses; the others are freed when
+	both ends are closed.
+  */
+void pipe_free(PIPE_CB* pipe);
+
+/** @brief Round a requested capacity, as explained in @c PipeEx(). 
+
+	@returns the capacity, or 0 if the request is too large.
+  */
+uint pipe_round_size(unsigned int size);
+
+/** @brief Change the capacity of a pipe.
+
+	@returns 0 on success, or -1 if the data do not fit or a
+		memory limit would be exceeded. The new capacity is charged
+		to the current process.
+  */
+int pipe_resize(PIPE_CB* pipe, uint size);
+
+/** @brief Set the watermarks of a pipe. */
+void pipe_set_watermarks(PIPE_CB* pipe, uint read_lowat, uint write_lowat);
+
+/** @brief Read from a pipe.
+
+	Block until there are enough data, or the write end is closed.
+	@returns the number of bytes read, 0 at end of data, or a negative
+		value on error (see @ref stream_wait).
+  */
 int sys_Pipe_Read(void* stream_object, char *buf, unsigned int size);
 
-int sys_Pipe(pipe_t* pipe);
+/** @brief Write to a pipe.
+
+	Block until there is enough space, or the read end is closed.
+	@returns the number of bytes written, or a negative value on error.
+		Writing to a pipe whose read end is closed is an error.
+  */
+int sys_Pipe_Write(void* stream_object, const char *buf, unsigned int size);
 
-int sys_Pipe_Write(void* stream_object, char *buf, unsigned int size);
+/** @brief Read from a pipe into many buffers, like @c sys_Pipe_Read. */
+int sys_Pipe_Readv(void* stream_object, const iovec_t* iov, unsigned int iovcnt);
 
+/** @brief Write to a pipe from many buffers, like @c sys_Pipe_Write. 
+
+	In a packet pipe, the segments make up one message.
+  */
+int sys_Pipe_Writev(void* stream_object, const iovec_t* iov, unsigned int iovcnt);
+
+/** @brief The @c Splice method of the read end. 
+
+	In a packet pipe, one message is moved per call, cut to 
+	@c SPLICE_BUFFER_SIZE bytes.
+  */
+int sys_Pipe_Splice(void* stream_object, int (*sink)(void*, const char*, unsigned int),
+	void* sinkobj, unsigned int len);
+
+/** @brief Close the write end of a pipe. The pipe is freed when both ends are closed. 
+
+	Blocked writers fail, and readers get the rest of the data, then 0.
+  */
 int sys_Pipe_Writer_Close(void* streamobj);
 
+/** @brief Close the read end of a pipe. The pipe is freed when both ends are closed. 
+
+	The data in the pipe are dropped, blocked readers and writers fail.
+  */
 int sys_Pipe_Reader_Close(void* streamobj);
 
-PIPE_CB* construct_Pipe();
+/** @brief The @c Poll method of the read end. */
+unsigned int pipe_reader_poll(void* streamobj, poll_entry* pe);
+
+/** @brief The @c Poll method of the write end. */
+unsigned int pipe_writer_poll(void* streamobj, poll_entry* pe);
+
+/** @} */
 
-  #endif
+#endif
@@ -0,0 +1,178 @@
+
+#include <assert.h>
+#include "tinyos.h"
+#include "kernel_cc.h"
+#include "kernel_poll.h"
+#include "kernel_streams.h"
+
+/*
+  The poll head lock is taken by interrupt handlers, therefore it must
+  always be taken with preemption off.
+ */
+
+void poll_head_init(poll_head* head)
+{
+  head->lock = MUTEX_INIT;
+  rlnode_init(&head->entries, NULL);
+}
+
+
+void poll_entry_init(poll_entry* pe, unsigned int mask, poll_notify_func notify, void* data)
+{
+  rlnode_init(&pe->node, pe);
+  pe->head = NULL;
+  pe->mask = mask;
+  pe->notify = notify;
+  pe->data = data;
+}
+
+
+void poll_add(poll_head* head, poll_entry* pe)
+{
+  assert(pe->head == NULL);
+  int pre = preempt_off;
+  Mutex_Lock(&head->lock);
+  rlist_push_back(&head->entries, &pe->node);
+  pe->head = head;
+  Mutex_Unlock(&head->lock);
+  if(pre) preempt_on;
+}
+
+
+void poll_remove(poll_entry* pe)
+{
+  poll_head* head = pe->head;
+  if(head == NULL) return;
+
+  int pre = preempt_off;
+  Mutex_Lock(&head->lock);
+  rlist_remove(&pe->node);
+  pe->head = NULL;
+  Mutex_Unlock(&head->lock);
+  if(pre) preempt_on;
+}
+
+
+void poll_notify(poll_head* head, unsigned int events)
+{
+  int pre = preempt_off;
+  Mutex_Lock(&head->lock);
+  for(rlnode* p = head->entries.next; p != &head->entries; p = p->next) {
+    poll_entry* pe = p->obj;
+    if(pe->mask & events)
+      pe->notify(pe, events);
+  }
+  Mutex_Unlock(&head->lock);
+  if(pre) preempt_on;
+}
+
+
+void poll_head_close(poll_head* head)
+{
+  int pre = preempt_off;
+  Mutex_Lock(&head->lock);
+  while(! is_rlist_empty(&head->entries)) {
+    poll_entry* pe = rlist_pop_front(&head->entries)->obj;
+    pe->head = NULL;
+    pe->notify(pe, POLL_FREE|POLL_HANGUP);
+  }
+  Mutex_Unlock(&head->lock);
+  if(pre) preempt_on;
+}
+
+
+
+/*
+ *
+ *   The Poll system call
+ *
+ */
+
+
+/* The state of a thread in Poll() */
+typedef struct poll_waiter {
+  CondVar ready;          /* The thread sleeps here */
+  volatile int woken;     /* Set by any notification */
+} poll_waiter;
+
+
+static void poll_wakeup(poll_entry* pe, unsigned int events)
+{
+  poll_waiter* w = pe->data;
+  w->woken = 1;
+  Cond_Broadcast(&w->ready);
+}
+
+
+/*
+  Return the ready events of a stream, registering pe on the stream if
+  pe is not NULL. Streams without a Poll method are always ready.
+ */
+static unsigned int stream_poll(FCB* fcb, poll_entry* pe)
+{
+  if(fcb->streamfunc->Poll)
+    return fcb->streamfunc->Poll(fcb->streamobj, pe);
+  else
+    return POLL_READ|POLL_WRITE;
+}
+
+
+int sys_Poll(pollfd_t* fds, unsigned int n, timeout_t timeout)
+{
+  if(n > MAX_POLLFD || (n > 0 && fds == NULL))
+    return -1;
+
+  FCB** fcb = xmalloc(n*sizeof(FCB*) + 1);
+  poll_entry* pe = xmalloc(n*sizeof(poll_entry) + 1);
+  poll_waiter waiter = { .ready = COND_INIT, .woken = 0 };
+
+  /* Pin the streams, so that they are not closed by another thread */
+  for(unsigned int i=0; i<n; i++) {
+    fcb[i] = (fds[i].fid >= 0) ? get_fcb(fds[i].fid) : NULL;
+    if(fcb[i]) FCB_incref(fcb[i]);
+    poll_entry_init(&pe[i], fds[i].events|POLL_ERROR|POLL_HANGUP, poll_wakeup, &waiter);
+  }
+
+  TimerDuration deadline = (timeout == TIMEOUT_INFINITE) ? NO_TIMEOUT : bios_clock() + timeout*1000ul;
+  int registered = 0;
+  int count;
+
+  /* As in the serial driver, keep interrupts off between the scan and the wait */
+  preempt_off;
+
+  while(1) {
+    waiter.woken = 0;
+    count = 0;
+
+    /* Scan the streams, registering on them in the first pass, unless some are ready */
+    for(unsigned int i=0; i<n; i++) {
+      unsigned int events = 0;
+      if(fcb[i])
+        events = stream_poll(fcb[i], (registered || count) ? NULL : &pe[i])
+          & (fds[i].events|POLL_ERROR|POLL_HANGUP);
+      else if(fds[i].fid >= 0)
+        events = POLL_INVALID;
+      fds[i].revents = events;
+      if(events) count++;
+    }
+    registered = 1;
+
+    if(count > 0 || timeout == 0) break;
+    if(waiter.woken) continue;
+
+    TimerDuration now = bios_clock();
+    if(deadline != NO_TIMEOUT && now >= deadline) break;
+    kernel_timedwait(&waiter.ready, SCHED_POLL, deadline == NO_TIMEOUT ? NO_TIMEOUT : deadline - now);
+  }
+
+  preempt_on;
+
+  for(unsigned int i=0; i<n; i++) {
+    poll_remove(&pe[i]);
+    if(fcb[i]) FCB_decref(fcb[i]);
+  }
+  free(pe);
+  free(fcb);
+
+  return count;
+}
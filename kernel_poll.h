@@ -0,0 +1,96 @@
+#ifndef __KERNEL_POLL_H
+#define __KERNEL_POLL_H
+
+#include "tinyos.h"
+#include "util.h"
+
+/**
+	@file kernel_poll.h
+	@brief Readiness notification for streams.
+
+	@defgroup poll Readiness notification.
+	@ingroup kernel
+	@brief Readiness notification for streams.
+
+	A stream that can tell when it becomes ready for I/O keeps one or more
+	@c poll_head objects, and calls @ref poll_notify on them when its state
+	changes (e.g., when data arrives). A waiter registers a @c poll_entry on
+	a poll head through the @c Poll method of the stream, and gets a callback
+	for each notification.
+
+	This is the mechanism behind the @c Poll() system call.
+
+	@{
+*/
+
+/** @brief An internal event, sent when a poll head is closed.
+
+	Upon receiving this event, the poll entry has already been detached
+	from the poll head.
+  */
+#define POLL_FREE 0x8000
+
+typedef struct poll_entry poll_entry;
+
+/** @brief A callback for readiness events. */
+typedef void (*poll_notify_func)(poll_entry* pe, unsigned int events);
+
+
+/** @brief A list of poll entries, kept by a stream. */
+typedef struct poll_head
+{
+  Mutex lock;         /**< @brief Protects the list, may be taken by interrupt handlers */
+  rlnode entries;     /**< @brief The registered poll entries */
+} poll_head;
+
+
+/** @brief The registration of a waiter on a poll head. */
+struct poll_entry
+{
+  rlnode node;            /**< @brief Intrusive list node */
+  poll_head* head;        /**< @brief The poll head, or NULL if not registered */
+  unsigned int mask;      /**< @brief The events of interest */
+  poll_notify_func notify;/**< @brief The callback */
+  void* data;             /**< @brief Data for the callback */
+};
+
+
+/** @brief Initialize a poll head. */
+void poll_head_init(poll_head* head);
+
+/** @brief Initialize a poll entry.
+
+	The callback will only be called for the events in @c mask, and for
+	@c POLL_FREE.
+  */
+void poll_entry_init(poll_entry* pe, unsigned int mask, poll_notify_func notify, void* data);
+
+/** @brief Register a poll entry on a poll head.
+
+	The entry must not be already registered. This function, as well as
+	@ref poll_remove and @ref poll_head_close, must be called with the kernel
+	lock held.
+  */
+void poll_add(poll_head* head, poll_entry* pe);
+
+/** @brief Unregister a poll entry, if it is registered. */
+void poll_remove(poll_entry* pe);
+
+/** @brief Notify the entries of a poll head of some events.
+
+	The callbacks are called with preemption off and the poll head locked,
+	therefore they must not block, or access the poll head. This function
+	can be called from interrupt handlers.
+  */
+void poll_notify(poll_head* head, unsigned int events);
+
+/** @brief Detach all entries of a poll head.
+
+	This must be called before a poll head is released. Each entry receives
+	a @c POLL_FREE|POLL_HANGUP event.
+  */
+void poll_head_close(poll_head* head);
+
+/** @} */
+
+#endif
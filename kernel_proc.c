@@ -30,6 +30,15 @@ static file_ops system_info_fops = {
 PCB PT[MAX_PROC];
 unsigned int process_count;
 
+/* 
+  The list of used (alive or zombie) PCBs, in order of birth. It is 
+  traversed without the kernel lock by info streams, so every change
+  is made inside a write section of live_seq.
+ */
+static rlnode live_list;
+static unsigned int live_seq;
+static unsigned long last_birth;
+
 PCB* get_pcb(Pid_t pid)
 {
   return PT[pid].pstate==FREE ? NULL : &PT[pid];
@@ -47,15 +56,20 @@ static inline void initialize_PCB(PCB* pcb)
   pcb->argl = 0;
   pcb->args = NULL;
   pcb->thread_count=0;
+  pcb->generation = 0;
+  pcb->kmem = 0;
+  pcb->args_kmem.pcb = NULL;
 
-  for(int i=0;i<MAX_FILEID;i++)
-    pcb->FIDT[i] = NULL;
+  pcb->fidt = NULL;
 
   rlnode_init(& pcb->children_list, NULL);
   rlnode_init(& pcb->exited_list, NULL);
   rlnode_init(& pcb->thread_list, NULL);//initializing pcb list
   rlnode_init(& pcb->children_node, pcb);
   rlnode_init(& pcb->exited_node, pcb);
+  rlnode_init(& pcb->live_node, pcb);
+  pcb->birth = 0;
+  pcb->info_seq = 0;
   pcb->child_exit = COND_INIT;
 }
 
@@ -79,6 +93,7 @@ void initialize_processes()
   }
 
   process_count = 0;
+  rlnode_init(&live_list, NULL);
 
   /* Execute a null "idle" process */
   if(Exec(NULL,0,NULL)!=0)
@@ -96,6 +111,8 @@ PCB* acquire_PCB()
   if(pcb_freelist != NULL) {
     pcb = pcb_freelist;
     pcb->pstate = ALIVE;
+    pcb->generation++;
+    pcb->kmem = 0;
     pcb_freelist = pcb_freelist->parent;
     process_count++;
   }
@@ -103,12 +120,33 @@ PCB* acquire_PCB()
   return pcb;
 }
 
+/*
+  Add a fully initialized PCB to the list of used PCBs.
+  Must be called with kernel_mutex held
+*/
+static void publish_PCB(PCB* pcb)
+{
+  seq_write_begin(&live_seq);
+  seq_write_begin(&pcb->info_seq);
+  pcb->birth = ++last_birth;
+  rlist_push_back(&live_list, &pcb->live_node);
+  seq_write_end(&pcb->info_seq);
+  seq_write_end(&live_seq);
+}
+
 /*
   Must be called with kernel_mutex held
 */
 void release_PCB(PCB* pcb)
 {
+  seq_write_begin(&live_seq);
+  seq_write_begin(&pcb->info_seq);
   pcb->pstate = FREE;
+  pcb->birth = 0;
+  rlist_remove(&pcb->live_node);
+  seq_write_end(&pcb->info_seq);
+  seq_write_end(&live_seq);
+
   pcb->parent = pcb_freelist;
   pcb_freelist = pcb;
   process_count--;
@@ -138,6 +176,15 @@ void start_main_thread()
 }
 
 
+/* The limits of the processes without a parent */
+static const unsigned long default_rlimits[RLIMIT_MAX] = {
+  [RLIMIT_THREADS] = RLIM_INFINITY,
+  [RLIMIT_FIDS] = MAX_FILEID,
+  [RLIMIT_CPU] = 100ul*MAX_CORES,
+  [RLIMIT_KMEM] = RLIM_INFINITY
+};
+
+
 /*
 	System call to create a new process.
  */
@@ -154,6 +201,8 @@ Pid_t sys_Exec(Task call, int argl, void* args)
     /* Processes with pid<=1 (the scheduler and the init process) 
        are parentless and are treated specially. */
     newproc->parent = NULL;
+    memcpy(newproc->rlimits, default_rlimits, sizeof(default_rlimits));
+    newproc->fidt = FIDT_create();
   }
   else
   {
@@ -164,14 +213,23 @@ Pid_t sys_Exec(Task call, int argl, void* args)
     newproc->parent = curproc;
     rlist_push_front(& curproc->children_list, & newproc->children_node);
 
-    /* Inherit file streams from parent */
-    for(int i=0; i<MAX_FILEID; i++) {
-       newproc->FIDT[i] = curproc->FIDT[i];
-       if(newproc->FIDT[i])
-          FCB_incref(newproc->FIDT[i]);
-    }
+    /* Inherit the resource limits */
+    memcpy(newproc->rlimits, curproc->rlimits, sizeof(newproc->rlimits));
+
+    /* Inherit file streams from parent, copy-on-write */
+    newproc->fidt = FIDT_share(curproc->fidt);
+  }
+
+  /* No thread-local storage keys */
+  for(int k=0; k<MAX_TLS_KEYS; k++) {
+    newproc->tls_keys[k].in_use = 0;
+    newproc->tls_keys[k].destructor = NULL;
   }
 
+  /* Start the accounting from scratch */
+  newproc->stats = (cpu_stats){ 0 };
+  newproc->cpu_period_start = 0;
+  newproc->cpu_period_used = 0;
 
   /* Set the main thread's function */
   newproc->main_task = call;
@@ -179,8 +237,12 @@ Pid_t sys_Exec(Task call, int argl, void* args)
   /* Copy the arguments to new storage, owned by the new process */
   newproc->argl = argl;
   if(args!=NULL) {
+    if(! kmem_charge(newproc, &newproc->args_kmem, argl))
+      goto undo;
     newproc->args = malloc(argl);
     memcpy(newproc->args, args, argl);
+    memcpy(newproc->info_args, args, 
+      argl < PROCINFO_MAX_ARGS_SIZE ? argl : PROCINFO_MAX_ARGS_SIZE);
   }
   else
     newproc->args=NULL;
@@ -192,9 +254,25 @@ Pid_t sys_Exec(Task call, int argl, void* args)
    */
   if(call != NULL) {
 
+    if(newproc->rlimits[RLIMIT_THREADS]==0)
+      goto undo;
+
     PTCB* ptcb = (PTCB*)xmalloc(PROCESS_THREAD_PTCB_SIZE);
     assert(ptcb!=NULL);
 
+    if(! kmem_charge(newproc, &ptcb->kmem, THREAD_KMEM_SIZE)) {
+      free(ptcb);
+      goto undo;
+    }
+
+    //creating the mainthread of the new process
+    newproc->main_thread = spawn_thread(newproc, start_main_thread);
+    if(newproc->main_thread == NULL) {
+      kmem_uncharge(&ptcb->kmem);
+      free(ptcb);
+      goto undo;
+    }
+
     ptcb->ref_count=0;//initializing the ref count
 
     rlnode_init(&ptcb->thread_list_node, ptcb); /* Intrusive list node */
@@ -210,19 +288,34 @@ Pid_t sys_Exec(Task call, int argl, void* args)
     ptcb->detached=0;//boolean variable , 1 if the thread is detached
     ptcb->exit_cv=COND_INIT;//initializing the exit condition variable
 
-    //creating the mainthread of the new process
-    newproc->main_thread = spawn_thread(newproc, start_main_thread);
-
     newproc->main_thread->ptcb=ptcb;//setting the newprocs main threads ptcb
     ptcb->tcb=newproc->main_thread;//setting the ptcbs tcb pointer to the new process main thread
 
     newproc->thread_count++;
-    wakeup(newproc->main_thread);
   }
 
+  /* From now on, the new process is visible to info streams */
+  publish_PCB(newproc);
+
+  if(call != NULL)
+    wakeup(newproc->main_thread);
+
 
 finish:
   return get_pid(newproc);
+
+undo:
+  /* A resource limit was exceeded, release everything */
+  if(newproc->args) {
+    free(newproc->args);
+    newproc->args = NULL;
+  }
+  kmem_uncharge(&newproc->args_kmem);
+  FIDT_release(newproc->fidt);
+  newproc->fidt = NULL;
+  rlist_remove(& newproc->children_node);
+  release_PCB(newproc);
+  return NOPROC;
 }
 
 
@@ -239,6 +332,83 @@ Pid_t sys_GetPPid()
 }
 
 
+int sys_SetLimit(rlimit_t res, unsigned long value)
+{
+  if(res<0 || res>=RLIMIT_MAX)
+    return -1;
+
+  PCB* curproc = CURPROC;
+
+  /* Limits can only be lowered */
+  if(value > curproc->rlimits[res])
+    return -1;
+
+  /* Each process must be able to get some cpu */
+  if(res==RLIMIT_CPU && value==0)
+    return -1;
+
+  curproc->rlimits[res] = value;
+  return 0;
+}
+
+
+unsigned long sys_GetLimit(rlimit_t res)
+{
+  if(res<0 || res>=RLIMIT_MAX)
+    return 0;
+  return CURPROC->rlimits[res];
+}
+
+
+int kmem_charge(PCB* pcb, kmem_account* acct, size_t size)
+{
+  unsigned long limit = pcb->rlimits[RLIMIT_KMEM];
+  if(pcb->kmem > limit || size > limit - pcb->kmem)
+    return 0;
+
+  pcb->kmem += size;
+  acct->pcb = pcb;
+  acct->generation = pcb->generation;
+  acct->size = size;
+  return 1;
+}
+
+
+/* The process may have exited, and its PCB may be reused */
+static int kmem_held(kmem_account* acct)
+{
+  PCB* pcb = acct->pcb;
+  return pcb != NULL && pcb->pstate != FREE && pcb->generation == acct->generation;
+}
+
+
+void kmem_uncharge(kmem_account* acct)
+{
+  PCB* pcb = acct->pcb;
+  if(kmem_held(acct))
+    pcb->kmem -= (acct->size < pcb->kmem) ? acct->size : pcb->kmem;
+
+  acct->pcb = NULL;
+}
+
+
+int kmem_recharge(PCB* pcb, kmem_account* acct, size_t size)
+{
+  kmem_account old = *acct;
+  int held = kmem_held(acct);
+
+  kmem_uncharge(acct);
+  if(kmem_charge(pcb, acct, size))
+    return 1;
+
+  /* Put the old charge back */
+  if(held)
+    old.pcb->kmem += old.size;
+  *acct = old;
+  return 0;
+}
+
+
 static void cleanup_zombie(PCB* pcb, int* status)
 {
   if(status != NULL)
@@ -321,6 +491,8 @@ Pid_t sys_WaitChild(Pid_t cpid, int* status)
 
 void sys_Exit(int exitval)
 {
+  run_tls_destructors();
+
   /* Right here, we must check that we are not the boot task. If we are, 
      we must wait until all processes exit. */
   if(sys_GetPid()==1) {
@@ -356,21 +528,20 @@ void sys_Exit(int exitval)
     free(curproc->args);
     curproc->args = NULL;
   }
+  kmem_uncharge(&curproc->args_kmem);
 
   /* Clean up FIDT */
-  for(int i=0;i<MAX_FILEID;i++) {
-    if(curproc->FIDT[i] != NULL) {
-      FCB_decref(curproc->FIDT[i]);
-      curproc->FIDT[i] = NULL;
-    }
-  }
+  FIDT_release(curproc->fidt);
+  curproc->fidt = NULL;
 
   /* Reparent any children of the exiting process to the 
      initial task */
   PCB* initpcb = get_pcb(1);
   while(!is_rlist_empty(& curproc->children_list)) {
     rlnode* child = rlist_pop_front(& curproc->children_list);
+    seq_write_begin(&child->pcb->info_seq);
     child->pcb->parent = initpcb;
+    seq_write_end(&child->pcb->info_seq);
     rlist_push_front(& initpcb->children_list, child);
   }
 
@@ -391,7 +562,9 @@ void sys_Exit(int exitval)
   curproc->main_thread = NULL;
 
   /* Now, mark the process as exited. */
+  seq_write_begin(&curproc->info_seq);
   curproc->pstate = ZOMBIE;
+  seq_write_end(&curproc->info_seq);
 
   }
 
@@ -403,86 +576,159 @@ void sys_Exit(int exitval)
 
 
 
-Fid_t sys_OpenInfo()
+Fid_t sys_OpenInfoFilter(const procinfo_filter* filter)
 {
-    Fid_t fid[1];
-    FCB* fcb[1];
-
-    if(! FCB_reserve(1, fid,fcb))
-    return NOFILE ;
-
-    SICB* sicb=(SICB*)xmalloc(sizeof(SICB));//Allocating space for a system info control block
+  procinfo_filter f = { .alive_only = 0, .pid_min = 0, .pid_max = MAX_PROC-1 };
+  if(filter != NULL) {
+    f = *filter;
+    if(f.pid_min < 0) f.pid_min = 0;
+    if(f.pid_max >= MAX_PROC) f.pid_max = MAX_PROC-1;
+    if(f.pid_min > f.pid_max) return NOFILE;
+  }
 
-    if(sicb==NULL)
-    return NOFILE ;
+  Fid_t fid[1];
+  FCB* fcb[1];
 
-    procinfo* pinfo=(procinfo*)xmalloc(sizeof(procinfo));//Allocating space for process info control block
+  if(! FCB_reserve(1, fid, fcb))
+    return NOFILE;
 
-    if(pinfo==NULL)
-    return NOFILE ;
+  SICB* sicb = (SICB*) xmalloc(sizeof(SICB));
+  sicb->last = NULL;
+  sicb->last_birth = 0;
+  sicb->filter = f;
+  sicb->lock = MUTEX_INIT;
 
-    sicb->curinfo=*(pinfo);
-    sicb->cursor=0;
+  fcb[0]->streamobj = sicb;
+  fcb[0]->streamfunc = &system_info_fops;
 
-    fcb[0]->streamobj=sicb;
-    fcb[0]->streamfunc=&system_info_fops;    
+  return fid[0];
+}
 
 
-	   return fid[0];
+Fid_t sys_OpenInfo()
+{
+  return sys_OpenInfoFilter(NULL);
 }
-//A function that does nothing 
- int sys_Info_Void(void* stream_object, char *buf, unsigned int size){
-    return -1;
- 
- }
 
- int sys_System_Info_Close(void* streamobj){
-    
-    SICB* sicb=(SICB*)streamobj;
 
-    if(sicb==NULL)
-      return -1 ;
+/* Information streams are read-only */
+int sys_Info_Void(void* stream_object, const char *buf, unsigned int size)
+{
+  return -1;
+}
 
-    free(sicb);//deallocating the system info control block 
 
-    return 0;
- }
+int sys_System_Info_Close(void* streamobj)
+{
+  free(streamobj);
+  return 0;
+}
 
- int sys_System_Info_Read(void* stream_object, char *buf, unsigned int size){
-  
-  SICB* sicb=(SICB*)stream_object;
 
-    if(sicb==NULL)
-      return -1 ;
+/*
+  Copy the info of a PCB into a procinfo record, without the kernel lock.
+  Returns 1 if the PCB still has the given birth and matches the filter.
+ */
+static int read_procinfo(procinfo_filter* f, PCB* pcb, unsigned long birth, procinfo* info)
+{
+  unsigned int seq;
+  int ok;
+  do {
+    seq = seq_read_begin(&pcb->info_seq);
+
+    Pid_t pid = get_pid(pcb);
+    ok = pcb->birth == birth 
+      && pid >= f->pid_min && pid <= f->pid_max
+      && (pcb->pstate == ALIVE || !f->alive_only);
+    if(! ok) continue;
+
+    info->pid = pid;
+    info->ppid = get_pid(pcb->parent);
+    info->alive = (pcb->pstate==ALIVE) ? 1 : 0;
+    info->thread_count = pcb->thread_count;
+    info->main_task = pcb->main_task;
+    info->argl = pcb->argl;
+    int len = pcb->argl < PROCINFO_MAX_ARGS_SIZE ? pcb->argl : PROCINFO_MAX_ARGS_SIZE;
+    memcpy(info->args, pcb->info_args, len);
+
+    info->stats.run_time = __atomic_load_n(&pcb->stats.run_time, __ATOMIC_RELAXED);
+    info->stats.wait_time = __atomic_load_n(&pcb->stats.wait_time, __ATOMIC_RELAXED);
+    info->stats.vol_switches = __atomic_load_n(&pcb->stats.vol_switches, __ATOMIC_RELAXED);
+    info->stats.invol_switches = __atomic_load_n(&pcb->stats.invol_switches, __ATOMIC_RELAXED);
+    info->stats.syscalls = __atomic_load_n(&pcb->stats.syscalls, __ATOMIC_RELAXED);
+
+  } while(seq_read_retry(&pcb->info_seq, seq));
+
+  return ok;
+}
 
-  int i=sicb->cursor;
 
-  //finding the next process that is free 
-  for(;i<MAX_PROC;i++){
+/* 
+  Return the node after which the traversal of a stream resumes. If the
+  last PCB examined has since been released, start from the head of the
+  list, skipping the PCBs already examined.
+ */
+static rlnode* info_position(SICB* sicb)
+{
+  PCB* last = sicb->last;
+  if(last != NULL && last->birth == sicb->last_birth)
+    return & last->live_node;
+  return & live_list;
+}
 
-    if((&PT[i])->pstate!=FREE){
-      break;
-    }
 
-  }
+/*
+  Return as many whole procinfo records as fit in the buffer.
 
-  if(i==MAX_PROC)//If we have reached the end of the process table 
-    return 0;
+  The list of used PCBs is traversed without the kernel lock. The PCBs are
+  never freed, so the traversal only has to be restarted (from the last PCB
+  examined) when the list changed under it.
+ */
+int sys_System_Info_Read(void* stream_object, char *buf, unsigned int size)
+{
+  SICB* sicb = (SICB*) stream_object;
 
-  sicb->cursor=(i+1);
- 
-  //Initializing the variables of the procinfo
-  
-  sicb->curinfo.pid=get_pid(&PT[i]);
-  sicb->curinfo.ppid=get_pid((&PT[i])->parent);
-  sicb->curinfo.alive=((&PT[i])->pstate==ALIVE)?1:0;
-  sicb->curinfo.thread_count=(&PT[i])->thread_count;
-  sicb->curinfo.main_task=(&PT[i])->main_task;
-  sicb->curinfo.argl=(&PT[i])->argl;
+  if(size < sizeof(procinfo))
+    return -1;
 
-  memcpy(sicb->curinfo.args,(&PT[i])->args,(&PT[i])->argl);
+  unsigned int count = 0;
+  procinfo* out = (procinfo*) buf;
+  unsigned int max = size / sizeof(procinfo);
+  int at_end = 0;
+
+  /* Monitoring must not delay Exec or Exit */
+  kernel_unlock();
+  Mutex_Lock(& sicb->lock);
+
+  while(count < max && !at_end) {
+    unsigned int seq = seq_read_begin(&live_seq);
+    rlnode* pos = info_position(sicb);
+
+    while(count < max) {
+      rlnode* node = pos->next;
+      PCB* pcb = node->pcb;
+      unsigned long birth = (node == &live_list) ? 0 : pcb->birth;
+
+      /* Restart if the list changed */
+      if(seq_read_retry(&live_seq, seq)) break;
+
+      if(node == &live_list) {
+        at_end = 1;
+        break;
+      }
+
+      if(birth > sicb->last_birth) {
+        sicb->last = pcb;
+        sicb->last_birth = birth;
+        if(read_procinfo(& sicb->filter, pcb, birth, &out[count]))
+          count++;
+      }
+      pos = node;
+    }
+  }
 
-  memcpy(buf,(char*) &(sicb->curinfo),size);//Converting it to a byte array and passing to buf 
+  Mutex_Unlock(& sicb->lock);
+  kernel_lock();
 
-  return size;
- }
+  return count * sizeof(procinfo);
+}
@@ -30,6 +30,47 @@ typedef enum pid_state_e {
   ZOMBIE  /**< @brief The PID is held by a zombie */
 } pid_state;
 
+/**
+  @brief A charge of kernel memory to a process.
+
+  Kernel objects created on behalf of a process record the charge made
+  against the @c RLIMIT_KMEM limit of the process, so that it can be
+  returned when the object is freed. The generation of the PCB is kept,
+  so that objects outliving their creator do not uncharge a new process
+  that has reused the PCB.
+
+  @see kmem_charge
+  @see kmem_uncharge
+ */
+typedef struct kmem_account {
+  PCB* pcb;                 /**< @brief The charged process, or NULL */
+  unsigned int generation;  /**< @brief The generation of the PCB at the time of the charge */
+  size_t size;              /**< @brief The number of bytes charged */
+} kmem_account;
+
+
+/**
+  @brief A thread-local storage key of a process.
+
+  The generation of a key is increased whenever the key is created or
+  deleted, so that thread values set for a previous key are ignored.
+  @see tls_slot
+ */
+typedef struct tls_key {
+  int in_use;                   /**< @brief Non-zero if the key is valid */
+  unsigned int gen;             /**< @brief The generation of the key */
+  void (*destructor)(void*);    /**< @brief The destructor, or NULL */
+} tls_key;
+
+
+/**
+  @brief The scheduling period for cpu share limits, in microseconds.
+
+  A process with a cpu limit of @c p percent may run for @c p percent of
+  this period; then, its threads are throttled until the period ends.
+ */
+#define CPU_LIMIT_PERIOD (100000ul)
+
 /**
   @brief Process Control Block.
 
@@ -52,6 +93,18 @@ typedef struct process_control_block {
   rlnode thread_list;
   rlnode children_node;   /**< @brief Intrusive node for @c children_list */
   rlnode exited_node;     /**< @brief Intrusive node for @c exited_list */
+  rlnode live_node;       /**< @brief Intrusive node for the list of used PCBs */
+  unsigned long birth;    /**< @brief Position in the list of used PCBs, 0 when not in the list */
+
+  unsigned int info_seq;  /**< @brief Sequence count for the fields returned by info streams.
+
+                            Info streams read the PCB without the kernel lock. Updates to
+                            @c pstate, @c parent, @c thread_count, @c main_task, @c argl, 
+                            @c info_args and @c birth of a PCB in the list of used PCBs must
+                            be made inside a write section. The counters in @c stats are 
+                            monotonic and are read individually.
+                            @see seq_write_begin */
+  char info_args[PROCINFO_MAX_ARGS_SIZE]; /**< @brief Prefix of @c args, for info streams */
 
   CondVar child_exit;     /**< @brief Condition variable for @c WaitChild. 
 
@@ -59,7 +112,19 @@ typedef struct process_control_block {
                              process terminates. It is used in the implementation of
                              @c WaitChild() */
 
-  FCB* FIDT[MAX_FILEID];  /**< @brief The fileid table of the process */
+  FIDT* fidt;             /**< @brief The fileid table of the process, possibly shared */
+
+  cpu_stats stats;        /**< @brief CPU accounting, summed over all threads of the process */
+
+  unsigned long rlimits[RLIMIT_MAX]; /**< @brief The resource limits, inherited by children */
+  size_t kmem;            /**< @brief The kernel memory charged to the process */
+  unsigned int generation;/**< @brief Increased every time the PCB is acquired */
+  kmem_account args_kmem; /**< @brief The charge for @c args */
+
+  tls_key tls_keys[MAX_TLS_KEYS]; /**< @brief The thread-local storage keys */
+
+  TimerDuration cpu_period_start; /**< @brief Start of the current cpu limit period */
+  TimerDuration cpu_period_used;  /**< @brief Cpu time used in the current cpu limit period */
 
 } PCB;
 
@@ -79,18 +144,35 @@ int detached;//Boolean variable , 1 if the thread is detached
 
 CondVar exit_cv;//Condition variable to wait on, when waiting for the thread to exit 
 
+kmem_account kmem;//The kernel memory charged for this thread
+
 
 
 
   } PTCB;
 
-typedef struct system_info_control_block {
+/**
+  @brief System information control block.
 
-  procinfo curinfo;
+  This is the stream object of an information stream. Info streams
+  are read without the kernel lock, so that monitoring never delays
+  process creation and termination. The list of used PCBs is kept in
+  order of @c birth, and the stream remembers the birth of the last
+  PCB it examined. 
+ */
+typedef struct system_info_control_block {
 
-  uint cursor;//Its a counter for the process table
+  PCB* last;                /**< @brief The last PCB examined, or NULL */
+  unsigned long last_birth; /**< @brief The birth of @c last */
+  procinfo_filter filter;   /**< @brief Which processes to return */
+  Mutex lock;               /**< @brief Serializes readers of the stream */
 
   } SICB;
+/**
+  @brief The kernel memory charged to a process for each of its threads.
+ */
+#define THREAD_KMEM_SIZE (sizeof(TCB)+THREAD_STACK_SIZE+sizeof(PTCB))
+
 /**
   @brief Initialize the process table.
 
@@ -123,11 +205,44 @@ PCB* get_pcb(Pid_t pid);
 */
 Pid_t get_pid(PCB* pcb);
 
+/**
+  @brief Charge kernel memory to a process.
+
+  If the charge would exceed the @c RLIMIT_KMEM limit of the process, 
+  nothing is charged and 0 is returned. Else, the charge is recorded
+  in @c acct and 1 is returned.
+
+  @param pcb the process to charge
+  @param acct the charge record, usually kept in the kernel object
+  @param size the number of bytes to charge
+  @returns 1 on success and 0 if the limit is exceeded
+*/
+int kmem_charge(PCB* pcb, kmem_account* acct, size_t size);
+
+/**
+  @brief Return a charge of kernel memory.
+
+  The charge recorded in @c acct is returned to the process, if the process
+  still exists. It is legal to uncharge an empty record.
+*/
+void kmem_uncharge(kmem_account* acct);
+
+/**
+  @brief Replace a charge of kernel memory by one of a new size.
+
+  The charge recorded in @c acct is returned, and @c size bytes are
+  charged to @c pcb instead. If the new charge would exceed the limit,
+  the old charge is kept.
+
+  @returns 1 on success and 0 if the limit is exceeded
+*/
+int kmem_recharge(PCB* pcb, kmem_account* acct, size_t size);
+
 int sys_System_Info_Read(void* stream_object, char *buf, unsigned int size);
 
 int sys_System_Info_Close(void* streamobj);
 
-int sys_Info_Void(void* stream_object, char *buf, unsigned int size);
+int sys_Info_Void(void* stream_object, const char *buf, unsigned int size);
 
 /** @} */
 
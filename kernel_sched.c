@@ -73,9 +73,7 @@ void* allocate_thread(size_t size)
 	void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE | PROT_EXEC,
 		MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
 
-	CHECK((ptr == MAP_FAILED) ? -1 : 0);
-
-	return ptr;
+	return (ptr == MAP_FAILED) ? NULL : ptr;
 }
 #else
 /*
@@ -86,9 +84,7 @@ void free_thread(void* ptr, size_t size) { free(ptr); }
 
 void* allocate_thread(size_t size)
 {
-	void* ptr = aligned_alloc(SYSTEM_PAGE_SIZE, size);
-	CHECK((ptr == NULL) ? -1 : 0);
-	return ptr;
+	return aligned_alloc(SYSTEM_PAGE_SIZE, size);
 }
 #endif
 
@@ -108,13 +104,15 @@ static void thread_start()
 }
 
 /*
-  Initialize and return a new TCB
+  Initialize and return a new TCB, or NULL if we are out of memory
 */
 
 TCB* spawn_thread(PCB* pcb, void (*func)())
 {
 	/* The allocated thread size must be a multiple of page size */
 	TCB* tcb = (TCB*)allocate_thread(THREAD_SIZE);
+	if (tcb == NULL)
+		return NULL;
 
 	/* Set the owner */
 	tcb->owner_pcb = pcb;
@@ -134,6 +132,19 @@ TCB* spawn_thread(PCB* pcb, void (*func)())
 	tcb->last_cause = SCHED_IDLE;
 	tcb->curr_cause = SCHED_IDLE;
 
+	/* Clear the accounting */
+	tcb->run_stamp = 0;
+	tcb->ready_stamp = 0;
+	tcb->stats = (cpu_stats){ 0 };
+
+	/* No thread-local values */
+	memset(tcb->tls, 0, sizeof(tcb->tls));
+	tcb->io_mode = 0;
+	tcb->io_fcb = NULL;
+	tcb->io_min = 0;
+	tcb->syscall_depth = 0;
+	tcb->throttled = 0;
+
 	/* Compute the stack segment address and size */
 	void* sp = ((void*)tcb) + THREAD_TCB_SIZE;
 
@@ -197,7 +208,14 @@ rlnode TIMEOUT_LIST; /* The list of threads with a timeout */
 Mutex sched_spinlock = MUTEX_INIT; /* spinlock for scheduler queue */
 
 /* Interrupt handler for ALARM */
-void yield_handler() { yield(SCHED_QUANTUM); }
+void yield_handler()
+{
+	yield(SCHED_QUANTUM);
+
+	/* Outside of system calls, we are returning to user code */
+	if (CURTHREAD->syscall_depth == 0)
+		sched_throttle();
+}
 
 /* Interrupt handle for inter-core interrupts */
 void ici_handler()
@@ -237,6 +255,8 @@ static void sched_queue_add(TCB* tcb)
 	
 	/*Adding to the right scheduler queue based on the tcb priority field*/
 	rlist_push_back(&SCHED[tcb->priority], &tcb->sched_node);
+	/* Start counting the time spent waiting for a core */
+	tcb->ready_stamp = bios_cpu_clock();
 	/* Restart possibly halted cores */
 	cpu_core_restart_one();
 }
@@ -433,6 +453,119 @@ void adjust_priority(TCB* tcb){
 }
 
 
+/*
+  Charge the time-slice of the current thread that ends now, to the thread
+  and its owner process. Return the length of the time-slice.
+
+  *** MUST BE CALLED WITH sched_spinlock HELD ***
+*/
+static TimerDuration sched_account_slice(TCB* current, TimerDuration now)
+{
+	TimerDuration ran = now - current->run_stamp;
+	current->stats.run_time += ran;
+	current->owner_pcb->stats.run_time += ran;
+	return ran;
+}
+
+/*
+  Count a context switch as voluntary or involuntary.
+
+  *** MUST BE CALLED WITH sched_spinlock HELD ***
+*/
+static void sched_account_switch(TCB* current, TCB* next, enum SCHED_CAUSE cause)
+{
+	cpu_stats* pstats = &current->owner_pcb->stats;
+
+	if (current != next) {
+		if (cause == SCHED_QUANTUM) {
+			current->stats.invol_switches++;
+			pstats->invol_switches++;
+		} else {
+			current->stats.vol_switches++;
+			pstats->vol_switches++;
+		}
+	}
+}
+
+/*
+  Enforce the cpu share limit of the owner process of a thread whose
+  time-slice just ended. The limit allows the process to run for a fraction of 
+  each CPU_LIMIT_PERIOD; if the process has used up its share, the thread is 
+  marked, and sched_throttle() puts it to sleep until the period ends. The
+  thread may hold the kernel lock here, so it must not sleep yet.
+
+  *** MUST BE CALLED WITH sched_spinlock HELD ***
+*/
+static void sched_enforce_cpu_limit(TCB* tcb, TimerDuration ran, TimerDuration now)
+{
+	PCB* pcb = tcb->owner_pcb;
+	unsigned long share = pcb->rlimits[RLIMIT_CPU];
+
+	if (tcb->type == IDLE_THREAD || share >= 100ul * cpu_cores())
+		return;
+
+	/* Start a new period if needed */
+	if (now - pcb->cpu_period_start >= CPU_LIMIT_PERIOD) {
+		pcb->cpu_period_start = now;
+		pcb->cpu_period_used = 0;
+	}
+	pcb->cpu_period_used += ran;
+
+	/* Throttle the thread at its next safe point */
+	if (pcb->cpu_period_used * 100 >= share * CPU_LIMIT_PERIOD)
+		tcb->throttled = 1;
+}
+
+
+void sched_throttle()
+{
+	TCB* tcb = CURTHREAD;
+	if (tcb == NULL || !tcb->throttled)
+		return;
+
+	int preempt = preempt_off;
+	Mutex_Lock(&sched_spinlock);
+	tcb->throttled = 0;
+
+	/* The period may have ended since the thread was marked */
+	PCB* pcb = tcb->owner_pcb;
+	TimerDuration now = bios_cpu_clock();
+	TimerDuration elapsed = now - pcb->cpu_period_start;
+	if (elapsed < CPU_LIMIT_PERIOD) {
+		Mutex_Unlock(&sched_spinlock);
+		sleep_releasing(STOPPED, NULL, SCHED_QUANTUM, CPU_LIMIT_PERIOD - elapsed);
+	}
+	else
+		Mutex_Unlock(&sched_spinlock);
+
+	if (preempt)
+		preempt_on;
+}
+
+
+void sched_account_syscall()
+{
+	TCB* current = CURTHREAD;
+
+	/* During boot, system calls are made outside of any thread */
+	if (current == NULL)
+		return;
+	current->stats.syscalls++;
+	current->owner_pcb->stats.syscalls++;
+	current->syscall_depth++;
+}
+
+
+void sched_syscall_exit()
+{
+	TCB* current = CURTHREAD;
+	if (current == NULL)
+		return;
+	if (--current->syscall_depth == 0)
+		sched_throttle();
+}
+
+
 /* This function is the entry point to the scheduler's context switching */
 
 void yield(enum SCHED_CAUSE cause)
@@ -459,6 +592,10 @@ void yield(enum SCHED_CAUSE cause)
 
 	 adjust_priority(current); //adjusts the priority of current thread 
 
+	/* Charge the time-slice, possibly throttling the current thread */
+	TimerDuration now = bios_cpu_clock();
+	sched_enforce_cpu_limit(current, sched_account_slice(current, now), now);
+
 	/* Wake up threads whose sleep timeout has expired */
 	sched_wakeup_expired_timeouts();
 
@@ -468,6 +605,8 @@ void yield(enum SCHED_CAUSE cause)
 	
 	assert(next != NULL);
 
+	sched_account_switch(current, next, cause);
+
 	yield_counter= yield_counter+1;
 
 	/* Save the current TCB for the gain phase */
@@ -510,6 +649,16 @@ void gain(int preempt)
 	current->phase = CTX_DIRTY;
 	current->rts = current->its;
 
+	/* Charge the time spent in the ready queue, and start the time-slice */
+	TimerDuration now = bios_cpu_clock();
+	if (current->ready_stamp != 0) {
+		TimerDuration waited = now - current->ready_stamp;
+		current->stats.wait_time += waited;
+		current->owner_pcb->stats.wait_time += waited;
+		current->ready_stamp = 0;
+	}
+	current->run_stamp = now;
+
 	/* Take care of the previous thread */
 	TCB* prev = CURCORE.previous_thread;
 	if (current != prev) {
@@ -591,6 +740,10 @@ void run_scheduler()
 	curcore->idle_thread.curr_cause = SCHED_IDLE;
 	curcore->idle_thread.last_cause = SCHED_IDLE;
 
+	curcore->idle_thread.run_stamp = bios_cpu_clock();
+	curcore->idle_thread.ready_stamp = 0;
+	curcore->idle_thread.stats = (cpu_stats){ 0 };
+
 	/* Initialize interrupt handler */
 	cpu_interrupt_handler(ALARM, yield_handler);
 	cpu_interrupt_handler(ICI, ici_handler);
@@ -91,6 +91,19 @@ enum SCHED_CAUSE {
 	SCHED_USER /**< @brief User-space code called yield */
 };
 
+/**
+  @brief A thread-local storage value.
+
+  The value is valid only while @c gen is equal to the generation 
+  of the key in the process.
+  @see tls_key
+ */
+typedef struct tls_slot {
+	void* value;       /**< @brief The value of the key for this thread */
+	unsigned int gen;  /**< @brief The key generation this value was set for */
+} tls_slot;
+
+
 /**
   @brief The thread control block  TCB
 
@@ -129,6 +142,20 @@ typedef struct thread_control_block {
 	enum SCHED_CAUSE curr_cause; /**< @brief The endcause for the current time-slice */
 	enum SCHED_CAUSE last_cause; /**< @brief The endcause for the last time-slice */
 
+	TimerDuration run_stamp; /**< @brief The time the current time-slice started */
+	TimerDuration ready_stamp; /**< @brief The time the thread was queued as ready, or 0 */
+	cpu_stats stats; /**< @brief CPU accounting for this thread */
+
+	tls_slot tls[MAX_TLS_KEYS]; /**< @brief The thread-local storage of this thread */
+
+	unsigned int io_mode; /**< @brief The mode of the current I/O call, see @c stream_wait */
+	TimerDuration io_deadline; /**< @brief The deadline of the current I/O call, if it is timed */
+	FCB* io_fcb; /**< @brief The stream of the current I/O call, for accounting, or NULL */
+	unsigned int io_min; /**< @brief The least bytes the current read asks for, see @c stream_read_min */
+
+	unsigned int syscall_depth; /**< @brief The number of system calls in progress, 0 in user code */
+	int throttled; /**< @brief Set when the process used up its cpu share, see @c sched_throttle */
+
 } TCB;
 
 /** @brief Thread stack size.
@@ -253,6 +280,36 @@ void sleep_releasing(Thread_state newstate, Mutex* mx, enum SCHED_CAUSE cause, T
  */
 void yield(enum SCHED_CAUSE cause);
 
+/**
+  @brief Account for a system call made by the current thread.
+
+  This is called on entry to every system call, and increases the syscall 
+  counters of the current thread and its process, as well as its
+  @c syscall_depth.
+ */
+void sched_account_syscall(void);
+
+/**
+  @brief Leave a system call.
+
+  This is called on exit from every system call, after the kernel lock is 
+  released. When the outermost system call of the thread returns, the 
+  thread may be throttled (see @c sched_throttle).
+ */
+void sched_syscall_exit(void);
+
+/**
+  @brief Throttle the current thread, if its process used up its cpu share.
+
+  When a time-slice ends and the process of the thread has used up its 
+  share of the current period (see @c RLIMIT_CPU), the scheduler only marks 
+  the thread. The thread sleeps until the end of the period when it next 
+  reaches a safe point, where it holds no kernel locks: on return from 
+  its outermost system call, or on return to user code after an expired 
+  quantum.
+ */
+void sched_throttle(void);
+
 /**
   @brief Enter the scheduler.
 
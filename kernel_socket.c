@@ -1,32 +1,724 @@
 
 #include "tinyos.h"
+#include "kernel_socket.h"
+#include "kernel_sched.h"
+
+
+/*
+  All socket state is protected by the kernel lock.
+ */
+
+/* The listeners of each port, or NULL */
+static PORTCB* PORT_MAP[MAX_PORT+1];
+
+/* The datagram socket of each port, or NULL */
+static SCB* DGRAM_MAP[MAX_PORT+1];
+
+static int socket_read(void* this, char *buf, unsigned int size);
+static int socket_write(void* this, const char *buf, unsigned int size);
+static int socket_close(void* this);
+static int socket_readv(void* this, const iovec_t* iov, unsigned int iovcnt);
+static int socket_writev(void* this, const iovec_t* iov, unsigned int iovcnt);
+static int socket_splice(void* this, int (*sink)(void*, const char*, unsigned int),
+  void* sinkobj, unsigned int len);
+static unsigned int socket_poll(void* this, poll_entry* pe);
+
+static file_ops socket_fops = {
+  .Open = NULL,
+  .Read = socket_read,
+  .Write = socket_write,
+  .Close = socket_close,
+  .Readv = socket_readv,
+  .Writev = socket_writev,
+  .Splice = socket_splice,
+  .Poll = socket_poll
+};
+
+
+void SCB_decref(SCB* scb)
+{
+  assert(scb->refcount > 0);
+  if(--scb->refcount == 0)
+    free(scb);
+}
+
+
+/* Return the socket of a fid, or NULL */
+static SCB* get_scb(Fid_t fid)
+{
+  FCB* fcb = get_fcb(fid);
+  return (fcb && fcb->streamfunc == &socket_fops) ? fcb->streamobj : NULL;
+}
+
+
+static SCB* socket_init(FCB* fcb, port_t port)
+{
+  SCB* scb = xmalloc(sizeof(SCB));
+  scb->port = port;
+  scb->type = UNBOUND;
+  scb->refcount = 1;
+  scb->fcb = fcb;
+  scb->connect = NULL;
+  poll_head_init(&scb->poll);
+
+  fcb->streamobj = scb;
+  fcb->streamfunc = &socket_fops;
+  fcb->devtype = DEV_SOCKET;
+  return scb;
+}
+
+
+/* 
+  Socket calls other than Read and Write set up the I/O mode themselves:
+  on a non-blocking socket they return IO_WOULDBLOCK instead of waiting.
+ */
+static unsigned int socket_io_begin(FCB* fcb)
+{
+  TCB* tcb = CURTHREAD;
+  unsigned int io_mode = tcb->io_mode;
+  if(fcb->flags & FID_NONBLOCK) tcb->io_mode |= IO_MODE_NONBLOCK;
+  tcb->io_fcb = fcb;
+  return io_mode;
+}
+
+static void socket_io_end(unsigned int io_mode)
+{
+  CURTHREAD->io_mode = io_mode;
+  CURTHREAD->io_fcb = NULL;
+}
+
+
+/* Add a listener to its port */
+static int port_add(SCB* scb, unsigned int flags)
+{
+  PORTCB* pcb = PORT_MAP[scb->port];
+
+  if(pcb == NULL) {
+    pcb = xmalloc(sizeof(PORTCB));
+    pcb->flags = flags;
+    pcb->count = 0;
+    pcb->next = 0;
+    PORT_MAP[scb->port] = pcb;
+  }
+  else if(! (flags & LISTEN_REUSEPORT) || pcb->flags != flags || pcb->count == MAX_PORT_LISTENERS)
+    return -1;
+
+  pcb->listener[pcb->count++] = scb;
+  return 0;
+}
+
+
+/* Remove a listener from its port, freeing the port entry with the last one */
+static void port_remove(SCB* scb)
+{
+  PORTCB* pcb = PORT_MAP[scb->port];
+
+  for(unsigned int i=0; i<pcb->count; i++)
+    if(pcb->listener[i] == scb) {
+      pcb->listener[i] = pcb->listener[--pcb->count];
+      break;
+    }
+
+  if(pcb->count == 0) {
+    PORT_MAP[scb->port] = NULL;
+    free(pcb);
+  }
+}
+
+
+/* Pick the listener of a port that gets the next connection, or NULL */
+static SCB* port_pick(port_t port)
+{
+  PORTCB* pcb = PORT_MAP[port];
+  if(pcb == NULL)
+    return NULL;
+
+  if(pcb->flags & LISTEN_BYCORE)
+    return pcb->listener[cpu_core_id % pcb->count];
+
+  if(pcb->next >= pcb->count) pcb->next = 0;
+  return pcb->listener[pcb->next++];
+}
+
+
+/* Connect two unbound sockets with a pipe in each direction, or return 0
+   if the pipes would exceed the kernel memory limit */
+static int socket_connect(SCB* a, SCB* b, int packet)
+{
+  PIPE_CB* ab = construct_Pipe();
+  PIPE_CB* ba = construct_Pipe();
+  if(ab == NULL || ba == NULL) {
+    if(ab) pipe_free(ab);
+    if(ba) pipe_free(ba);
+    return 0;
+  }
+
+  /* Messages are always copied whole into the ring */
+  ab->packet = ba->packet = packet;
+  ab->direct = ba->direct = !packet;
+
+  ab->write = a->fcb;
+  ab->read = b->fcb;
+  ab->writer_poll = &a->poll;
+  ab->reader_poll = &b->poll;
+
+  ba->write = b->fcb;
+  ba->read = a->fcb;
+  ba->writer_poll = &b->poll;
+  ba->reader_poll = &a->poll;
+
+  a->type = PEER;
+  a->pscb.read_pipe = ba;
+  a->pscb.write_pipe = ab;
+
+  b->type = PEER;
+  b->pscb.read_pipe = ab;
+  b->pscb.write_pipe = ba;
+
+  poll_notify(&a->poll, POLL_WRITE);
+  poll_notify(&b->poll, POLL_WRITE);
+  return 1;
+}
+
+
+static void socket_shutdown(SCB* scb, shutdown_mode how)
+{
+  PSCB* p = &scb->pscb;
+
+  /* The pipe may outlive this socket, so it gets its own poll heads back */
+  if((how & SHUTDOWN_READ) && p->read_pipe) {
+    p->read_pipe->reader_poll = &p->read_pipe->read_poll;
+    sys_Pipe_Reader_Close(p->read_pipe);
+    p->read_pipe = NULL;
+  }
+  if((how & SHUTDOWN_WRITE) && p->write_pipe) {
+    p->write_pipe->writer_poll = &p->write_pipe->write_poll;
+    sys_Pipe_Writer_Close(p->write_pipe);
+    p->write_pipe = NULL;
+  }
+  poll_notify(&scb->poll, POLL_HANGUP);
+}
+
+
+/* Take the first datagram off the queue of a socket */
+static int dgram_recv(SCB* scb, port_t* port, const iovec_t* iov, unsigned int iovcnt)
+{
+  DSCB* d = &scb->dscb;
+
+  while(is_rlist_empty(&d->queue)) {
+    if(scb->fcb == NULL) return -1;
+    int rc = stream_wait(&d->has_data, SCHED_PIPE);
+    if(rc < 0) return rc;
+  }
+
+  /* The rest of the message is discarded */
+  DGRAM_MSG* msg = rlist_pop_front(&d->queue)->obj;
+  uint n = 0;
+  for(unsigned int i=0; i<iovcnt && n < msg->len; i++) {
+    uint m = (iov[i].len < msg->len - n) ? iov[i].len : msg->len - n;
+    memcpy(iov[i].base, msg->data + n, m);
+    n += m;
+  }
+  if(port) *port = msg->from;
+
+  d->bytes -= msg->len;
+  free(msg);
+  Cond_Broadcast(&d->has_space);
+  return n;
+}
+
+
+static int socket_readv(void* this, const iovec_t* iov, unsigned int iovcnt)
+{
+  SCB* scb = this;
+  if(scb->type == DGRAM && scb->port != NOPORT)
+    return dgram_recv(scb, NULL, iov, iovcnt);
+  if(scb->type != PEER || scb->pscb.read_pipe == NULL)
+    return -1;
+  return sys_Pipe_Readv(scb->pscb.read_pipe, iov, iovcnt);
+}
+
+
+static int socket_read(void* this, char *buf, unsigned int size)
+{
+  iovec_t iov = { buf, size };
+  return socket_readv(this, &iov, 1);
+}
+
+
+static int socket_writev(void* this, const iovec_t* iov, unsigned int iovcnt)
+{
+  SCB* scb = this;
+  if(scb->type != PEER || scb->pscb.write_pipe == NULL)
+    return -1;
+  return sys_Pipe_Writev(scb->pscb.write_pipe, iov, iovcnt);
+}
+
+
+static int socket_write(void* this, const char *buf, unsigned int size)
+{
+  iovec_t iov = { (void*) buf, size };
+  return socket_writev(this, &iov, 1);
+}
+
+
+static int socket_splice(void* this, int (*sink)(void*, const char*, unsigned int),
+  void* sinkobj, unsigned int len)
+{
+  SCB* scb = this;
+
+  /* One datagram per call */
+  if(scb->type == DGRAM && scb->port != NOPORT) {
+    char buffer[DGRAM_MAX_SIZE];
+    iovec_t iov = { buffer, (len < DGRAM_MAX_SIZE) ? len : DGRAM_MAX_SIZE };
+    int rc = dgram_recv(scb, NULL, &iov, 1);
+    return (rc > 0) ? stream_splice_copy(sink, sinkobj, buffer, rc) : rc;
+  }
+  if(scb->type != PEER || scb->pscb.read_pipe == NULL)
+    return -1;
+  return sys_Pipe_Splice(scb->pscb.read_pipe, sink, sinkobj, len);
+}
+
+
+/* Mark a request as served, and let its socket know */
+static void connect_served(RNS* req, int admitted)
+{
+  req->served = 1;
+  req->admitted = admitted;
+  Cond_Signal(&req->wakeup_request);
+  if(! admitted)
+    poll_notify(&req->scb->poll, POLL_ERROR);
+}
+
+
+/* Take the request of a socket away from it, and free it */
+static void connect_free(SCB* scb)
+{
+  RNS* req = scb->connect;
+  if(! req->served)
+    rlist_remove(&req->request_node);
+  free(req);
+  scb->connect = NULL;
+}
+
+
+static int socket_close(void* this)
+{
+  SCB* scb = this;
+
+  /* The request of a non-blocking Connect that was never collected */
+  if(scb->connect)
+    connect_free(scb);
+
+  switch(scb->type) {
+    case LISTENER:
+      /* Refuse the pending requests, and wake up the acceptors */
+      port_remove(scb);
+      while(! is_rlist_empty(&scb->lscb.request_queue)) {
+        RNS* req = rlist_pop_front(&scb->lscb.request_queue)->obj;
+        connect_served(req, 0);
+      }
+      Cond_Broadcast(&scb->lscb.has_request);
+
+      /* The acceptors do not hold the FCB, so their waits are not accounted to it */
+      for(rlnode* a = scb->lscb.acceptors.next; a != &scb->lscb.acceptors; a = a->next)
+        ((TCB*) a->obj)->io_fcb = NULL;
+      break;
+    case PEER:
+      socket_shutdown(scb, SHUTDOWN_BOTH);
+      break;
+    case DGRAM:
+      /* Drop the queue, and fail the waiting senders and receivers */
+      if(scb->port != NOPORT) DGRAM_MAP[scb->port] = NULL;
+      while(! is_rlist_empty(&scb->dscb.queue))
+        free(rlist_pop_front(&scb->dscb.queue)->obj);
+      kmem_uncharge(&scb->dscb.kmem);
+      Cond_Broadcast(&scb->dscb.has_space);
+      Cond_Broadcast(&scb->dscb.has_data);
+      break;
+    case UNBOUND:
+      break;
+  }
+
+  scb->fcb = NULL;
+  poll_head_close(&scb->poll);
+  SCB_decref(scb);
+  return 0;
+}
+
+
+static unsigned int socket_poll(void* this, poll_entry* pe)
+{
+  SCB* scb = this;
+  if(pe) poll_add(&scb->poll, pe);
+
+  unsigned int events = 0;
+  switch(scb->type) {
+    case LISTENER:
+      if(! is_rlist_empty(&scb->lscb.request_queue)) events |= POLL_READ;
+      break;
+    case PEER:
+      if(scb->pscb.read_pipe)
+        events |= pipe_reader_poll(scb->pscb.read_pipe, NULL);
+      if(scb->pscb.write_pipe)
+        events |= pipe_writer_poll(scb->pscb.write_pipe, NULL);
+      if(scb->pscb.read_pipe == NULL && scb->pscb.write_pipe == NULL)
+        events |= POLL_HANGUP;
+      break;
+    case DGRAM:
+      if(! is_rlist_empty(&scb->dscb.queue)) events |= POLL_READ;
+      events |= POLL_WRITE;
+      break;
+    case UNBOUND:
+      /* A refused non-blocking Connect */
+      if(scb->connect && scb->connect->served) events |= POLL_ERROR;
+      break;
+  }
+  return events;
+}
+
 
 
 Fid_t sys_Socket(port_t port)
 {
-	return NOFILE;
+  if(port < NOPORT || port > MAX_PORT)
+    return NOFILE;
+
+  Fid_t fid;
+  FCB* fcb;
+  if(! FCB_reserve(1, &fid, &fcb))
+    return NOFILE;
+
+  socket_init(fcb, port);
+  return fid;
 }
 
+
+int sys_ListenEx(Fid_t sock, unsigned int flags)
+{
+  SCB* scb = get_scb(sock);
+  if(scb == NULL || scb->type != UNBOUND || scb->port == NOPORT)
+    return -1;
+  if(flags & ~(LISTEN_REUSEPORT|LISTEN_BYCORE|LISTEN_PACKET)
+      || (flags & (LISTEN_REUSEPORT|LISTEN_BYCORE)) == LISTEN_BYCORE)
+    return -1;
+  if(port_add(scb, flags) == -1)
+    return -1;
+
+  scb->type = LISTENER;
+  rlnode_init(&scb->lscb.request_queue, NULL);
+  scb->lscb.has_request = COND_INIT;
+  rlnode_init(&scb->lscb.acceptors, NULL);
+  scb->lscb.packet = (flags & LISTEN_PACKET) != 0;
+  return 0;
+}
+
+
 int sys_Listen(Fid_t sock)
 {
-	return -1;
+  return sys_ListenEx(sock, 0);
+}
+
+
+int sys_AcceptMany(Fid_t lsock, Fid_t* fids, unsigned int max)
+{
+  FCB* lfcb = get_fcb(lsock);
+  SCB* lscb = get_scb(lsock);
+  if(lscb == NULL || lscb->type != LISTENER || fids == NULL || max == 0)
+    return -1;
+
+  /* 
+    We do not hold the FCB, since closing the listener must wake us up.
+    Instead, the listener knows about us, and takes its FCB away from us
+    when it is closed.
+   */
+  unsigned int io_mode = socket_io_begin(lfcb);
+  lscb->refcount++;
+  rlnode acceptor;
+  rlnode_init(&acceptor, CURTHREAD);
+  rlist_push_back(&lscb->lscb.acceptors, &acceptor);
+
+  rlnode* queue = &lscb->lscb.request_queue;
+  int retval = -1;
+
+  while(is_rlist_empty(queue) && lscb->fcb != NULL) {
+    int rc = stream_wait(&lscb->lscb.has_request, SCHED_PIPE);
+    if(rc < 0) { retval = rc; goto finish; }
+  }
+
+  /* The listener was closed while we were waiting */
+  if(lscb->fcb == NULL)
+    goto finish;
+
+  /* Serve all the pending requests that we can take */
+  unsigned int count = 0;
+  while(count < max && ! is_rlist_empty(queue)) {
+    Fid_t fid;
+    FCB* fcb;
+    int reserved = FCB_reserve(1, &fid, &fcb);
+
+    /* Out of fids, leave the rest of the requests for the next call */
+    if(! reserved && count > 0)
+      break;
+
+    /* Never connect a socket twice, and refuse what we cannot afford */
+    RNS* req = rlist_pop_front(queue)->obj;
+    int admitted = reserved && req->scb->type == UNBOUND;
+    if(admitted) {
+      SCB* srv = socket_init(fcb, lscb->port);
+      admitted = socket_connect(req->scb, srv, lscb->lscb.packet);
+      if(admitted)
+        fids[count++] = fid;
+      else
+        socket_close(srv);
+    }
+    if(reserved && ! admitted)
+      FCB_unreserve(1, &fid, &fcb);
+    connect_served(req, admitted);
+
+    if(! reserved)
+      break;
+  }
+  retval = (count > 0) ? (int)count : -1;
+
+finish:
+  rlist_remove(&acceptor);
+  SCB_decref(lscb);
+  socket_io_end(io_mode);
+  return retval;
 }
 
 
 Fid_t sys_Accept(Fid_t lsock)
 {
-	return NOFILE;
+  Fid_t fid;
+  int rc = sys_AcceptMany(lsock, &fid, 1);
+  return (rc == 1) ? fid : rc;
 }
 
 
 int sys_Connect(Fid_t sock, port_t port, timeout_t timeout)
 {
-	return -1;
+  FCB* fcb = get_fcb(sock);
+  SCB* scb = get_scb(sock);
+  if(scb == NULL)
+    return -1;
+
+  /* Make a new request, unless there is one from a non-blocking call */
+  RNS* req = scb->connect;
+  if(req == NULL) {
+    if(scb->type != UNBOUND || port <= NOPORT || port > MAX_PORT)
+      return -1;
+    SCB* lscb = port_pick(port);
+    if(lscb == NULL)
+      return -1;
+
+    req = xmalloc(sizeof(RNS));
+    rlnode_init(&req->request_node, req);
+    req->served = 0;
+    req->admitted = 0;
+    req->waiting = 0;
+    req->deadline = (timeout == TIMEOUT_INFINITE) ? NO_TIMEOUT : bios_clock() + timeout*1000ul;
+    req->wakeup_request = COND_INIT;
+    req->scb = scb;
+    scb->connect = req;
+
+    /* Hand the request to a waiting acceptor */
+    rlist_push_back(&lscb->lscb.request_queue, &req->request_node);
+    Cond_Signal(&lscb->lscb.has_request);
+    poll_notify(&lscb->poll, POLL_READ);
+  }
+  else if(req->waiting)
+    return -1;   /* Another thread is connecting this socket */
+
+  /* As in Read, a Close by another thread takes effect when we return */
+  FCB_incref(fcb);
+  unsigned int io_mode = socket_io_begin(fcb);
+  int rc = 0;
+
+  req->waiting = 1;
+  while(! req->served) {
+    TimerDuration now = bios_clock();
+    if(req->deadline != NO_TIMEOUT && now >= req->deadline)
+      break;
+
+    /* A non-blocking call leaves the request queued */
+    if(CURTHREAD->io_mode & IO_MODE_NONBLOCK) {
+      rc = IO_WOULDBLOCK;
+      break;
+    }
+    if(req->deadline != NO_TIMEOUT) {
+      CURTHREAD->io_mode |= IO_MODE_TIMED;
+      CURTHREAD->io_deadline = req->deadline;
+    }
+    stream_wait(&req->wakeup_request, SCHED_PIPE);
+  }
+  req->waiting = 0;
+
+  if(rc != IO_WOULDBLOCK) {
+    rc = req->admitted ? 0 : -1;
+    connect_free(scb);
+  }
+
+  socket_io_end(io_mode);
+  FCB_decref(fcb);
+  return rc;
+}
+
+
+int socket_set_watermarks(Fid_t sock, unsigned int read_lowat, unsigned int write_lowat)
+{
+  SCB* scb = get_scb(sock);
+  if(scb == NULL || scb->type != PEER)
+    return -1;
+
+  /* The other watermark of each pipe belongs to the peer */
+  PIPE_CB* in = scb->pscb.read_pipe;
+  PIPE_CB* out = scb->pscb.write_pipe;
+
+  /* As for pipes, messages have no watermarks */
+  if((in && in->packet) || (out && out->packet))
+    return -1;
+  if(in) pipe_set_watermarks(in, read_lowat, in->write_lowat);
+  if(out) pipe_set_watermarks(out, out->read_lowat, write_lowat);
+  return 0;
 }
 
 
 int sys_ShutDown(Fid_t sock, shutdown_mode how)
 {
-	return -1;
+  SCB* scb = get_scb(sock);
+  if(scb == NULL || scb->type != PEER || how < SHUTDOWN_READ || how > SHUTDOWN_BOTH)
+    return -1;
+
+  socket_shutdown(scb, how);
+  return 0;
+}
+
+
+Fid_t sys_SocketDgram(port_t port)
+{
+  if(port < NOPORT || port > MAX_PORT || (port != NOPORT && DGRAM_MAP[port] != NULL))
+    return NOFILE;
+
+  Fid_t fid;
+  FCB* fcb;
+  if(! FCB_reserve(1, &fid, &fcb))
+    return NOFILE;
+
+  /* The capacity of the queue is charged, whether it is used or not */
+  kmem_account kmem;
+  if(! kmem_charge(CURPROC, &kmem, DGRAM_QUEUE_SIZE)) {
+    FCB_unreserve(1, &fid, &fcb);
+    return NOFILE;
+  }
+
+  SCB* scb = socket_init(fcb, port);
+  scb->type = DGRAM;
+  rlnode_init(&scb->dscb.queue, NULL);
+  scb->dscb.bytes = 0;
+  scb->dscb.size = DGRAM_QUEUE_SIZE;
+  scb->dscb.kmem = kmem;
+  scb->dscb.policy = DGRAM_BACKPRESSURE;
+  scb->dscb.drops = 0;
+  scb->dscb.has_data = COND_INIT;
+  scb->dscb.has_space = COND_INIT;
+  if(port != NOPORT) DGRAM_MAP[port] = scb;
+  return fid;
 }
 
+
+int sys_SendTo(Fid_t sock, port_t port, const void* buf, unsigned int len)
+{
+  FCB* fcb = get_fcb(sock);
+  SCB* scb = get_scb(sock);
+  if(scb == NULL || scb->type != DGRAM || port <= NOPORT || port > MAX_PORT)
+    return -1;
+  if(len > DGRAM_MAX_SIZE || (buf == NULL && len > 0))
+    return -1;
+
+  SCB* dst = DGRAM_MAP[port];
+  if(dst == NULL)
+    return -1;
+  DSCB* d = &dst->dscb;
+
+  /* Our socket must not be closed while we sleep, and neither must the receiver */
+  FCB_incref(fcb);
+  unsigned int io_mode = socket_io_begin(fcb);
+  dst->refcount++;
+  int rc = len;
+
+  while(dst->fcb != NULL && d->bytes + len > d->size) {
+    if(d->policy == DGRAM_DROP) {
+      d->drops++;
+      goto finish;
+    }
+    int wrc = stream_wait(&d->has_space, SCHED_PIPE);
+    if(wrc < 0) { rc = wrc; goto finish; }
+  }
+
+  /* The receiver was closed while we were waiting */
+  if(dst->fcb == NULL) {
+    rc = -1;
+    goto finish;
+  }
+
+  DGRAM_MSG* msg = xmalloc(sizeof(DGRAM_MSG) + len);
+  rlnode_init(&msg->node, msg);
+  msg->from = scb->port;
+  msg->len = len;
+  memcpy(msg->data, buf, len);
+  rlist_push_back(&d->queue, &msg->node);
+  d->bytes += len;
+
+  Cond_Signal(&d->has_data);
+  poll_notify(&dst->poll, POLL_READ);
+
+finish:
+  SCB_decref(dst);
+  socket_io_end(io_mode);
+  FCB_account(fcb, 1, rc);
+  FCB_decref(fcb);
+  return rc;
+}
+
+
+int sys_RecvFrom(Fid_t sock, port_t* port, void* buf, unsigned int len)
+{
+  FCB* fcb = get_fcb(sock);
+  SCB* scb = get_scb(sock);
+  if(scb == NULL || scb->type != DGRAM || scb->port == NOPORT || (buf == NULL && len > 0))
+    return -1;
+
+  /* As in Read, a Close by another thread takes effect when we return */
+  FCB_incref(fcb);
+  unsigned int io_mode = socket_io_begin(fcb);
+  iovec_t iov = { buf, len };
+  int rc = dgram_recv(scb, port, &iov, 1);
+  socket_io_end(io_mode);
+  FCB_account(fcb, 0, rc);
+  FCB_decref(fcb);
+  return rc;
+}
+
+
+int sys_DgramSetQueue(Fid_t sock, unsigned int size, unsigned int policy)
+{
+  SCB* scb = get_scb(sock);
+  if(scb == NULL || scb->type != DGRAM || scb->port == NOPORT)
+    return -1;
+
+  if(size == 0) size = DGRAM_QUEUE_SIZE;
+  if(size < DGRAM_MAX_SIZE || size > DGRAM_QUEUE_MAX)
+    return -1;
+  if(policy != DGRAM_BACKPRESSURE && policy != DGRAM_DROP)
+    return -1;
+  if(size != scb->dscb.size && ! kmem_recharge(CURPROC, &scb->dscb.kmem, size))
+    return -1;
+
+  /* A larger queue, or dropping, may let the waiting senders go */
+  scb->dscb.size = size;
+  scb->dscb.policy = policy;
+  Cond_Broadcast(&scb->dscb.has_space);
+  return scb->dscb.drops;
+}
@@ -6,85 +6,146 @@
 #include "kernel_cc.h"
 #include "kernel_streams.h"
 #include "kernel_pipe.h"
+#include "kernel_poll.h"
 
+/**
+	@file kernel_socket.h
+	@brief Local sockets.
 
+	@defgroup sockets Sockets.
+	@ingroup kernel
+	@brief Local sockets.
+
+	The listeners are kept in a table indexed by port, so finding the
+	listener of a port is O(1). Each listener has a queue of connection
+	requests. A request belongs to the connecting socket, which has at
+	most one. It stays queued until an @c Accept() takes it off the queue,
+	creates the server socket, and connects the two sockets. A blocking
+	@c Connect() waits for this. A non-blocking one returns at once, and
+	the socket notifies its poll entries when the request is served. Then,
+	the next @c Connect() returns the result, and frees the request.
+
+	Several listeners may share a port (see @c ListenEx()). Then, the
+	table entry of the port holds all of them, and @c Connect() picks one
+	in O(1) time, in turn or by its core.
+
+	A connection is a pair of pipes, one for each direction. Each peer
+	socket is the reader of one pipe and the writer of the other, and
+	@c ShutDown() closes the corresponding end. A pipe is freed when both
+	of its ends are closed. The connections of a listener with 
+	@c LISTEN_PACKET use packet pipes, so they carry messages.
+
+	Datagram sockets have their own port table. Each one keeps a list of
+	the messages sent to it, bounded by their total size. 
+
+	@{
+*/
+
+typedef struct socket_control_block SCB;
+
+/** @brief The state of a socket. */
 typedef enum {
-	UNBOUND, /**< @brief SOCKET initialising */
-	PEER, /**< @brief ready to read n write   */
-	LISTENER, /**< @brief listener socket   */
+	UNBOUND, /**< @brief Neither listening nor connected */
+	PEER, /**< @brief Connected, ready to read and write */
+	LISTENER, /**< @brief Listening socket */
+	DGRAM, /**< @brief Datagram socket */
 } Socket_type;
 
+
+/** @brief The part of a listener socket. */
 typedef struct listener_socket_control_block
 {
-  rlnode request_queue;  			/**< @brief Reference counter. */
-  
-  CondVar has_request; // The condition variable that wakes if the listener has a request
-
-
+  rlnode request_queue;   /**< @brief Pending connection requests */
+  CondVar has_request;    /**< @brief Acceptors wait here */
+  rlnode acceptors;       /**< @brief The threads waiting in @c AcceptMany() */
+  int packet;             /**< @brief Set if the connections carry messages */
 } LSCB;
-  
-typedef struct unbound_socket_control_block
-{
-  int stupid_variable;//A stupid variable that does nothing 
-
-} USCB;
 
 
+/** @brief The part of a connected socket. */
 typedef struct peer_socket_control_block
 {
+  PIPE_CB* read_pipe;     /**< @brief The incoming pipe, NULL after @c SHUTDOWN_READ */
+  PIPE_CB* write_pipe;    /**< @brief The outgoing pipe, NULL after @c SHUTDOWN_WRITE */
+} PSCB;
 
-  SCB* peer_socket;//Pointer to the other peer socket
-  
-  PIPE_CB* read_pipe;
-  PIPE_CB* write_pipe;
 
-} PSCB;
+/** @brief A queued datagram. */
+typedef struct dgram_message
+{
+  rlnode node;            /**< @brief Node in the queue of the receiver */
+  port_t from;            /**< @brief The port of the sender */
+  uint len;               /**< @brief The length of @c data */
+  char data[];            /**< @brief The message */
+} DGRAM_MSG;
 
 
-typedef struct socket_control_block
+/** @brief The part of a datagram socket. */
+typedef struct dgram_socket_control_block
 {
-  port_t port;//The port of the socket 
-  Socket_type type;//The type of the socket which is enum (UNBOUND,PEER,LISTENER)
-  uint refcount;
-  FCB* fcb;//Pointer to the fcb to take the stream object and function
+  rlnode queue;           /**< @brief The received messages */
+  uint bytes;             /**< @brief The total length of the queued messages */
+  uint size;              /**< @brief The capacity of the queue */
+  kmem_account kmem;      /**< @brief The charge for the capacity */
+  uint policy;            /**< @brief @c DGRAM_BACKPRESSURE or @c DGRAM_DROP */
+  uint drops;             /**< @brief The number of dropped messages */
+  CondVar has_data;       /**< @brief Receivers wait here */
+  CondVar has_space;      /**< @brief Senders wait here */
+} DSCB;
+
+
+/** @brief The socket stream object. */
+struct socket_control_block
+{
+  port_t port;            /**< @brief The port of the socket, or NOPORT */
+  Socket_type type;       /**< @brief The state of the socket */
+  uint refcount;          /**< @brief One for the FCB, plus one for each pending call */
+  FCB* fcb;               /**< @brief The stream of the socket */
+  poll_head poll;         /**< @brief Poll entries of the socket, for both directions */
+  struct request_node_struct* connect; /**< @brief The connection request in progress, or NULL */
 
   union {
-   PSCB* pscb;
-   LSCB* lscb;
-   USCB* uscb;
+    LSCB lscb;            /**< @brief Valid for a @c LISTENER */
+    PSCB pscb;            /**< @brief Valid for a @c PEER */
+    DSCB dscb;            /**< @brief Valid for a @c DGRAM */
   };
+};
 
-} SCB;
-
-
-typedef struct request_node_struct
-{ 
-	rlnode request_node;//The head node of the listeners list 
-	uint admitted;//boolean Variable to check if the socket is admitted
-	CondVar wakeup_request;//The condition variable 
-	SCB* scb;//Pointer to the Listening scb 
-
-}RNS;
 
-Fid_t sys_Socket(port_t port);
-
-int sys_Listen(Fid_t sock);
-
-Fid_t sys_Accept(Fid_t lsock);
+/** @brief The listeners of a port. */
+typedef struct port_control_block
+{
+  unsigned int flags;     /**< @brief The @c ListenEx() flags of the listeners */
+  unsigned int count;     /**< @brief The number of listeners */
+  unsigned int next;      /**< @brief The next listener in turn */
+  SCB* listener[MAX_PORT_LISTENERS]; /**< @brief The listeners */
+} PORTCB;
 
-int sys_Connect(Fid_t sock, port_t port, timeout_t timeout);
 
-int sys_Socket_Read(void* stream_object, char *buf, unsigned int size);
-  
-int sys_Socket_Write(void* stream_object, char *buf, unsigned int size);
+/** @brief A connection request, queued on a listener. */
+typedef struct request_node_struct
+{
+  rlnode request_node;    /**< @brief Node in the request queue of the listener */
+  int served;             /**< @brief Set when an acceptor has taken the request */
+  int admitted;           /**< @brief Set if the connection was established */
+  int waiting;            /**< @brief Set while a thread is blocked on the request */
+  TimerDuration deadline; /**< @brief When the request expires, or @c NO_TIMEOUT */
+  CondVar wakeup_request; /**< @brief The connecting thread waits here */
+  SCB* scb;               /**< @brief The connecting socket */
+} RNS;
 
-int sys_Socket_Close(void* streamobj);
 
+/** @brief Release a reference to a socket, freeing it on the last one. */
 void SCB_decref(SCB* scb);
 
-int sys_Socket_Void(void* stream_object, char *buf, unsigned int size);
+/** @brief Set the watermarks of a connected socket, as in @c SetWatermarks().
+
+	The reader watermark applies to the incoming pipe, and the writer 
+	watermark to the outgoing one.
+	@returns 0 on success, or -1 if @c fid is not a connected socket.
+  */
+int socket_set_watermarks(Fid_t fid, unsigned int read_lowat, unsigned int write_lowat);
 
-PIPE_CB* construct_Pipe();
-  
+/** @} */
 
- #endif
\ No newline at end of file
+#endif
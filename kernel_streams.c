@@ -1,8 +1,10 @@
 
+#include <limits.h>
 #include "util.h"
 #include "tinyos.h"
 #include "kernel_cc.h"
 #include "kernel_streams.h"
+#include "kernel_eventq.h"
 #include "kernel_sched.h"
 #include "kernel_proc.h"
 
@@ -29,6 +31,10 @@ FCB* acquire_FCB()
   if(! is_rlist_empty(& FCB_freelist)) {
     FCB* fcb = rlist_pop_front(& FCB_freelist)->fcb;
     fcb->refcount = 0;
+    fcb->flags = 0;
+    rlnode_init(& fcb->watchers, NULL);
+    fcb->devtype = DEV_KERNEL;
+    fcb->stats = (io_stats){ 0 };
     return fcb;
   }
   else
@@ -52,6 +58,8 @@ int FCB_decref(FCB* fcb)
   assert(fcb);
   fcb->refcount --;
   if(fcb->refcount==0) {
+    if(! is_rlist_empty(& fcb->watchers))
+      evq_release_stream(fcb);
     int retval = fcb->streamfunc->Close(fcb->streamobj);
     release_FCB(fcb);
     return retval;
@@ -62,20 +70,141 @@ int FCB_decref(FCB* fcb)
 
 
 
+/*
+ *
+ *   Fid tables
+ *
+ */
+
+FIDT* FIDT_create()
+{
+  FIDT* fidt = xmalloc(sizeof(FIDT));
+  fidt->refcount = 1;
+  fidt->size = FIDT_INITIAL_SIZE;
+  fidt->slot = xmalloc(fidt->size * sizeof(FCB*));
+  memset(fidt->slot, 0, fidt->size * sizeof(FCB*));
+  memset(fidt->used, 0, sizeof(fidt->used));
+  fidt->full = 0;
+  return fidt;
+}
+
+
+FIDT* FIDT_share(FIDT* fidt)
+{
+  fidt->refcount++;
+  return fidt;
+}
+
+
+void FIDT_release(FIDT* fidt)
+{
+  if(--fidt->refcount > 0) return;
+
+  for(uint i=0; i<fidt->size; i++)
+    if(fidt->slot[i] != NULL)
+      FCB_decref(fidt->slot[i]);
+  free(fidt->slot);
+  free(fidt);
+}
+
+
+/* Return the fid table of the current process, making a private copy if it is shared */
+static FIDT* own_fidt()
+{
+  PCB* cur = CURPROC;
+  FIDT* fidt = cur->fidt;
+  if(fidt->refcount == 1) return fidt;
+
+  FIDT* copy = xmalloc(sizeof(FIDT));
+  *copy = *fidt;
+  copy->refcount = 1;
+  copy->slot = xmalloc(copy->size * sizeof(FCB*));
+  memcpy(copy->slot, fidt->slot, copy->size * sizeof(FCB*));
+  for(uint i=0; i<copy->size; i++)
+    if(copy->slot[i] != NULL)
+      FCB_incref(copy->slot[i]);
+
+  fidt->refcount--;
+  cur->fidt = copy;
+  return copy;
+}
+
+
+/* Make sure the table has a slot for fid */
+static void fidt_grow(FIDT* fidt, Fid_t fid)
+{
+  if(fid < fidt->size) return;
+
+  uint size = fidt->size;
+  while(size <= fid) size *= 2;
+  fidt->slot = xrealloc(fidt->slot, size * sizeof(FCB*));
+  memset(fidt->slot + fidt->size, 0, (size - fidt->size) * sizeof(FCB*));
+  fidt->size = size;
+}
+
+
+static inline void fidt_mark(FIDT* fidt, Fid_t fid)
+{
+  uint w = fid / 64;
+  fidt->used[w] |= (uint64_t)1 << (fid % 64);
+  if(fidt->used[w] == ~(uint64_t)0)
+    fidt->full |= (uint64_t)1 << w;
+}
+
+
+static inline void fidt_unmark(FIDT* fidt, Fid_t fid)
+{
+  uint w = fid / 64;
+  fidt->used[w] &= ~((uint64_t)1 << (fid % 64));
+  fidt->full &= ~((uint64_t)1 << w);
+}
+
+
+/* Allocate the lowest free fid below limit, or return NOFILE */
+static Fid_t fidt_alloc(FIDT* fidt, size_t limit)
+{
+  if(~fidt->full == 0) return NOFILE;
+  uint w = __builtin_ctzll(~fidt->full);
+  if(w >= FIDT_WORDS) return NOFILE;
+  Fid_t fid = w*64 + __builtin_ctzll(~fidt->used[w]);
+  if(fid >= limit) return NOFILE;
+
+  fidt_grow(fidt, fid);
+  fidt_mark(fidt, fid);
+  return fid;
+}
+
+
+/* Install an FCB at a used fid */
+static inline void fidt_set(FIDT* fidt, Fid_t fid, FCB* fcb)
+{
+  fidt->slot[fid] = fcb;
+}
+
+
+/* Return the fid limit of the current process */
+static inline size_t fid_limit()
+{
+  unsigned long limit = CURPROC->rlimits[RLIMIT_FIDS];
+  return limit < MAX_FILEID ? limit : MAX_FILEID;
+}
+
+
 int FCB_reserve(size_t num, Fid_t *fid, FCB** fcb)
 {
-    PCB* cur = CURPROC;
-    size_t f=0;
+    FIDT* fidt = own_fidt();
+    size_t limit = fid_limit();
     uint i;
 
     /* Find distinct fids */
-    for(i=0; i<num; i++) {
-	while(f<MAX_FILEID && cur->FIDT[f]!=NULL)
-	    f++;
-	if(f==MAX_FILEID) break;
-	fid[i] = f; f++;
+    for(i=0; i<num; i++)
+	if((fid[i] = fidt_alloc(fidt, limit)) == NOFILE)
+	    break;
+    if(i<num) {
+	while(i>0) 
+	    fidt_unmark(fidt, fid[--i]);
+	return 0;
     }
-    if(i<num) return 0;
     /* Allocate FCBs */
     for(i=0;i<num;i++)
 	if((fcb[i] = acquire_FCB()) == NULL)
@@ -86,11 +215,13 @@ int FCB_reserve(size_t num, Fid_t *fid, FCB** fcb)
 	    release_FCB(fcb[i-1]);
 	    i--;
 	}
+	for(i=0; i<num; i++)
+	    fidt_unmark(fidt, fid[i]);
 	return 0;
     }
     /* Found all */
     for(i=0;i<num;i++) {
-	cur->FIDT[fid[i]]=fcb[i];
+	fidt_set(fidt, fid[i], fcb[i]);
 	FCB_incref(fcb[i]);
     }
     return 1;
@@ -100,10 +231,11 @@ int FCB_reserve(size_t num, Fid_t *fid, FCB** fcb)
 
 void FCB_unreserve(size_t num, Fid_t *fid, FCB** fcb)
 {
-    PCB* cur = CURPROC;
+    FIDT* fidt = own_fidt();
     for(size_t i=0; i<num ; i++) {
-	assert(cur->FIDT[fid[i]]==fcb[i]);
-	cur->FIDT[fid[i]] = NULL;
+	assert(fidt->slot[fid[i]]==fcb[i]);
+	fidt_set(fidt, fid[i], NULL);
+	fidt_unmark(fidt, fid[i]);
 	release_FCB(fcb[i]);
     }
 }
@@ -122,13 +254,107 @@ void FCB_unreserve(size_t num, Fid_t *fid, FCB** fcb)
 
 FCB* get_fcb(Fid_t fid)
 {
-  if(fid < 0 || fid >= MAX_FILEID) return NULL;
+  FIDT* fidt = CURPROC->fidt;
+  if(fid < 0 || fid >= fidt->size) return NULL;
 
-  return CURPROC->FIDT[fid];
+  return fidt->slot[fid];
 }
 
 
-int sys_Read(Fid_t fd, char *buf, unsigned int size)
+/*
+  The I/O mode of the current thread is set for the duration of each 
+  I/O call, and consulted by stream_wait and stream_yield. A call on two
+  streams (Splice) is non-blocking if either of them is.
+ */
+static void io_begin(FCB* fcb, FCB* peer, timeout_t timeout)
+{
+  TCB* tcb = CURTHREAD;
+  unsigned int flags = fcb->flags | (peer ? peer->flags : 0);
+  tcb->io_fcb = fcb;
+  tcb->io_mode = (flags & FID_NONBLOCK) ? IO_MODE_NONBLOCK : 0;
+  if(timeout != TIMEOUT_INFINITE) {
+    tcb->io_mode |= IO_MODE_TIMED;
+    tcb->io_deadline = bios_clock() + timeout*1000ul;
+  }
+}
+
+static void io_end()
+{
+  CURTHREAD->io_mode = 0;
+  CURTHREAD->io_fcb = NULL;
+  CURTHREAD->io_min = 0;
+}
+
+
+unsigned int stream_read_min()
+{
+  return CURTHREAD->io_min;
+}
+
+
+void FCB_account(FCB* fcb, int write, int rc)
+{
+  io_stats* dev = & device_dcb(fcb->devtype)->stats;
+  unsigned long bytes = (rc > 0) ? rc : 0;
+
+  if(write) {
+    fcb->stats.writes++;            dev->writes++;
+    fcb->stats.bytes_written += bytes; dev->bytes_written += bytes;
+  } else {
+    fcb->stats.reads++;             dev->reads++;
+    fcb->stats.bytes_read += bytes; dev->bytes_read += bytes;
+  }
+}
+
+
+/* Account for the time the current thread spent blocked since start (by bios_cpu_clock) */
+static void io_account_wait(TimerDuration start)
+{
+  FCB* fcb = CURTHREAD->io_fcb;
+  if(fcb == NULL) return;
+
+  io_stats* dev = & device_dcb(fcb->devtype)->stats;
+  TimerDuration blocked = bios_cpu_clock() - start;
+  fcb->stats.blocked_time += blocked;  dev->blocked_time += blocked;
+  fcb->stats.wakeups++;                dev->wakeups++;
+}
+
+
+int stream_wait(CondVar* cv, enum SCHED_CAUSE cause)
+{
+  TCB* tcb = CURTHREAD;
+  if(tcb->io_mode & IO_MODE_NONBLOCK)
+    return IO_WOULDBLOCK;
+
+  TimerDuration start = bios_cpu_clock();
+  if(tcb->io_mode & IO_MODE_TIMED) {
+    TimerDuration now = bios_clock();
+    if(now >= tcb->io_deadline)
+      return IO_TIMEDOUT;
+    kernel_timedwait(cv, cause, tcb->io_deadline - now);
+  }
+  else
+    kernel_wait(cv, cause);
+  io_account_wait(start);
+  return 0;
+}
+
+
+int stream_yield(enum SCHED_CAUSE cause)
+{
+  TCB* tcb = CURTHREAD;
+  if(tcb->io_mode & IO_MODE_NONBLOCK)
+    return IO_WOULDBLOCK;
+  if((tcb->io_mode & IO_MODE_TIMED) && bios_clock() >= tcb->io_deadline)
+    return IO_TIMEDOUT;
+  TimerDuration start = bios_cpu_clock();
+  yield(cause);
+  io_account_wait(start);
+  return 0;
+}
+
+
+int sys_ReadTimed(Fid_t fd, char *buf, unsigned int size, timeout_t timeout)
 {
   int retcode = -1;
   int (*devread)(void*,char*,uint);
@@ -146,8 +372,12 @@ int sys_Read(Fid_t fd, char *buf, unsigned int size)
        while we are using it! */
     FCB_incref(fcb);
   
-    if(devread)
+    if(devread) {
+      io_begin(fcb, NULL, timeout);
       retcode = devread(sobj, buf, size);
+      io_end();
+      FCB_account(fcb, 0, retcode);
+    }
 
     /* Need to decrease the reference to FCB */
     FCB_decref(fcb);
@@ -160,7 +390,7 @@ int sys_Read(Fid_t fd, char *buf, unsigned int size)
 }
 
 
-int sys_Write(Fid_t fd, const char *buf, unsigned int size)
+int sys_WriteTimed(Fid_t fd, const char *buf, unsigned int size, timeout_t timeout)
 {
   int retcode = -1;
   int (*devwrite)(void*, const char*, uint) = NULL;
@@ -180,8 +410,12 @@ int sys_Write(Fid_t fd, const char *buf, unsigned int size)
     FCB_incref(fcb);
   
 
-    if(devwrite)
+    if(devwrite) {
+      io_begin(fcb, NULL, timeout);
       retcode = devwrite(sobj, buf, size);
+      io_end();
+      FCB_account(fcb, 1, retcode);
+    }
 
     /* Need to decrease the reference to FCB */
     FCB_decref(fcb);
@@ -193,6 +427,230 @@ int sys_Write(Fid_t fd, const char *buf, unsigned int size)
 }
 
 
+int sys_ReadAtLeast(Fid_t fd, char *buf, unsigned int size, unsigned int min, timeout_t timeout)
+{
+  FCB* fcb = get_fcb(fd);
+  if(fcb == NULL || fcb->streamfunc->Read == NULL || min > size)
+    return -1;
+
+  FCB_incref(fcb);
+
+  /* Streams that know about io_min return enough in one call */
+  int count = 0, rc;
+  io_begin(fcb, NULL, timeout);
+  do {
+    CURTHREAD->io_min = min - count;
+    rc = fcb->streamfunc->Read(fcb->streamobj, buf+count, size-count);
+    if(rc > 0) count += rc;
+  } while(rc > 0 && count < min);
+  io_end();
+
+  rc = count > 0 ? count : rc;
+  FCB_account(fcb, 0, rc);
+  FCB_decref(fcb);
+  return rc;
+}
+
+
+int sys_Read(Fid_t fd, char *buf, unsigned int size)
+{
+  return sys_ReadTimed(fd, buf, size, TIMEOUT_INFINITE);
+}
+
+
+int sys_Write(Fid_t fd, const char *buf, unsigned int size)
+{
+  return sys_WriteTimed(fd, buf, size, TIMEOUT_INFINITE);
+}
+
+
+int sys_SetFidFlags(Fid_t fd, unsigned int flags)
+{
+  FCB* fcb = get_fcb(fd);
+  if(fcb == NULL || (flags & ~FID_NONBLOCK))
+    return -1;
+  fcb->flags = flags;
+  return 0;
+}
+
+
+int sys_GetFidFlags(Fid_t fd)
+{
+  FCB* fcb = get_fcb(fd);
+  return fcb ? (int) fcb->flags : -1;
+}
+
+
+/* 
+  Check a scatter/gather list: the total length must fit in the return value.
+ */
+static int iov_valid(const iovec_t* iov, unsigned int iovcnt)
+{
+  if(iov == NULL || iovcnt > MAX_IOVEC) return 0;
+  unsigned long total = 0;
+  for(unsigned int i=0; i<iovcnt; i++) {
+    total += iov[i].len;
+  }
+  return total <= INT_MAX;
+}
+
+
+/*
+  The generic vectored read, for streams without a Readv method. The
+  next segment is read only if the previous one was filled.
+ */
+static int generic_readv(FCB* fcb, const iovec_t* iov, unsigned int iovcnt)
+{
+  int (*devread)(void*,char*,uint) = fcb->streamfunc->Read;
+  if(devread == NULL) return -1;
+
+  int count = 0;
+  for(unsigned int i=0; i<iovcnt; i++) {
+    if(iov[i].len == 0) continue;
+    int rc = devread(fcb->streamobj, iov[i].base, iov[i].len);
+    if(rc < 0) return count > 0 ? count : rc;
+    count += rc;
+    if(rc < iov[i].len) break;
+  }
+  return count;
+}
+
+
+/*
+  The generic vectored write, for streams without a Writev method. 
+ */
+static int generic_writev(FCB* fcb, const iovec_t* iov, unsigned int iovcnt)
+{
+  int (*devwrite)(void*,const char*,uint) = fcb->streamfunc->Write;
+  if(devwrite == NULL) return -1;
+
+  int count = 0;
+  for(unsigned int i=0; i<iovcnt; i++) {
+    if(iov[i].len == 0) continue;
+    int rc = devwrite(fcb->streamobj, iov[i].base, iov[i].len);
+    if(rc < 0) return count > 0 ? count : rc;
+    count += rc;
+    if(rc < iov[i].len) break;
+  }
+  return count;
+}
+
+
+int sys_ReadV(Fid_t fd, const iovec_t* iov, unsigned int iovcnt)
+{
+  int retcode = -1;
+  FCB* fcb = get_fcb(fd);
+
+  if(fcb && iov_valid(iov, iovcnt)) {
+    FCB_incref(fcb);
+    io_begin(fcb, NULL, TIMEOUT_INFINITE);
+    if(fcb->streamfunc->Readv)
+      retcode = fcb->streamfunc->Readv(fcb->streamobj, iov, iovcnt);
+    else
+      retcode = generic_readv(fcb, iov, iovcnt);
+    io_end();
+    FCB_account(fcb, 0, retcode);
+    FCB_decref(fcb);
+  }
+
+  return retcode;
+}
+
+
+int sys_WriteV(Fid_t fd, const iovec_t* iov, unsigned int iovcnt)
+{
+  int retcode = -1;
+  FCB* fcb = get_fcb(fd);
+
+  if(fcb && iov_valid(iov, iovcnt)) {
+    FCB_incref(fcb);
+    io_begin(fcb, NULL, TIMEOUT_INFINITE);
+    if(fcb->streamfunc->Writev)
+      retcode = fcb->streamfunc->Writev(fcb->streamobj, iov, iovcnt);
+    else
+      retcode = generic_writev(fcb, iov, iovcnt);
+    io_end();
+    FCB_account(fcb, 1, retcode);
+    FCB_decref(fcb);
+  }
+
+  return retcode;
+}
+
+
+/* Deliver all n bytes in blocking mode; -1 only if none were accepted */
+int stream_splice_copy(int (*sink)(void*, const char*, unsigned int), void* sinkobj,
+  const char* buf, unsigned int n)
+{
+  /* 
+    The bytes are consumed, so we must deliver them all, even if this 
+    blocks on the destination. Only an error of the destination loses them.
+   */
+  unsigned int io_mode = CURTHREAD->io_mode;
+  CURTHREAD->io_mode &= ~(IO_MODE_NONBLOCK|IO_MODE_TIMED);
+  unsigned int count = 0;
+  while(count < n) {
+    int rc = sink(sinkobj, buf+count, n-count);
+    if(rc <= 0) break;
+    count += rc;
+  }
+  CURTHREAD->io_mode = io_mode;
+  return count > 0 ? (int) count : -1;
+}
+
+
+/* Splice through a buffer, for streams without a Splice method */
+static int bounce_splice(FCB* src, FCB* dst, unsigned int len)
+{
+  int (*devread)(void*,char*,uint) = src->streamfunc->Read;
+  int (*devwrite)(void*,const char*,uint) = dst->streamfunc->Write;
+  if(devread == NULL) return -1;
+
+  /* Do not take bytes from the source that the destination cannot take */
+  if(dst->streamfunc->Poll) {
+    unsigned int events = dst->streamfunc->Poll(dst->streamobj, NULL);
+    if(events & POLL_ERROR) return -1;
+    if(! (events & POLL_WRITE) && (CURTHREAD->io_mode & IO_MODE_NONBLOCK))
+      return IO_WOULDBLOCK;
+  }
+
+  char buffer[SPLICE_BUFFER_SIZE];
+  int n = devread(src->streamobj, buffer, len < SPLICE_BUFFER_SIZE ? len : SPLICE_BUFFER_SIZE);
+  if(n <= 0) return n;
+
+  return stream_splice_copy(devwrite, dst->streamobj, buffer, n);
+}
+
+
+int sys_Splice(Fid_t from, Fid_t to, unsigned int len)
+{
+  FCB* src = get_fcb(from);
+  FCB* dst = get_fcb(to);
+
+  if(src==NULL || dst==NULL || dst->streamfunc->Write==NULL || len > INT_MAX)
+    return -1;
+  if(len == 0)
+    return 0;
+
+  FCB_incref(src);
+  FCB_incref(dst);
+
+  int retcode;
+  io_begin(src, dst, TIMEOUT_INFINITE);
+  if(src->streamfunc->Splice)
+    retcode = src->streamfunc->Splice(src->streamobj, dst->streamfunc->Write, dst->streamobj, len);
+  else
+    retcode = bounce_splice(src, dst, len);
+  io_end();
+  FCB_account(src, 0, retcode);
+  FCB_account(dst, 1, retcode);
+
+  FCB_decref(dst);
+  FCB_decref(src);
+  return retcode;
+}
+
+
 int sys_Close(int fd)
 {
   int retcode = (fd>=0 && fd<MAX_FILEID) ? 0 : -1;  /* Closing a closed fd is legal! */
@@ -200,7 +658,9 @@ int sys_Close(int fd)
   FCB* fcb = get_fcb(fd);
 
   if(fcb) {
-    CURPROC->FIDT[fd] = NULL;
+    FIDT* fidt = own_fidt();
+    fidt_set(fidt, fd, NULL);
+    fidt_unmark(fidt, fd);
     retcode = FCB_decref(fcb);    
   }
 
@@ -221,6 +681,10 @@ int sys_Dup2(int oldfd, int newfd)
   if(oldfd<0 || newfd<0 || oldfd>=MAX_FILEID || newfd>=MAX_FILEID)
     return -1;
 
+  /* Respect the fid limit of the process */
+  if(newfd >= fid_limit())
+    return -1;
+
   FCB* old = get_fcb(oldfd);
   FCB* new = get_fcb(newfd);
 
@@ -228,10 +692,13 @@ int sys_Dup2(int oldfd, int newfd)
     retcode = -1;
   }
   else if(old!=new) {
+    FIDT* fidt = own_fidt();
+    FCB_incref(old);
+    fidt_grow(fidt, newfd);
+    fidt_set(fidt, newfd, old);
+    fidt_mark(fidt, newfd);
     if(new)
       FCB_decref(new);
-    FCB_incref(old);
-    CURPROC->FIDT[newfd] = old;
   }
 
   return retcode;
@@ -261,6 +728,7 @@ Fid_t open_stream(Device_type major, unsigned int minor)
       FCB_unreserve(1, &fid, &fcb);
       goto finerr;
   }
+  fcb->devtype = major;
   
   goto finok;
 finerr:
@@ -281,3 +749,86 @@ Fid_t sys_OpenTerminal(unsigned int termno)
   return open_stream(DEV_SERIAL, termno);
 }
 
+
+
+/*
+  I/O statistics streams. The records are copied when the stream is 
+  opened, and returned by Read in whole records.
+ */
+typedef struct iostat_stream
+{
+  unsigned int count;     /* Number of records */
+  unsigned int pos;       /* The next record to return */
+  iostat_info rec[];
+} iostat_stream;
+
+
+static void iostat_fill(iostat_info* rec, Fid_t fid, Device_type devtype, io_stats* stats)
+{
+  rec->fid = fid;
+  strncpy(rec->devname, device_dcb(devtype)->name, IOSTAT_NAME_SIZE-1);
+  rec->devname[IOSTAT_NAME_SIZE-1] = '\0';
+  rec->stats = *stats;
+}
+
+
+static int iostat_read(void* this, char* buf, unsigned int size)
+{
+  iostat_stream* ios = this;
+
+  if(size < sizeof(iostat_info))
+    return -1;
+
+  unsigned int n = size / sizeof(iostat_info);
+  if(n > ios->count - ios->pos) n = ios->count - ios->pos;
+  memcpy(buf, &ios->rec[ios->pos], n*sizeof(iostat_info));
+  ios->pos += n;
+  return n*sizeof(iostat_info);
+}
+
+
+static int iostat_close(void* this)
+{
+  free(this);
+  return 0;
+}
+
+
+static file_ops iostat_fops = {
+  .Open = NULL,
+  .Read = iostat_read,
+  .Write = NULL,
+  .Close = iostat_close
+};
+
+
+Fid_t sys_OpenIoStats()
+{
+  Fid_t fid;
+  FCB* fcb;
+
+  if(! FCB_reserve(1, &fid, &fcb))
+    return NOFILE;
+
+  /* The new stream is included in the records */
+  FIDT* fidt = CURPROC->fidt;
+  unsigned int count = DEV_MAX;
+  for(Fid_t i=0; i<fidt->size; i++)
+    if(fidt->slot[i]) count++;
+
+  iostat_stream* ios = xmalloc(sizeof(iostat_stream) + count*sizeof(iostat_info));
+  ios->count = count;
+  ios->pos = 0;
+
+  unsigned int n = 0;
+  for(int d=0; d<DEV_MAX; d++)
+    iostat_fill(&ios->rec[n++], NOFILE, d, & device_dcb(d)->stats);
+  for(Fid_t i=0; i<fidt->size; i++) {
+    FCB* f = fidt->slot[i];
+    if(f) iostat_fill(&ios->rec[n++], i, f->devtype, &f->stats);
+  }
+
+  fcb->streamobj = ios;
+  fcb->streamfunc = &iostat_fops;
+  return fid;
+}
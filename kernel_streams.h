@@ -3,6 +3,7 @@
 
 #include "tinyos.h"
 #include "kernel_dev.h"
+#include "kernel_sched.h"
 
 /**
 	@file kernel_streams.h
@@ -41,13 +42,62 @@
 typedef struct file_control_block
 {
   uint refcount;  			/**< @brief Reference counter. */
+  unsigned int flags;       /**< @brief The flags set by @c SetFidFlags */
   void* streamobj;			/**< @brief The stream object (e.g., a device) */
   file_ops* streamfunc;		/**< @brief The stream implementation methods */
   rlnode freelist_node;		/**< @brief Intrusive list node */
+  rlnode watchers;          /**< @brief Event queue items watching this stream */
+  Device_type devtype;      /**< @brief The device type, for accounting */
+  io_stats stats;           /**< @brief I/O counters */
 } FCB;
 
 
 
+/** @brief The initial number of slots of a fid table. */
+#define FIDT_INITIAL_SIZE 64
+
+/** @brief The number of words in the bitmap of a fid table. */
+#define FIDT_WORDS ((MAX_FILEID+63)/64)
+
+#if FIDT_WORDS > 64
+#error "The fid table bitmap supports at most 4096 fids"
+#endif
+
+/** @brief The fid table of a process.
+
+	The fid table maps fids to FCBs. The array of slots grows on demand,
+	doubling in size, up to @c MAX_FILEID slots. Used fids are marked in a
+	two-level bitmap, so that the lowest free fid is found in constant time.
+
+	A table can be shared copy-on-write by many processes: a child process
+	starts with the table of its parent, and a private copy is made when
+	either process first changes it. Each FCB reference is held by the table, 
+	not by the processes sharing it.
+ */
+typedef struct fid_table
+{
+  uint refcount;            /**< @brief Number of processes sharing the table */
+  uint size;                /**< @brief Number of slots */
+  FCB** slot;               /**< @brief The FCB of each fid, or NULL */
+  uint64_t used[FIDT_WORDS];/**< @brief Bit set for each used fid */
+  uint64_t full;            /**< @brief Bit @c i set when word @c used[i] is full */
+} FIDT;
+
+
+/** @brief Create an empty fid table. */
+FIDT* FIDT_create();
+
+/** @brief Share a fid table with one more process, returning the table. */
+FIDT* FIDT_share(FIDT* fidt);
+
+/** @brief Release a fid table.
+
+	When the last process releases the table, all the FCBs it holds are 
+	decref'ed and the table is freed.
+  */
+void FIDT_release(FIDT* fidt);
+
+
 /** 
   @brief Initialization for files and streams.
 
@@ -78,6 +128,19 @@ void FCB_incref(FCB* fcb);
 int FCB_decref(FCB* fcb);
 
 
+/**
+	@brief Account for a read or write call on a stream.
+
+	The counters of the FCB and its device type are updated, for a call
+	that returned @c rc.
+
+	@param fcb the stream
+	@param write non-zero for a write call, zero for a read call
+	@param rc the return value of the call
+*/
+void FCB_account(FCB* fcb, int write, int rc);
+
+
 /** @brief Acquire a number of FCBs and corresponding fids.
 
    Given an array of fids and an array of pointers to FCBs  of
@@ -128,6 +191,57 @@ void FCB_unreserve(size_t num, Fid_t *fid, FCB** fcb);
 FCB* get_fcb(Fid_t fid);
 
 
+/** @brief Flags for the @c io_mode field of the TCB. */
+enum {
+	IO_MODE_NONBLOCK = 1,	/**< @brief Do not block */
+	IO_MODE_TIMED = 2		/**< @brief Block until @c io_deadline */
+};
+
+
+/** @brief Wait for a stream to become ready.
+
+	Stream implementations call this function instead of @c kernel_wait(),
+	so that the I/O call respects the non-blocking flag of the stream, and 
+	the timeout of timed calls. The caller should check the condition again
+	when this returns 0.
+
+	@param cv the condition variable to wait on
+	@param cause the scheduler cause for the wait
+	@returns 0 after waiting, or @c IO_WOULDBLOCK or @c IO_TIMEDOUT if the
+	   I/O call must return without waiting (more).
+  */
+int stream_wait(CondVar* cv, enum SCHED_CAUSE cause);
+
+
+/** @brief Yield while waiting for a polled stream.
+
+	This is like @ref stream_wait, for drivers that poll the device by 
+	calling @c yield().
+  */
+int stream_yield(enum SCHED_CAUSE cause);
+
+
+/** @brief The least number of bytes that the current read call asks for.
+
+	This is set by @c ReadAtLeast(), and it is 0 for other calls. A stream
+	may wait until this many bytes are available, instead of returning
+	fewer. Returning fewer is not an error: the caller will read again.
+  */
+unsigned int stream_read_min();
+
+
+/** @brief Write a whole buffer to the sink of a @c Splice method.
+
+	This is for @c Splice methods that copy the data out of the stream 
+	before they pass them on. Since the data are already consumed, the
+	sink is called in blocking mode until it accepts them all, or fails.
+
+	@returns the number of bytes written, or -1 if none were written.
+  */
+int stream_splice_copy(int (*sink)(void*, const char*, unsigned int), void* sinkobj,
+	const char* buf, unsigned int n);
+
+
 /** @} */
 
 #endif
@@ -14,11 +14,13 @@
 
 #define PRE_CALL \
 kernel_lock();\
+sched_account_syscall();\
 
 
 
 #define POST_CALL \
 kernel_unlock();\
+sched_syscall_exit();\
 
 
 /* with return */
@@ -9,26 +9,59 @@ SYSCALL(Exec, int, (Task task, int argl, void* args), (task, argl, args))\
 SYSCALLV(Exit, (int exitval), (exitval))\
 SYSCALL(GetPid, int, (void), ())\
 SYSCALL(GetPPid, int, (void), ())\
+SYSCALL(SetLimit, int, (rlimit_t res, unsigned long value), (res, value))\
+SYSCALL(GetLimit, unsigned long, (rlimit_t res), (res))\
 SYSCALL(WaitChild, Pid_t, (Pid_t proc, int* exitval), (proc, exitval))\
 SYSCALL(CreateThread, Tid_t, (Task task, int argl, void* args), (task, argl, args))\
 SYSCALL(ThreadSelf, Tid_t, (void), ())\
 SYSCALL(ThreadJoin, int, (Tid_t tid, int* exitval), (tid, exitval))\
 SYSCALL(ThreadDetach, int, (Tid_t tid), (tid))\
 SYSCALLV(ThreadExit, (int exitval), (exitval))\
+SYSCALL(TlsKeyCreate, TlsKey_t, (void (*destructor)(void*)), (destructor))\
+SYSCALL(TlsKeyDelete, int, (TlsKey_t key), (key))\
 SYSCALL(GetTerminalDevices, unsigned int, (), ())\
 SYSCALL(OpenTerminal, Fid_t, (unsigned int termno), (termno))\
 SYSCALL(OpenNull, Fid_t, (), ())\
 SYSCALL(Read,int,(Fid_t fd, char *buf, unsigned int size), (fd,buf,size))\
 SYSCALL(Write,int,(Fid_t fd, const char *buf, unsigned int size), (fd,buf,size))\
+SYSCALL(ReadV,int,(Fid_t fd, const iovec_t* iov, unsigned int iovcnt), (fd,iov,iovcnt))\
+SYSCALL(WriteV,int,(Fid_t fd, const iovec_t* iov, unsigned int iovcnt), (fd,iov,iovcnt))\
+SYSCALL(ReadTimed,int,(Fid_t fd, char *buf, unsigned int size, timeout_t timeout), (fd,buf,size,timeout))\
+SYSCALL(WriteTimed,int,(Fid_t fd, const char *buf, unsigned int size, timeout_t timeout), (fd,buf,size,timeout))\
+SYSCALL(ReadAtLeast,int,(Fid_t fd, char *buf, unsigned int size, unsigned int min, timeout_t timeout), (fd,buf,size,min,timeout))\
+SYSCALL(SetFidFlags,int,(Fid_t fd, unsigned int flags), (fd,flags))\
+SYSCALL(GetFidFlags,int,(Fid_t fd), (fd))\
+SYSCALL(Splice,int,(Fid_t from, Fid_t to, unsigned int len), (from,to,len))\
 SYSCALL(Close,int,(Fid_t fd),(fd))\
 SYSCALL(Dup2,int, (Fid_t oldfd, Fid_t newfd), (oldfd,newfd))\
+SYSCALL(Poll, int, (pollfd_t* fds, unsigned int n, timeout_t timeout), (fds,n,timeout))\
+SYSCALL(EventQueueCreate, Fid_t, (), ())\
+SYSCALL(EventQueueCtl, int, (Fid_t evq, evq_op op, Fid_t fid, unsigned int events), (evq,op,fid,events))\
+SYSCALL(EventQueueWait, int, (Fid_t evq, pollfd_t* events, unsigned int max, timeout_t timeout), (evq,events,max,timeout))\
 SYSCALL(Pipe, int, (pipe_t* pipe), (pipe))\
+SYSCALL(PipeEx, int, (pipe_t* pipe, unsigned int size, unsigned int flags), (pipe,size,flags))\
+SYSCALL(PipeSetSize, int, (Fid_t fid, unsigned int size), (fid,size))\
+SYSCALL(PipeGetSize, int, (Fid_t fid), (fid))\
+SYSCALL(SetWatermarks, int, (Fid_t fid, unsigned int read_lowat, unsigned int write_lowat), (fid,read_lowat,write_lowat))\
 SYSCALL(Socket, Fid_t, (port_t port), (port))\
 SYSCALL(Listen, int, (Fid_t sock), (sock))\
+SYSCALL(ListenEx, int, (Fid_t sock, unsigned int flags), (sock,flags))\
 SYSCALL(Accept, Fid_t, (Fid_t lsock), (lsock))\
+SYSCALL(AcceptMany, int, (Fid_t lsock, Fid_t* fids, unsigned int max), (lsock,fids,max))\
 SYSCALL(Connect, int, (Fid_t sock, port_t port, timeout_t timeout), (sock, port, timeout))\
 SYSCALL(ShutDown, int, (Fid_t sock, shutdown_mode how), (sock, how))\
+SYSCALL(SocketDgram, Fid_t, (port_t port), (port))\
+SYSCALL(SendTo, int, (Fid_t sock, port_t port, const void* buf, unsigned int len), (sock,port,buf,len))\
+SYSCALL(RecvFrom, int, (Fid_t sock, port_t* port, void* buf, unsigned int len), (sock,port,buf,len))\
+SYSCALL(DgramSetQueue, int, (Fid_t sock, unsigned int size, unsigned int policy), (sock,size,policy))\
+SYSCALL(HostListen, Fid_t, (const char* path), (path))\
+SYSCALL(HostAccept, Fid_t, (Fid_t lsock), (lsock))\
+SYSCALL(AioCreate, Fid_t, (), ())\
+SYSCALL(AioSubmit, int, (Fid_t ctx, const aio_sqe* sqe, unsigned int n), (ctx,sqe,n))\
+SYSCALL(AioReap, int, (Fid_t ctx, aio_cqe* cqe, unsigned int max, unsigned int min, timeout_t timeout), (ctx,cqe,max,min,timeout))\
 SYSCALL(OpenInfo, Fid_t, (), ())\
+SYSCALL(OpenInfoFilter, Fid_t, (const procinfo_filter* filter), (filter))\
+SYSCALL(OpenIoStats, Fid_t, (), ())\
 
 
 
@@ -4,6 +4,7 @@
 #include "kernel_proc.h"
 #include "kernel_cc.h"
 #include "kernel_streams.h"
+#include "kernel_threads.h"
 
 
 #define SYSTEM_PAGE_SIZE (1 << 12)
@@ -23,6 +24,10 @@ Tid_t sys_CreateThread(Task task, int argl, void* args){
 
  TCB* tcb=NULL;
 
+  /* Respect the thread limit of the process */
+  if(CURPROC->thread_count >= CURPROC->rlimits[RLIMIT_THREADS])
+    return NOTHREAD;
+
    PTCB* ptcb = spawn_ptcb(task,argl,args);//Creating and initializing a ptcb for the new thread
 
   if(ptcb==NULL)
@@ -31,8 +36,13 @@ Tid_t sys_CreateThread(Task task, int argl, void* args){
   tcb = spawn_thread(CURPROC,start_new_thread);
 
   
-  if(tcb==NULL)
+  if(tcb==NULL) {
+    /* Out of memory, undo the ptcb */
+    rlist_remove(&ptcb->thread_list_node);
+    kmem_uncharge(&ptcb->kmem);
+    free(ptcb);
     return NOTHREAD;
+  }
 
  
  ptcb->tcb=tcb;//connecting ptcb to its tcb
@@ -40,7 +50,9 @@ Tid_t sys_CreateThread(Task task, int argl, void* args){
 
   /* increase the count of threads in pcb */
 
+  seq_write_begin(&CURPROC->info_seq);
   CURPROC->thread_count++;
+  seq_write_end(&CURPROC->info_seq);
 
   
   int ret=wakeup(tcb);
@@ -148,6 +160,8 @@ void release_PTCB(PTCB* ptcb);
   */
 void sys_ThreadExit(int exitval)
 {
+  run_tls_destructors();
+
   PTCB*  cptcb=  CURTHREAD->ptcb;//cache this variable for better performance
 
   assert(cptcb!=NULL);
@@ -175,21 +189,20 @@ void sys_ThreadExit(int exitval)
     free(curproc->args);
     curproc->args = NULL;
   }
+  kmem_uncharge(&curproc->args_kmem);
 
   /* Clean up FIDT */
-  for(int i=0;i<MAX_FILEID;i++) {
-    if(curproc->FIDT[i] != NULL) {
-      FCB_decref(curproc->FIDT[i]);
-      curproc->FIDT[i] = NULL;
-    }
-  }
+  FIDT_release(curproc->fidt);
+  curproc->fidt = NULL;
 
   /* Reparent any children of the exiting process to the 
      initial task */
   PCB* initpcb = get_pcb(1);
   while(!is_rlist_empty(& curproc->children_list)) {
     rlnode* child = rlist_pop_front(& curproc->children_list);
+    seq_write_begin(&child->pcb->info_seq);
     child->pcb->parent = initpcb;
+    seq_write_end(&child->pcb->info_seq);
     rlist_push_front(& initpcb->children_list, child);
   }
 
@@ -210,7 +223,9 @@ void sys_ThreadExit(int exitval)
   curproc->main_thread = NULL;
 
   /* Now, mark the process as exited. */
+  seq_write_begin(&curproc->info_seq);
   curproc->pstate = ZOMBIE;
+  seq_write_end(&curproc->info_seq);
 
   }
 
@@ -226,6 +241,12 @@ PTCB * spawn_ptcb(Task task, int argl, void* args){
   PTCB* ptcb = (PTCB*)xmalloc(PROCESS_THREAD_PTCB_SIZE);
   assert(ptcb!=NULL);
 
+  //charge the thread's memory to the process
+  if(! kmem_charge(CURPROC, &ptcb->kmem, THREAD_KMEM_SIZE)) {
+    free(ptcb);
+    return NULL;
+  }
+
   ptcb->ref_count=0;
 
   rlnode_init(&ptcb->thread_list_node, ptcb); /* Intrusive list node */
@@ -268,11 +289,117 @@ void start_new_thread()
 //This function frees the given ptcb and decreases the thread count of the current process.
 void release_PTCB(PTCB* ptcb)
 {
+  kmem_uncharge(&ptcb->kmem);
   free(ptcb);
 
-   CURPROC->thread_count--;
+  seq_write_begin(&CURPROC->info_seq);
+  CURPROC->thread_count--;
+  seq_write_end(&CURPROC->info_seq);
  
 
 return;
 
 }
+
+
+
+/*
+ *
+ * Thread-local storage
+ *
+ */
+
+/* 
+  Destructors may set new values, so they are run repeatedly, 
+  up to this many rounds.
+ */
+#define TLS_DESTRUCTOR_ROUNDS 4
+
+TlsKey_t sys_TlsKeyCreate(void (*destructor)(void*))
+{
+  tls_key* keys = CURPROC->tls_keys;
+  for(TlsKey_t k=0; k<MAX_TLS_KEYS; k++) {
+    if(! keys[k].in_use) {
+      keys[k].gen++;
+      keys[k].destructor = destructor;
+      keys[k].in_use = 1;
+      return k;
+    }
+  }
+  return NOKEY;
+}
+
+
+int sys_TlsKeyDelete(TlsKey_t key)
+{
+  if(key<0 || key>=MAX_TLS_KEYS || !CURPROC->tls_keys[key].in_use)
+    return -1;
+
+  tls_key* k = & CURPROC->tls_keys[key];
+  k->in_use = 0;
+  k->gen++;
+  k->destructor = NULL;
+  return 0;
+}
+
+
+void run_tls_destructors()
+{
+  TCB* tcb = CURTHREAD;
+  tls_key* keys = tcb->owner_pcb->tls_keys;
+
+  for(int round=0; round < TLS_DESTRUCTOR_ROUNDS; round++) {
+    int called = 0;
+    for(int k=0; k<MAX_TLS_KEYS; k++) {
+      tls_slot* slot = & tcb->tls[k];
+      if(keys[k].in_use && keys[k].destructor != NULL 
+          && slot->gen == keys[k].gen && slot->value != NULL) {
+        void* value = slot->value;
+        void (*destructor)(void*) = keys[k].destructor;
+        slot->value = NULL;
+
+        /* Destructors are user code */
+        kernel_unlock();
+        destructor(value);
+        kernel_lock();
+        called = 1;
+      }
+    }
+    if(! called) break;
+  }
+}
+
+
+/* 
+  The current TCB is looked up with preemption off, since the thread 
+  may move to another core in between.
+ */
+static inline TCB* tls_thread()
+{
+  int preempt = preempt_off;
+  TCB* tcb = CURTHREAD;
+  if(preempt) preempt_on;
+  return tcb;
+}
+
+
+int TlsSet(TlsKey_t key, void* value)
+{
+  if(key<0 || key>=MAX_TLS_KEYS) return -1;
+  TCB* tcb = tls_thread();
+  tls_key* k = & tcb->owner_pcb->tls_keys[key];
+  if(! k->in_use) return -1;
+  tcb->tls[key].value = value;
+  tcb->tls[key].gen = k->gen;
+  return 0;
+}
+
+
+void* TlsGet(TlsKey_t key)
+{
+  if(key<0 || key>=MAX_TLS_KEYS) return NULL;
+  TCB* tcb = tls_thread();
+  tls_key* k = & tcb->owner_pcb->tls_keys[key];
+  tls_slot* slot = & tcb->tls[key];
+  return (k->in_use && slot->gen == k->gen) ? slot->value : NULL;
+}
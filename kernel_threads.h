@@ -23,4 +23,16 @@ void start_new_thread();
 
 void release_PTCB(PTCB* ptcb);
 
+TlsKey_t sys_TlsKeyCreate(void (*destructor)(void*));
+
+int sys_TlsKeyDelete(TlsKey_t key);
+
+/**
+  @brief Run the thread-local storage destructors of the current thread.
+
+  Called by the exit system calls. The kernel lock is released while
+  each destructor runs.
+ */
+void run_tls_destructors();
+
   #endif
\ No newline at end of file
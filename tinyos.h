@@ -36,6 +36,9 @@ typedef int Pid_t;		/* The PID type  */
 */
 typedef unsigned long timeout_t;
 
+/** @brief A timeout that never expires. */
+#define TIMEOUT_INFINITE ((timeout_t)-1)
+
 
 /** @brief The invalid PID */
 #define NOPROC (-1)
@@ -47,8 +50,9 @@ typedef unsigned long timeout_t;
 typedef int Fid_t;  
 
 /** @brief The maximum number of open files per process. 
-   Only values 0 to MAX_FILEID-1 are legal for file descriptors. */
-#define MAX_FILEID 16
+   Only values 0 to MAX_FILEID-1 are legal for file descriptors. 
+   The fid table of a process grows on demand, up to this size. */
+#define MAX_FILEID 4096
 
 /** @brief The invalid file id. */
 #define NOFILE  (-1)
@@ -292,6 +296,58 @@ Pid_t GetPid(void);
  */
 Pid_t GetPPid(void);
 
+
+/**
+  @brief The resources whose use by a process can be limited.
+
+  @see SetLimit
+  @see GetLimit
+ */
+typedef enum {
+  RLIMIT_THREADS,  /**< @brief The maximum number of threads of the process. */
+  RLIMIT_FIDS,     /**< @brief The maximum number of file ids; fids are legal in 0 to limit-1. */
+  RLIMIT_CPU,      /**< @brief The maximum share of cpu time, in percent of one core. */
+  RLIMIT_KMEM,     /**< @brief The maximum number of bytes of kernel memory, used by the
+                      threads, @c Exec arguments, and pipe, socket and datagram buffers 
+                      created by the process. */
+  RLIMIT_MAX       /**< @brief placeholder for the number of limits */
+} rlimit_t;
+
+/** @brief A limit value meaning "unlimited". */
+#define RLIM_INFINITY ((unsigned long)-1)
+
+/**
+  @brief Lower a resource limit of the current process.
+
+  Resource limits are inherited by the children of a process, at the time
+  of @c Exec. A process can only lower its limits; therefore, the limits
+  of a process bound the limits of all of its future descendants.
+
+  When a limit is exceeded, the system call that requested the resource fails
+  gracefully: @c CreateThread returns @c NOTHREAD, calls that create file ids 
+  return @c NOFILE, and @c Exec returns @c NOPROC. The cpu share limit is 
+  enforced by the scheduler, which throttles the threads of a process that has
+  exhausted its share of the current scheduling period.
+
+  @param res the resource to limit
+  @param value the new limit
+  @returns 0 on success and -1 on error. Possible errors are:
+    - @c res is not a legal resource
+    - @c value is larger than the current limit
+    - @c value is not legal for the resource (e.g., a cpu share of 0)
+  @see GetLimit
+ */
+int SetLimit(rlimit_t res, unsigned long value);
+
+/**
+  @brief Return a resource limit of the current process.
+
+  @param res the resource whose limit is returned
+  @returns the limit, or 0 if @c res is not a legal resource. 
+  @see SetLimit
+ */
+unsigned long GetLimit(rlimit_t res);
+
 /*******************************************
  *
  * Threads
@@ -376,6 +432,58 @@ int ThreadDetach(Tid_t tid);
 void ThreadExit(int exitval);
 
 
+/** @brief A key for thread-local storage. 
+  @see TlsKeyCreate
+ */
+typedef int TlsKey_t;
+
+/** @brief The maximum number of thread-local storage keys of a process. */
+#define MAX_TLS_KEYS 32
+
+/** @brief The invalid thread-local storage key. */
+#define NOKEY (-1)
+
+/**
+  @brief Create a thread-local storage key.
+
+  The key is valid in all the threads of the current process. Each thread
+  can associate its own value with the key, using @c TlsSet(). Initially,
+  the value of a new key is @c NULL in all threads.
+
+  When a thread exits, the destructor of each key (if not @c NULL) is called
+  with the thread's value for that key, if it is not @c NULL. Destructors run 
+  in the context of the exiting thread.
+
+  @param destructor the destructor for the key, or @c NULL
+  @returns a new key, or NOKEY if the keys of the process are exhausted.
+  */
+TlsKey_t TlsKeyCreate(void (*destructor)(void*));
+
+/**
+  @brief Delete a thread-local storage key.
+
+  The values of the key are not destroyed. 
+  @returns 0 on success and -1 if @c key is not a valid key.
+  */
+int TlsKeyDelete(TlsKey_t key);
+
+/**
+  @brief Set the value of a thread-local storage key for the current thread.
+
+  This call does not enter the kernel and takes no locks.
+  @returns 0 on success and -1 if @c key is not a valid key.
+  */
+int TlsSet(TlsKey_t key, void* value);
+
+/**
+  @brief Get the value of a thread-local storage key for the current thread.
+
+  This call does not enter the kernel and takes no locks.
+  @returns the value of the key, or @c NULL if @c key is not a valid key.
+  */
+void* TlsGet(TlsKey_t key);
+
+
 
 /*******************************************
  *
@@ -425,6 +533,9 @@ Fid_t OpenNull();
    of bytes copied into @c buf, or @c -1 on error. The call may return fewer 
    bytes than @c size, but at least 1. A value of 0 indicates "end of file".
 
+   If the stream is in non-blocking mode (see @c SetFidFlags) and no data
+   is available, the call returns @c IO_WOULDBLOCK instead of blocking.
+
   @param fd  the file ID of the stream to read from
   @param buf pointer to a byte buffer to receive the read data
   @param size maximum size of @c buf
@@ -459,6 +570,193 @@ int Read(Fid_t fd, char *buf, unsigned int size);
 int Write(Fid_t fd, const char* buf, unsigned int size);
 
 
+/** @brief A segment of a scatter/gather list.
+  @see ReadV
+  @see WriteV
+ */
+typedef struct iovec_t
+{
+  void* base;         /**< @brief The start of the segment */
+  unsigned int len;   /**< @brief The length of the segment */
+} iovec_t;
+
+/** @brief The maximum number of segments in a scatter/gather list. */
+#define MAX_IOVEC 64
+
+
+/** @brief Read bytes from a stream into many buffers.
+
+  This call is equivalent to a @c Read() into a single buffer, whose
+  contents are then scattered into the @c iovcnt segments of @c iov, in 
+  order. The call may return fewer bytes than the total length of the
+  segments, but at least 1, unless the end of file was reached.
+
+  @param fd the file ID of the stream to read from
+  @param iov an array of segments 
+  @param iovcnt the number of segments, at most @c MAX_IOVEC
+  @return the number of bytes copied, 0 if we have reached EOF, or -1 on error.
+    Possible errors are:
+    - The file descriptor is invalid.
+    - The segment list is invalid, or its total length exceeds 2GB.
+    - There was a I/O runtime problem.
+  @see iovec_t
+ */
+int ReadV(Fid_t fd, const iovec_t* iov, unsigned int iovcnt);
+
+
+/** @brief Write bytes to a stream from many buffers.
+
+  This call is equivalent to a @c Write() of the concatenation of the 
+  @c iovcnt segments of @c iov, done in a single system call.
+
+  @param fd the file ID of the stream to write to
+  @param iov an array of segments 
+  @param iovcnt the number of segments, at most @c MAX_IOVEC
+  @return the number of bytes copied, or -1 on error.
+    Possible errors are:
+    - The file descriptor is invalid.
+    - The segment list is invalid, or its total length exceeds 2GB.
+    - There was a I/O runtime problem.
+  @see iovec_t
+ */
+int WriteV(Fid_t fd, const iovec_t* iov, unsigned int iovcnt);
+
+
+/** @brief Returned by I/O calls on a non-blocking stream, which would have blocked. 
+  @see SetFidFlags
+ */
+#define IO_WOULDBLOCK (-2)
+
+/** @brief Returned by timed I/O calls, whose timeout expired. 
+  @see ReadTimed
+ */
+#define IO_TIMEDOUT (-3)
+
+/** @brief The flags of a stream.
+  @see SetFidFlags
+ */
+enum {
+  FID_NONBLOCK = 1    /**< @brief Reads and writes return @c IO_WOULDBLOCK instead of blocking */
+};
+
+
+/** @brief Set the flags of a stream.
+
+  The flags are a combination of the @c FID_ constants. They belong to the 
+  stream, therefore they are shared by all the file ids of the stream
+  (e.g., those created by @c Dup2()).
+
+  When a stream is non-blocking (flag @c FID_NONBLOCK), @c Read(), @c Write(),
+  their vectored and timed variants, and @c Splice() (for either stream)
+  return @c IO_WOULDBLOCK if they would block before transferring any bytes.
+
+  @param fd the file id of the stream
+  @param flags the new flags
+  @return 0 on success, or -1 on error.
+    Possible errors are:
+    - The file id is invalid.
+    - The flags are invalid.
+ */
+int SetFidFlags(Fid_t fd, unsigned int flags);
+
+
+/** @brief Return the flags of a stream, or -1 if the file id is invalid. 
+  @see SetFidFlags
+  */
+int GetFidFlags(Fid_t fd);
+
+
+/** @brief Read bytes from a stream, with a timeout.
+
+  This call is like @c Read(), but it blocks for at most @c timeout msec 
+  waiting for data. If the timeout expires before any bytes are read, it
+  returns @c IO_TIMEDOUT. A timeout of 0 never blocks.
+
+  @param fd the file ID of the stream to read from
+  @param buf pointer to a byte buffer to receive the read data
+  @param size maximum size of @c buf
+  @param timeout the timeout in msec, or @c TIMEOUT_INFINITE
+  @return the number of bytes copied, 0 if we have reached EOF, 
+    @c IO_TIMEDOUT, @c IO_WOULDBLOCK, or -1 on error (as for @c Read()).
+ */
+int ReadTimed(Fid_t fd, char *buf, unsigned int size, timeout_t timeout);
+
+
+/** @brief Write bytes to a stream, with a timeout.
+
+  This call is like @c Write(), but it blocks for at most @c timeout msec.
+  If the timeout expires before any bytes are written, it returns 
+  @c IO_TIMEDOUT.
+
+  @param fd the file ID of the stream to write to
+  @param buf pointer to the bytes to write
+  @param size the number of bytes to write
+  @param timeout the timeout in msec, or @c TIMEOUT_INFINITE
+  @return the number of bytes copied, @c IO_TIMEDOUT, @c IO_WOULDBLOCK,
+    or -1 on error (as for @c Write()).
+ */
+int WriteTimed(Fid_t fd, const char* buf, unsigned int size, timeout_t timeout);
+
+
+/** @brief Read at least a number of bytes from a stream.
+
+  This call is like @c ReadTimed(), but it returns only when at least 
+  @c min bytes have been read, or the stream reaches EOF, or the timeout
+  expires, or the stream would block. In the last three cases, it returns
+  the bytes read so far, if any.
+
+  Streams that support it (e.g., pipes) wait until enough data are 
+  available, and return them in one copy. Otherwise, the stream is read 
+  repeatedly.
+
+  @param fd the file ID of the stream to read from
+  @param buf pointer to a byte buffer to receive the read data
+  @param size maximum size of @c buf
+  @param min the least number of bytes to read, at most @c size
+  @param timeout the timeout in msec, or @c TIMEOUT_INFINITE
+  @return the number of bytes copied, 0 if we have reached EOF, 
+    @c IO_TIMEDOUT, @c IO_WOULDBLOCK, or -1 on error (as for @c Read()).
+    It is also an error if @c min is larger than @c size.
+ */
+int ReadAtLeast(Fid_t fd, char *buf, unsigned int size, unsigned int min, timeout_t timeout);
+
+
+/** @brief Move bytes from one stream to another.
+
+  This call reads up to @c len bytes from stream @c from and writes them
+  to stream @c to, without copying them to user space. It blocks like a
+  @c Read() on @c from, until some bytes are available, and then like a
+  @c Write() on @c to. 
+
+  When the source stream supports it, the bytes are passed to the 
+  destination directly from the kernel buffers of the source, and only 
+  the bytes accepted by the destination are consumed. Otherwise, they are
+  copied through an internal buffer, and at most @c SPLICE_BUFFER_SIZE 
+  bytes are moved per call. Bytes taken from the source are then always
+  written, so the call may block on the destination after it has read
+  them, even if a stream is non-blocking.
+
+  If either stream is non-blocking, the call returns @c IO_WOULDBLOCK 
+  instead of blocking before it moves any bytes.
+
+  @param from the file ID of the stream to read from
+  @param to the file ID of the stream to write to
+  @param len the maximum number of bytes to move
+  @return the number of bytes moved, 0 if @c from reached EOF, 
+    @c IO_WOULDBLOCK, or -1 on error.
+    Possible errors are:
+    - A file descriptor is invalid.
+    - The length exceeds 2GB.
+    - The destination stream is broken (e.g., a pipe without a reader).
+    - There was a I/O runtime problem.
+ */
+int Splice(Fid_t from, Fid_t to, unsigned int len);
+
+/** @brief The maximum number of bytes moved by a @c Splice() through an
+  internal buffer. */
+#define SPLICE_BUFFER_SIZE 4096
+
+
 /** @brief Close a file id.
    
 
@@ -490,6 +788,135 @@ int Close(Fid_t fd);
  */
 int Dup2(Fid_t oldfd, Fid_t newfd);
 
+
+/** @brief Readiness events for @c Poll().
+
+  These flags are combined in the @c events and @c revents fields of
+  a @c pollfd_t. 
+  @see Poll
+ */
+enum {
+  POLL_READ    = 1,   /**< @brief A @c Read() will not block */
+  POLL_WRITE   = 2,   /**< @brief A @c Write() will not block */
+  POLL_ERROR   = 4,   /**< @brief An error condition (always reported) */
+  POLL_HANGUP  = 8,   /**< @brief The peer has closed the stream (always reported) */
+  POLL_INVALID = 16   /**< @brief The file id is not open (always reported) */
+};
+
+/** @brief A file id and the events to wait for on it.
+  @see Poll
+ */
+typedef struct pollfd_t
+{
+  Fid_t fid;                /**< @brief The file id, a negative value is ignored */
+  unsigned short events;    /**< @brief The requested events */
+  unsigned short revents;   /**< @brief The returned events */
+} pollfd_t;
+
+/** @brief The maximum number of file ids passed to @c Poll(). */
+#define MAX_POLLFD MAX_FILEID
+
+
+/** @brief Wait until one of many streams is ready for I/O.
+
+  For each of the @c n elements of @c fds, this call checks whether
+  the stream is ready for the requested @c events and stores the ready 
+  events into @c revents. The events @c POLL_ERROR, @c POLL_HANGUP and 
+  @c POLL_INVALID are always reported. If no stream is ready, the calling
+  thread blocks until one becomes ready, or the timeout expires.
+
+  A stream is ready for @c POLL_READ if a @c Read() will not block, and for
+  @c POLL_WRITE if a @c Write() will not block. Streams that cannot tell are
+  always ready.
+
+  @param fds an array of @c n records
+  @param n the number of records, at most @c MAX_POLLFD
+  @param timeout the maximum time to wait in msec, 0 to return immediately,
+    or @c TIMEOUT_INFINITE to wait for ever
+  @return the number of records with a non-zero @c revents, 0 if the 
+    timeout expired, or -1 on error. 
+    Possible errors are:
+    - The array of records is invalid.
+ */
+int Poll(pollfd_t* fds, unsigned int n, timeout_t timeout);
+
+
+/** @brief Operations for @c EventQueueCtl().
+  @see EventQueueCtl
+ */
+typedef enum {
+  EVQ_ADD = 1,    /**< @brief Register a stream */
+  EVQ_MOD = 2,    /**< @brief Change the events of a registered stream */
+  EVQ_DEL = 3     /**< @brief Unregister a stream */
+} evq_op;
+
+
+/** @brief Create an event queue.
+
+  An event queue holds a set of streams, and returns those which have 
+  become ready for I/O. Unlike @c Poll(), the streams are registered once, 
+  with @c EventQueueCtl(), and the cost of @c EventQueueWait() depends only
+  on the number of streams that are ready.
+
+  The event queue is itself a stream, which can be passed to @c Poll() 
+  (it is ready for @c POLL_READ when some events are pending) and must be
+  closed with @c Close(). It cannot be registered on an event queue.
+
+  @return a file id for the new event queue, or @c NOFILE on error.
+    Possible errors are:
+    - The maximum number of file ids for the process has been reached.
+ */
+Fid_t EventQueueCreate();
+
+
+/** @brief Change the set of streams of an event queue.
+
+  With @c EVQ_ADD, stream @c fid is registered for @c events (a combination
+  of @c POLL_READ and @c POLL_WRITE). With @c EVQ_MOD, the events of a 
+  registered stream are changed, and with @c EVQ_DEL it is unregistered.
+
+  A stream is unregistered automatically when it is closed by all of its 
+  file ids.
+
+  @param evq the event queue
+  @param op the operation
+  @param fid the stream to register, change or unregister
+  @param events the events of interest
+  @return 0 on success, or -1 on error.
+    Possible errors are:
+    - @c evq is not an event queue.
+    - @c fid is not an open file id, or is an event queue.
+    - For @c EVQ_ADD, @c fid is already registered; for @c EVQ_MOD and 
+      @c EVQ_DEL, @c fid is not registered.
+ */
+int EventQueueCtl(Fid_t evq, evq_op op, Fid_t fid, unsigned int events);
+
+
+/** @brief Wait for events on an event queue.
+
+  This call returns up to @c max records for streams that have become
+  ready since the previous call. The events are edge-triggered: a stream
+  is returned again only after it is notified again, for example after
+  more data arrives. Therefore, a program should read from a stream until
+  no more data is available, before waiting again.
+
+  In each record, @c fid is the registered stream, @c events are the 
+  events of interest and @c revents the ready events. If no stream is 
+  ready, the call blocks until one becomes ready, or the timeout expires.
+
+  @param evq the event queue
+  @param events an array of at least @c max records
+  @param max the maximum number of records returned, at most @c MAX_POLLFD
+  @param timeout the maximum time to wait in msec, 0 to return immediately,
+    or @c TIMEOUT_INFINITE to wait for ever
+  @return the number of records returned, 0 if the timeout expired, or -1 
+    on error.
+    Possible errors are:
+    - @c evq is not an event queue.
+    - The array of records is invalid.
+ */
+int EventQueueWait(Fid_t evq, pollfd_t* events, unsigned int max, timeout_t timeout);
+
 /*******************************************
  *
  * Pipes
@@ -529,9 +956,123 @@ typedef struct pipe_s {
 	@param pipe a pointer to a pipe_t structure for storing the file ids.
 	@returns 0 on success, or -1 on error. Possible reasons for error:
 		- the available file ids for the process are exhausted.
+		- the buffer would exceed the @c RLIMIT_KMEM limit of the process.
 */
 int Pipe(pipe_t* pipe);
 
+
+/** @brief The capacity of a pipe created by @c Pipe(). */
+#define PIPE_DEFAULT_SIZE 8192
+
+/** @brief The smallest pipe capacity. */
+#define PIPE_MIN_SIZE 4096
+
+/** @brief The largest pipe capacity. */
+#define PIPE_MAX_SIZE (16u<<20)
+
+/** @brief The total capacity of all the pipes in the system. 
+
+	Pipes of the default capacity can always be created, but the 
+	capacity of a pipe cannot be increased past this limit.
+  */
+#define PIPE_MEMORY_LIMIT (64u<<20)
+
+
+/** @brief Flags for @c PipeEx(). */
+enum {
+	PIPE_PACKET = 1   /**< @brief Preserve the boundaries of writes */
+};
+
+
+/**
+	@brief Construct a pipe with a given capacity and mode.
+
+	This is the same as @c Pipe(), except that the capacity of the pipe
+	is @c size bytes, rounded up to a power of 2 and to at least
+	@c PIPE_MIN_SIZE. A size of 0 selects @c PIPE_DEFAULT_SIZE.
+
+	Large buffers are committed lazily, as they are filled.
+
+	If @c flags contains @c PIPE_PACKET, the pipe carries messages:
+	each @c Write() is stored as one message, atomically, or not at all,
+	and each @c Read() returns exactly one message. If the buffer of the
+	reader is too small, the rest of the message is discarded. A message 
+	takes 4 bytes of the capacity in addition to its length, and it must
+	fit in the pipe. Empty messages are not sent. Watermarks do not apply 
+	to packet pipes, and @c ReadAtLeast() may join several messages.
+
+	@param pipe a pointer to a pipe_t structure for storing the file ids.
+	@param size the requested capacity.
+	@param flags 0 or @c PIPE_PACKET.
+	@returns 0 on success, or -1 on error. Possible reasons for error:
+		- the available file ids for the process are exhausted.
+		- @c size is larger than @c PIPE_MAX_SIZE.
+		- the capacity would exceed @c PIPE_MEMORY_LIMIT.
+		- the capacity would exceed the @c RLIMIT_KMEM limit of the process.
+		- @c flags is not valid.
+	@see PipeSetSize
+*/
+int PipeEx(pipe_t* pipe, unsigned int size, unsigned int flags);
+
+
+/**
+	@brief Change the capacity of a pipe.
+
+	The new capacity is rounded as in @c PipeEx(). It may be given through
+	either end of the pipe, and it must be enough for the data currently 
+	in the pipe.
+
+	@param fid either end of a pipe.
+	@param size the requested capacity.
+	@returns 0 on success, or -1 on error. Possible reasons for error:
+		- @c fid is not an end of a pipe.
+		- @c size is larger than @c PIPE_MAX_SIZE.
+		- the pipe holds more data than the new capacity.
+		- the capacity would exceed @c PIPE_MEMORY_LIMIT.
+		- the capacity would exceed the @c RLIMIT_KMEM limit of the process.
+*/
+int PipeSetSize(Fid_t fid, unsigned int size);
+
+
+/**
+	@brief Return the capacity of a pipe.
+
+	@param fid either end of a pipe.
+	@returns the capacity in bytes, or -1 if @c fid is not an end of a pipe.
+*/
+int PipeGetSize(Fid_t fid);
+
+
+/**
+	@brief Set the wakeup watermarks of a pipe or a connected socket.
+
+	By default, a blocked reader is woken up as soon as there are data in
+	the pipe, and a blocked writer as soon as there is space. For bulk 
+	transfers this makes the two ends switch for every small chunk. 
+
+	With watermarks, a blocked reader is woken up only when at least 
+	@c read_lowat bytes are in the pipe (or the write end is closed), and
+	a blocked writer only when at least @c write_lowat bytes are free. 
+	Readiness reported by @c Poll() follows the same thresholds. A read 
+	asking for fewer bytes waits for as many as it asks for. The watermarks
+	are capped at the capacity of the pipe.
+
+	A non-blocking or timed call that cannot wait transfers what it can, 
+	if anything.
+
+	On a connected socket, the reader watermark applies to the data coming
+	in, and the writer watermark to the data going out.
+
+	@param fid either end of a pipe, or a connected socket.
+	@param read_lowat the reader watermark, at least 1.
+	@param write_lowat the writer watermark, at least 1.
+	@returns 0 on success, or -1 on error. Possible reasons for error:
+		- @c fid is not an end of a pipe or a connected socket.
+		- the pipe is a packet pipe, or the socket carries messages.
+		- a watermark is 0.
+*/
+int SetWatermarks(Fid_t fid, unsigned int read_lowat, unsigned int write_lowat);
+
 /*******************************************
  *
  * Sockets (local)
@@ -582,7 +1123,8 @@ Fid_t Socket(port_t port);
 
 	The socket must be bound to a port, as a result of calling @c Socket.
 	On each port there must be a unique listening socket (although any number
-	of non-listening sockets are allowed).
+	of non-listening sockets are allowed), unless the port is shared by 
+	@c ListenEx().
 
 	@param sock the socket to initialize as a listening socket
 	@returns 0 on success, -1 on error. Possible reasons for error:
@@ -595,6 +1137,49 @@ Fid_t Socket(port_t port);
 int Listen(Fid_t sock);
 
 
+/** @brief The largest number of listeners that may share a port. */
+#define MAX_PORT_LISTENERS 32
+
+/** @brief Flags for @c ListenEx(). */
+enum {
+	LISTEN_REUSEPORT = 1,  /**< @brief Share the port with other listeners */
+	LISTEN_BYCORE = 2,     /**< @brief Pick the listener by the core of the connecting thread */
+	LISTEN_PACKET = 4      /**< @brief The connections carry messages, as a @c PIPE_PACKET pipe */
+};
+
+/**
+	@brief Initialize a socket as a listening socket, possibly sharing its port.
+
+	With @c flags equal to 0, this is the same as @c Listen(). With
+	@c LISTEN_REUSEPORT, up to @c MAX_PORT_LISTENERS sockets can listen on
+	the same port, as long as they all pass the same flags. Each listener 
+	has its own queue of connection requests, and each @c Connect() to the
+	port is queued on one of them: in turn, or, if @c LISTEN_BYCORE is
+	also given, by the core that the connecting thread runs on. Thus,
+	a thread accepting on each listener handles a share of the connections,
+	without contending with the others.
+
+	When a listener is closed, the requests queued on it are refused.
+
+	If @c flags contains @c LISTEN_PACKET, the connections accepted by the 
+	listener keep the boundaries of writes in both directions, as in a
+	pipe created with @c PIPE_PACKET: each @c Write() (or @c WriteV()) is 
+	one message, and each @c Read() returns one message. Then, a message 
+	longer than the buffer of the connection cannot be sent, and
+	@c SetWatermarks() does not apply.
+
+	@param sock the socket to initialize as a listening socket
+	@param flags 0, @c LISTEN_REUSEPORT, or @c LISTEN_REUSEPORT|LISTEN_BYCORE,
+		possibly with @c LISTEN_PACKET
+	@returns 0 on success, -1 on error. Possible reasons for error are
+		those of @c Listen(), and also:
+		- @c flags is not valid.
+		- the port is full, or its listeners were given different flags.
+	@see Listen
+ */
+int ListenEx(Fid_t sock, unsigned int flags);
+
+
 /**
 	@brief Wait for a connection.
 
@@ -614,6 +1199,8 @@ int Listen(Fid_t sock);
 		- the file id is not initialized by @c Listen()
 		- the available file ids for the process are exhausted
 		- while waiting, the listening socket @c lsock was closed
+		- the buffers of the connection would exceed the @c RLIMIT_KMEM 
+		  limit of the process; the request is refused
 
 	@see Connect
 	@see Listen
@@ -621,6 +1208,25 @@ int Listen(Fid_t sock);
 Fid_t Accept(Fid_t lsock);
 
 
+/**
+	@brief Accept a batch of connections.
+
+	This is like @c Accept(), except that it takes all the connection
+	requests pending on the listener, up to @c max, in one call. It blocks
+	only if there are none.
+
+	@param lsock the listening socket
+	@param fids an array of @c max file ids, where the new sockets are stored
+	@param max the size of @c fids, at least 1
+	@returns the number of new sockets on success, or a negative value on 
+		error. Possible reasons for error are those of @c Accept(), and
+		also @c max being 0. If the listener is non-blocking and there are
+		no requests, @c IO_WOULDBLOCK is returned.
+	@see Accept
+ */
+int AcceptMany(Fid_t lsock, Fid_t* fids, unsigned int max);
+
+
 
 /**
 	@brief Create a connection to a listener at a specific port.
@@ -637,6 +1243,14 @@ Fid_t Accept(Fid_t lsock);
 	in the order of 100's of msec. Therefore, a timeout of at least 500 msec is
 	reasonable. If a negative timeout is given, it means, "infinite timeout".
 
+	If @c sock is non-blocking (flag @c FID_NONBLOCK, see @c SetFidFlags),
+	the request is queued at the listener and @c IO_WOULDBLOCK is returned.
+	The socket then reports @c POLL_WRITE when it is connected, or @c POLL_ERROR when
+	the request is refused; calling @c Connect() again returns the outcome,
+	or @c IO_WOULDBLOCK while the request is still pending. The timeout
+	counts from the first call, and the @c port of later calls is ignored.
+	Only one thread at a time may wait on the request of a socket.
+
 	@params sock the socket to connect to the other end
 	@params port the port on which to seek a listening socket
 	@params timeout the approximate amount of time to wait for a
@@ -646,6 +1260,7 @@ Fid_t Accept(Fid_t lsock);
 	   - the given port is illegal.
 	   - the port does not have a listening socket bound to it by @c Listen.
 	   - the timeout has expired without a successful connection.
+	   - another thread is already connecting @c sock.
 */
 int Connect(Fid_t sock, port_t port, timeout_t timeout);
 
@@ -685,6 +1300,14 @@ typedef enum {
    After shutdown of socket A, the corresponding operation `Read(A,...)` or `Write(A,...)`
    will return -1.
 
+   The shutdown takes effect at once. Threads blocked in `Read(A,...)` or
+   `Write(A,...)` in the direction shut down, and threads blocked in 
+   `Write(B,...)` after `SHUTDOWN_READ`, are woken up and fail with -1. 
+   The data that A has not read are dropped.
+
+   Closing a socket is the same as `SHUTDOWN_BOTH`, and it does not wait
+   for the peer to read the data already written (there is no lingering).
+
    Shutting down multiple times is not an error.
    
    @param sock the file ID of the socket to shut down.
@@ -695,6 +1318,259 @@ typedef enum {
 int ShutDown(Fid_t sock, shutdown_mode how);
 
 
+/** @brief The largest datagram. */
+#define DGRAM_MAX_SIZE 8192
+
+/** @brief The default capacity of the queue of a datagram socket, in bytes. */
+#define DGRAM_QUEUE_SIZE (64u<<10)
+
+/** @brief The largest capacity of the queue of a datagram socket, in bytes. */
+#define DGRAM_QUEUE_MAX (16u<<20)
+
+/** @brief What happens to a datagram sent to a full queue. 
+	@see DgramSetQueue
+ */
+enum {
+	DGRAM_BACKPRESSURE = 0,  /**< @brief The sender waits for space */
+	DGRAM_DROP = 1           /**< @brief The datagram is dropped */
+};
+
+
+/**
+	@brief Return a new datagram socket, bound on a port.
+
+	A datagram socket sends and receives messages without a connection.
+	Each message is delivered whole, or not at all, to the socket bound 
+	on the destination port, where it is queued until it is received. The
+	queue holds up to @c DGRAM_QUEUE_SIZE bytes of messages.
+
+	There may be only one datagram socket bound on each port. Datagram
+	ports are separate from the ports of stream sockets. A datagram socket
+	with port @c NOPORT can only send.
+
+	@c Read() on a datagram socket is the same as @c RecvFrom() without a
+	port, and @c Write() is an error.
+
+	@param port the port of the new socket, or @c NOPORT.
+	@returns a file id for the new socket, or NOFILE on error. Possible
+		reasons for error:
+		- the port is illegal.
+		- the port is taken by another datagram socket.
+		- the available file ids for the process are exhausted.
+		- the queue would exceed the @c RLIMIT_KMEM limit of the process.
+*/
+Fid_t SocketDgram(port_t port);
+
+/**
+	@brief Send a datagram to a port.
+
+	If the queue of the destination is full, the sender waits for space,
+	or, if the stream is non-blocking, @c IO_WOULDBLOCK is returned. If
+	the destination drops datagrams, a datagram that does not fit is
+	discarded, and the call succeeds anyway.
+
+	@param sock a datagram socket.
+	@param port the destination port.
+	@param buf the message.
+	@param len the length of the message, at most @c DGRAM_MAX_SIZE.
+	@returns @c len on success, or a negative value on error. Possible
+		reasons for error:
+		- @c sock is not a datagram socket.
+		- @c len is too large.
+		- no datagram socket is bound on @c port, or it was closed
+		  while we were waiting.
+*/
+int SendTo(Fid_t sock, port_t port, const void* buf, unsigned int len);
+
+/**
+	@brief Receive a datagram.
+
+	Wait until a datagram is queued on the socket, and return it. If the
+	buffer is too small, the rest of the datagram is discarded. If the
+	stream is non-blocking and there is no datagram, @c IO_WOULDBLOCK
+	is returned.
+
+	As with @c Read(), if another thread closes @c sock while this call
+	waits, the socket stays bound until the call returns.
+
+	@param sock a datagram socket bound on a port.
+	@param port if not NULL, the port of the sender is stored here.
+	@param buf the buffer for the message.
+	@param len the size of @c buf.
+	@returns the number of bytes stored in @c buf, or a negative value on
+		error. 
+*/
+int RecvFrom(Fid_t sock, port_t* port, void* buf, unsigned int len);
+
+/**
+	@brief Set the queue capacity and the policy of a datagram socket.
+
+	@param sock a datagram socket bound on a port.
+	@param size the capacity in bytes, 0 for @c DGRAM_QUEUE_SIZE. It must
+		be at least @c DGRAM_MAX_SIZE, and at most @c DGRAM_QUEUE_MAX.
+	@param policy @c DGRAM_BACKPRESSURE or @c DGRAM_DROP.
+	@returns the number of datagrams dropped so far on success, or -1 on error.
+		It is an error if the queue would exceed the @c RLIMIT_KMEM limit
+		of the process.
+*/
+int DgramSetQueue(Fid_t sock, unsigned int size, unsigned int policy);
+
+
+/**
+	@brief Listen for connections from the host.
+
+	This creates a Unix-domain stream socket in the host file system, at
+	@c path, for programs outside tinyos to connect to. A stale socket at
+	@c path is replaced. The path is removed when the listener is closed.
+	
+	The returned stream can only be passed to @c HostAccept() and @c Poll(),
+	and closed. It is readable when a connection is pending.
+
+	@param path the path of the socket in the host.
+	@returns a file id for the listener, or NOFILE on error. Possible
+		reasons for error:
+		- the path is too long, or it cannot be bound.
+		- all host sockets are in use (see @c MAX_HOST_SOCKETS).
+		- the available file ids for the process are exhausted.
+	@see HostAccept
+*/
+Fid_t HostListen(const char* path);
+
+/**
+	@brief Wait for a connection from the host.
+
+	The returned stream supports @c Read(), @c Write(), @c Poll() and
+	@c Close(). 
+	A read returns 0 when the host program has closed the connection, and 
+	a write fails once it is gone. Streams of this kind are usually bridged
+	to tinyos sockets (e.g., see the @c hostbridge command of the shell).
+
+	If the listener is non-blocking and there is no connection, 
+	@c IO_WOULDBLOCK is returned.
+
+	@param lsock a listener returned by @c HostListen().
+	@returns a file id for the connection, or NOFILE on error. Possible
+		reasons for error:
+		- @c lsock is not a host listener.
+		- the available file ids for the process are exhausted.
+	@see HostListen
+*/
+Fid_t HostAccept(Fid_t lsock);
+
+
+
+/*******************************************
+ *
+ * Asynchronous I/O
+ *
+ *******************************************/
+
+/** @brief The operations of asynchronous I/O requests. 
+  @see aio_sqe
+ */
+typedef enum {
+  AIO_READ = 1,   /**< @brief @c Read() into @c buf */
+  AIO_WRITE,      /**< @brief @c Write() from @c buf */
+  AIO_ACCEPT,     /**< @brief @c Accept() on listening socket @c fid */
+  AIO_CONNECT,    /**< @brief @c Connect() socket @c fid to @c port */
+  AIO_CLOSE       /**< @brief @c Close() file id @c fid */
+} aio_opcode;
+
+
+/** @brief An asynchronous I/O request (submission queue entry).
+  @see AioSubmit
+ */
+typedef struct aio_sqe
+{
+  aio_opcode opcode;        /**< @brief The operation */
+  Fid_t fid;                /**< @brief The stream */
+  void* buf;                /**< @brief The buffer, for @c AIO_READ and @c AIO_WRITE */
+  unsigned int len;         /**< @brief The buffer size, for @c AIO_READ and @c AIO_WRITE */
+  port_t port;              /**< @brief The port, for @c AIO_CONNECT */
+  timeout_t timeout;        /**< @brief The timeout, for @c AIO_CONNECT */
+  unsigned long user_data;  /**< @brief Returned with the completion */
+} aio_sqe;
+
+
+/** @brief The completion of an asynchronous I/O request (completion queue entry).
+  @see AioReap
+ */
+typedef struct aio_cqe
+{
+  unsigned long user_data;  /**< @brief The @c user_data of the request */
+  int result;               /**< @brief The return value of the operation */
+} aio_cqe;
+
+
+/** @brief The maximum number of requests of an asynchronous I/O context that
+  are in progress or whose completion has not been reaped. */
+#define MAX_AIO_INFLIGHT 1024
+
+
+/** @brief Create an asynchronous I/O context.
+
+  An asynchronous I/O context lets a thread start many I/O operations
+  with a single call to @c AioSubmit(), and collect their results later 
+  with @c AioReap(), without blocking on any single stream.
+
+  The context is a stream, which must be closed with @c Close(). Closing 
+  it cancels the requests still in progress.
+
+  @return a file id for the new context, or @c NOFILE on error.
+    Possible errors are:
+    - The maximum number of file ids for the process has been reached.
+ */
+Fid_t AioCreate();
+
+
+/** @brief Submit a batch of asynchronous I/O requests.
+
+  The requests are started in order. Each request is first tried without 
+  blocking; if it completes, its completion is queued immediately. 
+  Otherwise it stays in progress, and is completed by a later call to 
+  @c AioReap(), after its stream becomes ready.
+
+  The buffers of @c AIO_READ and @c AIO_WRITE requests must remain valid
+  until the request completes. The streams of requests in progress stay
+  open, even if their file ids are closed.
+
+  @param ctx the asynchronous I/O context
+  @param sqe an array of @c n requests
+  @param n the number of requests
+  @return the number of requests submitted, which is less than @c n if the 
+    context reached @c MAX_AIO_INFLIGHT requests, or -1 on error. 
+    Possible errors are:
+    - @c ctx is not an asynchronous I/O context.
+    - The array of requests is invalid.
+ */
+int AioSubmit(Fid_t ctx, const aio_sqe* sqe, unsigned int n);
+
+
+/** @brief Collect the completions of asynchronous I/O requests.
+
+  This call first makes progress on the requests whose streams have become
+  ready, and then returns up to @c max completions. If fewer than @c min 
+  completions are available, the call blocks until there are @c min 
+  completions or the timeout expires. With @c min equal to 0, the call 
+  never blocks. If @c min is larger than the number of requests in the
+  context, the call waits for all of them.
+
+  The @c result of a completion is the value that the corresponding 
+  system call would have returned.
+
+  @param ctx the asynchronous I/O context
+  @param cqe an array of at least @c max completions
+  @param max the maximum number of completions returned
+  @param min the minimum number of completions to wait for, at most @c max
+  @param timeout the maximum time to wait in msec, or @c TIMEOUT_INFINITE
+  @return the number of completions returned, or -1 on error.
+    Possible errors are:
+    - @c ctx is not an asynchronous I/O context.
+    - The array of completions is invalid, or @c min is larger than @c max.
+ */
+int AioReap(Fid_t ctx, aio_cqe* cqe, unsigned int max, unsigned int min, timeout_t timeout);
+
+
 
 /*******************************************
  *
@@ -707,6 +1583,24 @@ int ShutDown(Fid_t sock, shutdown_mode how);
   */
 #define PROCINFO_MAX_ARGS_SIZE (128)
 
+/**
+	@brief CPU accounting counters.
+
+	These counters are kept by the scheduler for every thread and every
+	process, and are returned as part of a @c procinfo record. Times are
+	in microseconds.
+	@see procinfo
+  */
+typedef struct cpu_stats
+{
+  unsigned long run_time;       /**< @brief Time spent running on some core. */
+  unsigned long wait_time;      /**< @brief Time spent in the ready queue, waiting for a core. */
+  unsigned long vol_switches;   /**< @brief Context switches where the thread gave up the core. */
+  unsigned long invol_switches; /**< @brief Context switches due to an expired quantum. */
+  unsigned long syscalls;       /**< @brief Number of system calls made. */
+} cpu_stats;
+
+
 /**
 	@brief A struct containing process-related information for a non-free
 	pid.
@@ -737,6 +1631,8 @@ typedef struct procinfo
 
     If the task's argument is longer (as designated by the @c argl field), the
     bytes contained in this field are just the prefix.  */
+
+  cpu_stats stats; /**< @brief CPU accounting for all the threads of the process. */
 } procinfo;
 
 
@@ -750,17 +1646,109 @@ typedef struct procinfo
 	Each procinfo structure contains information pertaining to some
 	used PCB (active or zombie) during the time of the stream. 
 
+	A call to @c Read returns as many whole @c procinfo records as fit 
+	in the buffer, so that a full snapshot can be taken with a few calls.
+	A buffer smaller than @c sizeof(procinfo) is an error. 
+	When all processes have been returned, @c Read returns 0.
+
 	There is no guarantee of the timeliness of the information.
 	A best-effort approach to return relevant system information is
-	made. 
+	made. Processes created after the stream was opened may or may
+	not be returned, but no process is returned twice.
 
 	@returns a file id on success, or NOFILE on error. Possible reasons
 		for error are:
 		- the available file ids for the process are exhausted.
+	@see OpenInfoFilter
  */
 Fid_t OpenInfo();
 
 
+/**
+	@brief A filter for the processes returned by an information stream.
+
+	@see OpenInfoFilter
+  */
+typedef struct procinfo_filter
+{
+	int alive_only;   /**< @brief If non-zero, zombie processes are skipped. */
+	Pid_t pid_min;    /**< @brief The smallest pid returned. */
+	Pid_t pid_max;    /**< @brief The largest pid returned. */
+} procinfo_filter;
+
+
+/**
+	@brief Open a kernel information stream for a subset of the processes.
+
+	This is the same as @c OpenInfo(), except that only processes
+	matching @c filter are returned. A @c NULL filter matches all 
+	processes.
+
+	@returns a file id on success, or NOFILE on error. Possible reasons
+		for error are:
+		- the available file ids for the process are exhausted.
+		- the pid range of the filter is empty.
+	@see OpenInfo
+ */
+Fid_t OpenInfoFilter(const procinfo_filter* filter);
+
+
+/**
+	@brief I/O accounting counters.
+
+	These counters are kept for every open stream and, cumulatively, for 
+	every device type. Times are in microseconds.
+	@see OpenIoStats
+  */
+typedef struct io_stats
+{
+  unsigned long reads;          /**< @brief Number of read calls (including vectored and splice). */
+  unsigned long writes;         /**< @brief Number of write calls (including vectored and splice). */
+  unsigned long bytes_read;     /**< @brief Bytes returned by reads. */
+  unsigned long bytes_written;  /**< @brief Bytes accepted by writes. */
+  unsigned long blocked_time;   /**< @brief Time that callers spent blocked in the stream. */
+  unsigned long wakeups;        /**< @brief Number of times a blocked caller was woken up. */
+} io_stats;
+
+/** @brief The size of the device name in an @c iostat_info record. */
+#define IOSTAT_NAME_SIZE 16
+
+/**
+	@brief An I/O statistics record.
+
+	This structure is returned by I/O statistics streams.
+	@see OpenIoStats
+  */
+typedef struct iostat_info
+{
+  Fid_t fid;      /**< @brief The file id of the stream, or @c NOFILE for 
+                      the totals of a device type. */
+  char devname[IOSTAT_NAME_SIZE]; /**< @brief The name of the device type 
+                      (e.g., "serial" or "pipe"). */
+  io_stats stats; /**< @brief The counters. */
+} iostat_info;
+
+
+/**
+	@brief Open an I/O statistics stream.
+
+	This is a read-only stream that returns a sequence of @c iostat_info 
+	records: first one per device type, with the totals since boot, and 
+	then one per open file id of the calling process, with the counters of 
+	the stream since it was opened. The records are taken when the stream 
+	is opened.
+
+	As with @c OpenInfo(), a call to @c Read returns as many whole records
+	as fit in the buffer. A buffer smaller than @c sizeof(iostat_info) is 
+	an error. When all records have been returned, @c Read returns 0.
+
+	@returns a file id on success, or NOFILE on error. Possible reasons
+		for error are:
+		- the available file ids for the process are exhausted.
+ */
+Fid_t OpenIoStats();
+
+
 
 
 /*******************************************
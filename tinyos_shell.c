@@ -21,6 +21,8 @@ int Repeat(size_t,const char**);
 int Hanoi(size_t,const char**);
 int HelpMessage(size_t,const char**);
 int SystemInfo(size_t,const char**);
+int Top(size_t,const char**);
+int IoStat(size_t,const char**);
 int Capitalize(size_t,const char**);
 int LowerCase(size_t,const char**);
 int LineEnum(size_t,const char**);
@@ -31,6 +33,9 @@ int Symposium_thr(size_t,const char**);
 int RemoteServer(size_t,const char**);
 int RemoteClient(size_t,const char**);
 int Echo(size_t,const char**);
+int Cat(size_t,const char**);
+int PipeBench(size_t,const char**);
+int HostBridge(size_t,const char**);
 
 
 struct { const char * cmdname; Program prog; uint nargs; const char* help; } 
@@ -39,6 +44,8 @@ COMMANDS[]  =
 	{"help", HelpMessage, 0, "A help message."},
 	{"ls", ListPrograms, 0, "List available programs programs."},
 	{"sysinfo", SystemInfo, 0, "Print some basic info about the current system."},
+	{"top", Top, 0, "top [<n>] (default: <n>=10). List the <n> processes that used the most cpu time."},
+	{"iostat", IoStat, 0, "Print the I/O counters of each device type and of the open streams."},
 	{"runterm", RunTerm, 2, "runterm <term> <prog>  <args...> : execute '<prog> <args...>' on terminal <term>."},
 	{"sh", Shell, 0, "Run a shell."},
 	{"repeat", Repeat, 2, "repeat <n> <prog> <args...>: execute '<prog> <args...>' <n> times."},
@@ -53,7 +60,10 @@ COMMANDS[]  =
 	{"hanoi", Hanoi, 1, "The towers of Hanoi."},
 	{"rserver", RemoteServer, 0, "A server for remote execution."},
 	{"rcli", RemoteClient, 1, "Remote client: rcli <cmd> [<args...>]."},
+	{"hostbridge", HostBridge, 1, "hostbridge <path> [<port>] (default: the rserver port). Connect host programs on the Unix socket <path> to <port>."},
 	{"echo", Echo, 0, "echo [<args...>], send the <args...> to stdout"},
+	{"cat", Cat, 0, "Copy stdin to stdout."},
+	{"pipebench", PipeBench, 0, "pipebench [<mbytes>] [<chunk>] [<pipe size>] [<lowat>] (default: 100 Mbytes, 32 kbytes, 8 kbytes, 1). Measure pipe throughput between two processes."},
 
 	{NULL, NULL, 0, NULL}
 };
@@ -197,12 +207,106 @@ int SystemInfo(size_t argc, const char** argv)
 				pname
 				);
 		}
+		Close(finfo);
 	}
 	printf("\n");
 	return 0;
 }
 
 
+int IoStat(size_t argc, const char** argv)
+{
+	Fid_t fstat = OpenIoStats();
+	if(fstat==NOFILE) {
+		printf("Cannot open the I/O statistics stream\n");
+		return 1;
+	}
+
+	printf("%5s %8s %8s %8s %10s %10s %10s %8s\n",
+		"FID", "Device", "Reads", "Writes", "Bytes in", "Bytes out", "Blocked ms", "Wakeups");
+	iostat_info info;
+	while(Read(fstat, (char*) &info, sizeof(info)) > 0) {
+		/* Skip the device types that were never used */
+		if(info.fid==NOFILE && info.stats.reads==0 && info.stats.writes==0)
+			continue;
+		char fid[8] = "-";
+		if(info.fid!=NOFILE) snprintf(fid, sizeof(fid), "%d", info.fid);
+		printf("%5s %8s %8lu %8lu %10lu %10lu %10lu %8lu\n",
+			fid, info.devname,
+			info.stats.reads, info.stats.writes,
+			info.stats.bytes_read, info.stats.bytes_written,
+			info.stats.blocked_time/1000, info.stats.wakeups);
+	}
+	Close(fstat);
+	return 0;
+}
+
+
+/* Order procinfo records by decreasing cpu time */
+static int procinfo_cpu_order(const void* a, const void* b)
+{
+	unsigned long ta = ((const procinfo*)a)->stats.run_time;
+	unsigned long tb = ((const procinfo*)b)->stats.run_time;
+	return (ta<tb) - (ta>tb);
+}
+
+int Top(size_t argc, const char** argv)
+{
+	int lines = 10;
+	if(argc>=2) lines = getint(1);
+
+	Fid_t finfo = OpenInfo();
+	if(finfo==NOFILE) {
+		printf("Cannot open the info stream\n");
+		return 1;
+	}
+
+	/* Take a snapshot of the process table */
+	size_t nproc = 0, cap = 16;
+	procinfo* table = malloc(cap*sizeof(procinfo));
+	int rc;
+	while((rc = Read(finfo, (char*) &table[nproc], (cap-nproc)*sizeof(procinfo))) > 0) {
+		nproc += rc / sizeof(procinfo);
+		if(nproc == cap) {
+			cap *= 2;
+			table = realloc(table, cap*sizeof(procinfo));
+		}
+	}
+	Close(finfo);
+
+	qsort(table, nproc, sizeof(procinfo), procinfo_cpu_order);
+
+	printf("%5s %5s %6s %8s %10s %10s %8s %8s %8s %15s\n",
+		"PID", "PPID", "State", "Threads", "CPU(ms)", "Wait(ms)",
+		"Vol.sw", "Inv.sw", "Syscalls", "Main program");
+	for(size_t i=0; i<nproc && i<lines; i++) {
+		procinfo* info = &table[i];
+		const char* argv[10];
+		int argc = ParseProcInfo(info, NULL, 10, argv);
+
+		const char* pname = "-";
+		if(argc>=1)
+			pname = argv[0];
+		else if(info->pid==0)
+			pname = "idle";
+		else if(info->pid==1)
+			pname = "init";
+
+		printf("%5d %5d %6s %8lu %10lu %10lu %8lu %8lu %8lu %15s\n",
+			info->pid, info->ppid,
+			(info->alive?"ALIVE":"ZOMBIE"),
+			info->thread_count,
+			info->stats.run_time/1000, info->stats.wait_time/1000,
+			info->stats.vol_switches, info->stats.invol_switches,
+			info->stats.syscalls,
+			pname);
+	}
+
+	free(table);
+	return 0;
+}
+
+
 int HelpMessage(size_t argc, const char** argv)
 {
 	printf("This is a simple shell for tinyos.\n\
@@ -254,8 +358,8 @@ int Fibonacci(size_t argc, const char** argv)
 int Capitalize(size_t argc, const char** argv)
 {
 	char c;
-	FILE* fin = fidopen(0, "r");
-	FILE* fout = fidopen(1, "w");
+	FILE* fout = fidopenbuf(1, "w", _IOFBF, 0, NULL);
+	FILE* fin = fidopenbuf(0, "r", _IOFBF, 0, fout);
 	while((c=fgetc(fin))!=EOF) {
 		fputc(toupper(c), fout);
 	}
@@ -267,7 +371,7 @@ int Capitalize(size_t argc, const char** argv)
 
 int Echo(size_t argc, const char** argv)
 {
-	FILE* fout = fidopen(1, "w");
+	FILE* fout = fidopenbuf(1, "w", _IOFBF, 0, NULL);
 	for(size_t i=1; i<argc; i++) {
 		if(i>1) fputs(" ", fout);
 		fprintf(fout,"%s", argv[i]);
@@ -278,11 +382,93 @@ int Echo(size_t argc, const char** argv)
 }
 
 
+int Cat(size_t argc, const char** argv)
+{
+	int rc;
+	while((rc = Splice(0, 1, SPLICE_BUFFER_SIZE)) > 0);
+	return rc<0 ? 1 : 0;
+}
+
+
+/* Get the info record of a process */
+static int get_procinfo(Pid_t pid, procinfo* info)
+{
+	procinfo_filter filter = { .alive_only = 0, .pid_min = pid, .pid_max = pid };
+	Fid_t finfo = OpenInfoFilter(&filter);
+	if(finfo==NOFILE) return 0;
+	int rc = Read(finfo, (char*) info, sizeof(procinfo));
+	Close(finfo);
+	return rc == sizeof(procinfo);
+}
+
+
+struct pipebench_args { Fid_t fid; unsigned int chunk; unsigned long nbytes; };
+
+/* The producer of pipebench: write nbytes to a pipe, in chunks */
+static int pipebench_producer(int argl, void* args)
+{
+	struct pipebench_args* a = args;
+	char* buffer = calloc(a->chunk, 1);
+	unsigned long nbytes = a->nbytes;
+	while(nbytes > 0) {
+		int rc = Write(a->fid, buffer, nbytes < a->chunk ? nbytes : a->chunk);
+		if(rc <= 0) break;
+		nbytes -= rc;
+	}
+	free(buffer);
+	return nbytes==0 ? 0 : 1;
+}
+
+int PipeBench(size_t argc, const char** argv)
+{
+	unsigned long mbytes = (argc>=2) ? getint(1) : 100;
+	unsigned int chunk = (argc>=3) ? getint(2) : 32768;
+	unsigned int size = (argc>=4) ? getint(3) : PIPE_DEFAULT_SIZE;
+	unsigned int lowat = (argc>=5) ? getint(4) : 1;
+	if(chunk==0) chunk = 32768;
+
+	pipe_t pipe;
+	if(PipeEx(&pipe, size, 0)!=0 || SetWatermarks(pipe.read, lowat, lowat)!=0) {
+		printf("Cannot create a pipe\n");
+		return 1;
+	}
+
+	struct pipebench_args a = { .fid = pipe.write, .chunk = chunk, .nbytes = mbytes<<20 };
+	TimerDuration start = bios_clock();
+	Pid_t pid = Exec(pipebench_producer, sizeof(a), &a);
+	Close(pipe.write);
+	if(pid==NOPROC) {
+		Close(pipe.read);
+		printf("Cannot create the producer\n");
+		return 1;
+	}
+
+	procinfo before = { 0 }, after = { 0 };
+	get_procinfo(GetPid(), &before);
+
+	char* buffer = malloc(chunk);
+	unsigned long count = 0;
+	int rc;
+	while((rc = Read(pipe.read, buffer, chunk)) > 0)
+		count += rc;
+	Close(pipe.read);
+	get_procinfo(GetPid(), &after);
+	WaitChild(pid, NULL);
+	free(buffer);
+
+	double secs = (bios_clock() - start) / 1E6;
+	unsigned long switches = after.stats.vol_switches - before.stats.vol_switches;
+	printf("%lu bytes in %.3f sec: %.3f Gbytes/sec, %.1f consumer switches/Mbyte\n", 
+		count, secs, count / secs / 1E9, switches / (count / 1048576.0));
+	return 0;
+}
+
+
 int LowerCase(size_t argc, const char** argv)
 {
 	char c;
-	FILE* fin = fidopen(0, "r");
-	FILE* fout = fidopen(1, "w");
+	FILE* fout = fidopenbuf(1, "w", _IOFBF, 0, NULL);
+	FILE* fin = fidopenbuf(0, "r", _IOFBF, 0, fout);
 	while((c=fgetc(fin))!=EOF) {
 		fputc(tolower(c), fout);
 	}
@@ -295,8 +481,8 @@ int LowerCase(size_t argc, const char** argv)
 int LineEnum(size_t argc, const char** argv)
 {
 	char c;
-	FILE* fin = fidopen(0, "r");
-	FILE* fout = fidopen(1, "w");
+	FILE* fout = fidopenbuf(1, "w", _IOFBF, 0, NULL);
+	FILE* fin = fidopenbuf(0, "r", _IOFBF, 0, fout);
 	int atend=1;
 	size_t count=0;
 	while((c=fgetc(fin))!=EOF) {
@@ -325,9 +511,9 @@ int More(size_t argc, const char** argv)
 	}
 
 	char c;
-	FILE* fin = fidopen(0, "r");
-	FILE* fout = fidopen(1, "w");
-	FILE* fkbd = fidopen(1, "r");
+	FILE* fout = fidopenbuf(1, "w", _IOFBF, 0, NULL);
+	FILE* fin = fidopenbuf(0, "r", _IOFBF, 0, fout);
+	FILE* fkbd = fidopenbuf(1, "r", _IONBF, 0, fout);
 
 	int atend=1;
 	size_t count=0;
@@ -361,7 +547,7 @@ int WordCount(size_t argc, const char** argv)
 	nchar = nword = nline = 0;
 	int wspace = 1;
 	char c;
-	FILE* fin = fidopen(0, "r");
+	FILE* fin = fidopenbuf(0, "r", _IOFBF, 0, NULL);
 	while((c=fgetc(fin))!=EOF) {
 		nchar++;
 		if(wspace && !isblank(c)) {
@@ -440,29 +626,24 @@ static void log_init(void* __globals);
 static void log_print(void* __globals);
 static void log_truncate(void* __globals);
 
-static int rsrv_listener_thread(int port, void* __globals);
+static int rsrv_listener_thread(int lsock, void* __globals);
 
 /* the thread that accepts new connections */
-static int rsrv_listener_thread(int port, void* __globals)
+static int rsrv_listener_thread(int lsock, void* __globals)
 {
-	Fid_t lsock = Socket(port);
-	if(Listen(lsock) == -1) {
-		printf("Cannot listen to the given port: %d\n", port);
-		return -1;
-	}
-	GS(listener_socket) = lsock;
-
-	/* Accept loop */
+	/* Accept loop, taking all the pending connections at once */
+	Fid_t socks[16];
 	while(1) {
-		Fid_t sock = Accept(lsock);
-		if(sock==NOFILE) {
+		int n = AcceptMany(lsock, socks, 16);
+		if(n<0) {
 			/* We failed! Check if we should quit */
 			if(GS(quit)) return 0;
-			log_message(__globals, "listener(port=%d): failed to accept!\n", port);
-		} else {
+			log_message(__globals, "listener(port=%d): failed to accept!\n", GS(port));
+		}
+		for(int i=0; i<n; i++) {
 			GS(active_conn)++;
 			GS(total_conn)++;
-			Tid_t t = CreateThread(rsrv_client, sock, __globals);
+			Tid_t t = CreateThread(rsrv_client, socks[i], __globals);
 			ThreadDetach(t);
 		}
 	}
@@ -488,8 +669,19 @@ int RemoteServer(size_t argc, const char** argv)
 
 	log_init(__globals);
 
+	/* 
+	   Listen before starting the listener thread, so that the console 
+	   never sees a listener socket that is not there yet.
+	 */
+	GS(listener_socket) = Socket(GS(port));
+	if(Listen(GS(listener_socket)) == -1) {
+		printf("Cannot listen to the given port: %d\n", GS(port));
+		Close(GS(listener_socket));
+		return -1;
+	}
+
 	/* Start a thread to listen on */
-	GS(listener) = CreateThread(rsrv_listener_thread, GS(port), __globals);
+	GS(listener) = CreateThread(rsrv_listener_thread, GS(listener_socket), __globals);
 	
 	/* Enter the server console */
 	char* linebuff = NULL;
@@ -620,16 +812,10 @@ static void log_truncate(void* __globals)
 
 
 
-/* Helper to receive a message */
+/* Helper to receive a message, in one call */
 static int recv_message(Fid_t sock, void* buf, size_t len)
 {
-	size_t count = 0;
-	while(count<len) {
-		int rc = Read(sock, buf+count, len-count);
-		if(rc<1) break;  /* Error or end of stream */
-		count += rc;
-	}
-	return count==len;
+	return ReadAtLeast(sock, buf, len, len, TIMEOUT_INFINITE) == len;
 }
 
 /* Helper to execute a remote process */
@@ -720,17 +906,20 @@ finish:
    the client program
 ************************/
 
-/* helper for RemoteClient */
-static void send_message(Fid_t sock, void* buf, size_t len)
+/* 
+  Helper for RemoteClient. The request is the first data on a new 
+  connection, and it is smaller than the buffer of the connection, 
+  so one call writes it whole.
+ */
+static void send_message(Fid_t sock, iovec_t* iov, unsigned int iovcnt)
 {
-	size_t count = 0;
-	while(count<len) {
-		int rc = Write(sock, buf+count, len-count);
-		if(rc<1) break;  /* Error or End of stream */
-		count += rc;
-	}
-	if(count!=len) {
-		printf("In client: I/O error writing %zu bytes (%zu written)\n", len, count);
+	size_t len = 0;
+	for(unsigned int i=0; i<iovcnt; i++) 
+		len += iov[i].len;
+
+	int rc = WriteV(sock, iov, iovcnt);
+	if(rc != len) {
+		printf("In client: I/O error writing %zu bytes (%d written)\n", len, rc);
 		Exit(1);
 	}
 }
@@ -754,20 +943,116 @@ int RemoteClient(size_t argc, const char** argv)
 	char args[argl];
 	argvpack(args, argc-1, argv+1);
 
-	/* Send message */
-	send_message(sock, &argl, sizeof(argl));
-	send_message(sock, args, argl);
+	/* Send the header and the message in one call */
+	iovec_t msg[2] = { { &argl, sizeof(argl) }, { args, argl } };
+	send_message(sock, msg, 2);
 	ShutDown(sock, SHUTDOWN_WRITE);
 
-	/* Read the server data and display */
-	char c;
-	FILE* fin = fidopen(sock, "r");
-	FILE* fout = fidopen(1, "w");
-	while((c=fgetc(fin))!=EOF) {
-		fputc(c, fout);
+	/* Relay the server data to stdout */
+	int rc;
+	while((rc = Splice(sock, 1, SPLICE_BUFFER_SIZE)) > 0);
+	Close(sock);
+	return rc<0 ? 1 : 0;
+}
+
+
+
+/*************************************
+
+	A bridge from host sockets
+
+***************************************/
+
+/* One direction of a bridged connection, with the bytes not written yet */
+typedef struct { 
+	Fid_t from, to; 
+	int open;
+	unsigned int pos, len;
+	char buf[SPLICE_BUFFER_SIZE];
+} bridge_dir;
+
+/* 
+  Connect a host connection to the port, and relay both ways in one thread.
+  Both streams are non-blocking. Each direction waits for its source to 
+  have data when its buffer is empty, and for its destination to have room
+  otherwise. It also stops when its destination fails. Splice() cannot be
+  used here, as it finishes its write even when the destination is full,
+  and then the other direction would not be drained.
+ */
+static int bridge_conn(int hfid, void* args)
+{
+	port_t port = *(port_t*)args;
+
+	Fid_t sock = Socket(NOPORT);
+	if(sock==NOFILE || Connect(sock, port, 1000)==-1) {
+		if(sock!=NOFILE) Close(sock);
+		Close(hfid);
+		return -1;
 	}
-	fclose(fin);
-	fclose(fout);
+	SetFidFlags(hfid, FID_NONBLOCK);
+	SetFidFlags(sock, FID_NONBLOCK);
+
+	bridge_dir dir[2] = { { hfid, sock, 1, 0, 0 }, { sock, hfid, 1, 0, 0 } };
+	while(dir[0].open || dir[1].open) {
+		pollfd_t pfd[4];
+		for(int d=0; d<2; d++) {
+			bridge_dir* b = & dir[d];
+			pfd[d].fid = ! b->open ? NOFILE : b->len ? b->to : b->from;
+			pfd[d].events = b->len ? POLL_WRITE : POLL_READ;
+			pfd[2+d].fid = b->open ? b->to : NOFILE;
+			pfd[2+d].events = 0;
+		}
+		if(Poll(pfd, 4, TIMEOUT_INFINITE) < 0) break;
+
+		for(int d=0; d<2; d++) {
+			bridge_dir* b = & dir[d];
+			if(! (pfd[d].revents || pfd[2+d].revents)) continue;
+
+			int rc = -1;
+			if(pfd[2+d].revents)
+				;    /* The destination failed */
+			else if(b->len == 0) {
+				rc = Read(b->from, b->buf, SPLICE_BUFFER_SIZE);
+				if(rc > 0) { b->pos = 0; b->len = rc; }
+			} else {
+				rc = Write(b->to, b->buf + b->pos, b->len);
+				if(rc > 0) { b->pos += rc; b->len -= rc; }
+			}
+
+			if(rc == 0 || (rc < 0 && rc != IO_WOULDBLOCK)) {
+				b->open = 0;
+				/* The host program is done sending, the reply may still be coming */
+				if(b->to == sock) ShutDown(sock, SHUTDOWN_WRITE);
+			}
+		}
+	}
+
+	Close(sock);
+	Close(hfid);
+	return 0;
+}
+
+int HostBridge(size_t argc, const char** argv)
+{
+	checkargs(1);
+	port_t port = (argc>2) ? getint(2) : REMOTE_SERVER_DEFAULT_PORT;
+
+	Fid_t lsock = HostListen(argv[1]);
+	if(lsock==NOFILE) {
+		printf("Cannot listen on %s\n", argv[1]);
+		return 1;
+	}
+	printf("Bridging %s to port %d\n", argv[1], port);
+
+	/* The connection threads read the port from here */
+	while(1) {
+		Fid_t hfid = HostAccept(lsock);
+		if(hfid==NOFILE) break;
+		Tid_t t = CreateThread(bridge_conn, hfid, &port);
+		ThreadDetach(t);
+	}
+
+	Close(lsock);
 	return 0;
 }
 
@@ -888,9 +1173,10 @@ int Shell(size_t argc, const char** argv)
 	char* cmdline = NULL;
 	size_t cmdlinelen = 0;
 
+	/* The input is not buffered, as it is shared with the commands we run */
 	FILE *fin, *fout;
-	fin = fidopen(0, "r");
-	fout = fidopen(1, "w");		
+	fout = fidopenbuf(1, "w", _IOLBF, 0, NULL);
+	fin = fidopenbuf(0, "r", _IONBF, 0, fout);
 
 	fprintf(fout,"Starting tinyos shell\nType 'help' for help, 'exit' to quit.\n");
 
@@ -11,20 +11,43 @@
 
 
 
+/* The cookie of a C stream opened by fidopenbuf */
+typedef struct fid_cookie {
+	Fid_t fid;
+	FILE* tie;		/* Flushed before each read */
+	char* buffer;	/* The stream buffer, or NULL */
+} fid_cookie;
+
+
 static ssize_t tinyos_fid_read(void *cookie, char *buf, size_t size)
 {
-	return Read(*(Fid_t*)cookie, buf, size); 
+	fid_cookie* fc = cookie;
+	if(fc->tie) fflush(fc->tie);
+	int ret = Read(fc->fid, buf, size); 
+	return (ret<0) ? -1 : ret;
 }
 
+/* 
+	A buffered stream passes many bytes at once, and the C library
+	takes a short count as an error, so we must write them all.
+ */
 static ssize_t tinyos_fid_write(void *cookie, const char *buf, size_t size)
 {
-	int ret = Write(*(Fid_t*)cookie, buf, size); 
-	return (ret<0) ? 0 : ret;
+	fid_cookie* fc = cookie;
+	size_t count = 0;
+	while(count < size) {
+		int ret = Write(fc->fid, buf+count, size-count); 
+		if(ret <= 0) break;
+		count += ret;
+	}
+	return count;
 }
 
 static int tinyos_fid_close(void* cookie)
 {
-	free(cookie);
+	fid_cookie* fc = cookie;
+	free(fc->buffer);
+	free(fc);
 	return 0;
 }
 
@@ -36,6 +59,11 @@ static cookie_io_functions_t  tinyos_fid_functions =
 	tinyos_fid_close
 };
 
+/*
+	The standard streams are shared by all processes, each of which has 
+	its own fids 0 and 1, therefore they must not be buffered. Programs
+	should use fidopenbuf for buffered I/O.
+ */
 static FILE* get_std_stream(int fid, const char* mode)
 {
 	FILE* term = fidopen(fid, mode);
@@ -46,17 +74,38 @@ static FILE* get_std_stream(int fid, const char* mode)
 }
 
 
-FILE* fidopen(Fid_t fid, const char* mode)
+FILE* fidopenbuf(Fid_t fid, const char* mode, int buffering, size_t size, FILE* tie)
 {
+	if(buffering != _IOFBF && buffering != _IOLBF && buffering != _IONBF)
+		return NULL;
+
+	fid_cookie* fc = (fid_cookie*) xmalloc(sizeof(fid_cookie));
+	fc->fid = fid;
+	fc->tie = tie;
+	fc->buffer = NULL;
+
+	FILE* f = fopencookie(fc, mode, tinyos_fid_functions);
+	if(f == NULL) {
+		free(fc);
+		return NULL;
+	}
 
-	Fid_t* fidloc = (Fid_t *) malloc(sizeof(Fid_t));
-	* fidloc = fid;
-	FILE* f = fopencookie(fidloc, mode, tinyos_fid_functions);
-
-	CHECKRC(setvbuf(f, NULL, _IONBF, 0));
+	if(buffering == _IONBF) {
+		CHECKRC(setvbuf(f, NULL, _IONBF, 0));
+	} else {
+		if(size == 0) size = BUFSIZ;
+		fc->buffer = xmalloc(size);
+		CHECKRC(setvbuf(f, fc->buffer, buffering, size));
+	}
 	return f;
 }
 
+
+FILE* fidopen(Fid_t fid, const char* mode)
+{
+	return fidopenbuf(fid, mode, _IONBF, 0, NULL);
+}
+
 FILE *saved_in = NULL, *saved_out = NULL;
 
 
@@ -16,11 +16,40 @@
 /**
     @brief Open a C stream on a tinyos file descriptor.
 
+	The stream is unbuffered, therefore every output call becomes a
+	@c Write() system call. This is the same as 
+	`fidopenbuf(fid, mode, _IONBF, 0, NULL)`.
+
 	This call returns a new FILE pointer on success and NULL
 	on failure.
+	@see fidopenbuf
 */
 FILE* fidopen(Fid_t fid, const char* mode);
 
+
+/**
+	@brief Open a buffered C stream on a tinyos file descriptor.
+
+	The @c buffering argument is one of the standard C buffering modes:
+	@c _IOFBF (full buffering), @c _IOLBF (line buffering) or @c _IONBF
+	(no buffering). The buffer has @c size bytes, or @c BUFSIZ if 
+	@c size is 0.
+
+	If @c tie is not NULL, it is flushed before each read from the 
+	new stream. For example, an input stream for an interactive terminal
+	should be tied to the buffered output stream of the program, so that
+	the user sees all the output (e.g., a prompt) before the program 
+	blocks for input.
+
+	Note that the buffered data of an output stream is only written when
+	the stream is flushed, therefore the stream should be closed (or 
+	flushed) by the process that owns the file id, before it exits.
+
+	This call returns a new FILE pointer on success and NULL
+	on failure.
+  */
+FILE* fidopenbuf(Fid_t fid, const char* mode, int buffering, size_t size, FILE* tie);
+
 void tinyos_replace_stdio();
 void tinyos_restore_stdio();
 void tinyos_pseudo_console();
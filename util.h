@@ -118,6 +118,19 @@ static inline void * xmalloc (size_t size)
   return value;
 }
 
+/**
+	@brief A wrapper for realloc checking for out-of-memory.
+
+	@see xmalloc
+  */
+static inline void * xrealloc (void* ptr, size_t size)
+{
+  void *value = realloc (ptr, size);
+  if (value == 0)
+    FATAL("virtual memory exhausted");
+  return value;
+}
+
 
 /** @}   check_macros  */
 
@@ -289,6 +302,7 @@ typedef struct thread_control_block TCB;	/**< @brief Forward declaration */
 typedef struct core_control_block CCB;		/**< @brief Forward declaration */
 typedef struct device_control_block DCB;	/**< @brief Forward declaration */
 typedef struct file_control_block FCB;		/**< @brief Forward declaration */
+typedef struct fid_table FIDT;				/**< @brief Forward declaration */
 typedef struct process_thread_control_block PTCB;/**< @brief Forward declaration */
 typedef struct socket_control_block SCB;
 typedef struct request_node_struct RNS;
@@ -5,6 +5,8 @@
 #include <time.h>
 #include <math.h>
 #include <setjmp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #include "util.h"
 #include "symposium.h"
@@ -18,6 +20,16 @@
  *
  */
 
+/* Give other threads some time to block */
+static void sleep_msec(timeout_t msec)
+{
+	Mutex mx = MUTEX_INIT;
+	CondVar cv = COND_INIT;
+	Mutex_Lock(&mx);
+	Cond_TimedWait(&mx, &cv, msec);
+	Mutex_Unlock(&mx);
+}
+
 
 /*
 	test_boot
@@ -728,6 +740,73 @@ BOOT_TEST(test_child_inherits_files,
 
 
 
+BOOT_TEST(test_fid_table_grows,
+	"Test that a process can open MAX_FILEID files, and that the lowest\n"
+	"free fid is always allocated."
+	)
+{
+	for(Fid_t i=0; i<MAX_FILEID; i++)
+		ASSERT(OpenNull()==i);
+	ASSERT(OpenNull()==NOFILE);
+
+	ASSERT(Close(MAX_FILEID-1)==0);
+	ASSERT(Close(1000)==0);
+	ASSERT(Close(70)==0);
+	ASSERT(OpenNull()==70);
+	ASSERT(OpenNull()==1000);
+	ASSERT(OpenNull()==MAX_FILEID-1);
+	ASSERT(OpenNull()==NOFILE);
+
+	for(Fid_t i=0; i<MAX_FILEID; i++)
+		ASSERT(Close(i)==0);
+	ASSERT(OpenNull()==0);
+
+	/* Dup2 to a high fid grows the table */
+	ASSERT(Dup2(0, MAX_FILEID-1)==0);
+	ASSERT(OpenNull()==1);
+	char c;
+	ASSERT(Read(MAX_FILEID-1, &c, 1)==1);
+	return 0;
+}
+
+
+BOOT_TEST(test_child_files_copy_on_write,
+	"Test that the files of a child are independent of its parent, even\n"
+	"though they are shared until changed."
+	)
+{
+	for(Fid_t i=0; i<100; i++)
+		ASSERT(OpenNull()==i);
+
+	int child(int argl, void* args) {
+		char c;
+		ASSERT(Read(99, &c, 1)==1);
+		ASSERT(Close(99)==0);
+		ASSERT(Read(99, &c, 1)==-1);
+		ASSERT(OpenNull()==99);
+		ASSERT(Dup2(0, 5)==0);
+		return 0;
+	}
+
+	int status;
+	ASSERT(WaitChild(Exec(child, 0, NULL), &status)!=NOPROC);
+	ASSERT(status==0);
+
+	/* The parent's table is unaffected */
+	char c;
+	ASSERT(Read(99, &c, 1)==1);
+	ASSERT(OpenNull()==100);
+
+	Pid_t pid = Exec(child, 0, NULL);
+	ASSERT(Close(99)==0);
+	ASSERT(Close(5)==0);
+	ASSERT(WaitChild(pid, &status)==pid);
+	ASSERT(status==0);
+	ASSERT(OpenNull()==5);
+	return 0;
+}
+
+
 BOOT_TEST(test_null_device,
 	"Test the null device."
 	)
@@ -752,6 +831,104 @@ BOOT_TEST(test_null_device,
 }
 
 
+BOOT_TEST(test_vectored_io,
+	"Test ReadV and WriteV on the null device, and their errors."
+	)
+{
+	Fid_t fn = OpenNull();
+	ASSERT(fn!=NOFILE);
+
+	char a[] = "zavara", b[] = "katranemia";
+	iovec_t iov[3] = { { a, 3 }, { NULL, 0 }, { b, 4 } };
+	ASSERT(ReadV(fn, iov, 3)==7);
+	ASSERT(memcmp(a, "\0\0\0ara", 7)==0);
+	ASSERT(memcmp(b, "\0\0\0\0anemia", 11)==0);
+	ASSERT(WriteV(fn, iov, 3)==7);
+	ASSERT(WriteV(fn, iov, 0)==0);
+
+	/* Errors */
+	iovec_t many[MAX_IOVEC+1];
+	for(int i=0;i<MAX_IOVEC+1;i++) { many[i].base = a; many[i].len = 1; }
+	ASSERT(WriteV(fn, many, MAX_IOVEC)==MAX_IOVEC);
+	ASSERT(WriteV(fn, many, MAX_IOVEC+1)==-1);
+	ASSERT(ReadV(fn, NULL, 1)==-1);
+	ASSERT(ReadV(NOFILE, iov, 3)==-1);
+	ASSERT(WriteV(MAX_FILEID, iov, 3)==-1);
+	iovec_t huge[2] = { { a, 1u<<31 }, { b, 1u<<31 } };
+	ASSERT(WriteV(fn, huge, 2)==-1);
+
+	ASSERT(Close(fn)==0);
+	return 0;
+}
+
+
+BOOT_TEST(test_splice,
+	"Test Splice between streams, and its errors."
+	)
+{
+	Fid_t fnull = OpenNull();
+	ASSERT(fnull!=NOFILE);
+	Fid_t finfo = OpenInfo();
+	ASSERT(finfo!=NOFILE);
+
+	ASSERT(Splice(fnull, fnull, 100000)==100000);
+	ASSERT(Splice(fnull, fnull, 0)==0);
+
+	/* Through a buffer, from a stream without a splice method */
+	ASSERT(Splice(finfo, fnull, 2*sizeof(procinfo))==2*sizeof(procinfo));
+	ASSERT(Splice(finfo, fnull, 2*sizeof(procinfo))==0);
+
+	/* No bytes are taken from the source, unless the destination can take them */
+	ASSERT(Close(finfo)==0);
+	finfo = OpenInfo();
+	pipe_t p;
+	ASSERT(Pipe(&p)==0);
+	ASSERT(SetFidFlags(p.read, FID_NONBLOCK)==0);
+	ASSERT(SetFidFlags(p.write, FID_NONBLOCK)==0);
+	static char block[1024];
+	while(Write(p.write, block, 1024) > 0);
+	ASSERT(Splice(finfo, p.write, sizeof(procinfo))==IO_WOULDBLOCK);
+
+	while(Read(p.read, block, 1024) > 0);
+	procinfo info;
+	ASSERT(Splice(finfo, p.write, sizeof(procinfo))==sizeof(procinfo));
+	ASSERT(Read(p.read, (char*)&info, sizeof(procinfo))==sizeof(procinfo));
+	ASSERT(info.pid==0);
+
+	ASSERT(Close(p.read)==0);
+	ASSERT(Splice(finfo, p.write, sizeof(procinfo))==-1);
+	ASSERT(Read(finfo, (char*)&info, sizeof(procinfo))==sizeof(procinfo));
+	ASSERT(info.pid==1);
+	ASSERT(Close(p.write)==0);
+
+	/* Errors */
+	ASSERT(Splice(fnull, finfo, 10)==-1);
+	ASSERT(Splice(NOFILE, fnull, 10)==-1);
+	ASSERT(Splice(fnull, MAX_FILEID, 10)==-1);
+	ASSERT(Splice(fnull, fnull, 1u<<31)==-1);
+	return 0;
+}
+
+
+BOOT_TEST(test_vectored_io_generic,
+	"Test ReadV on a stream without a vectored read method."
+	)
+{
+	Fid_t finfo = OpenInfo();
+	ASSERT(finfo!=NOFILE);
+
+	procinfo info[2];
+	iovec_t iov[2] = { { &info[0], sizeof(procinfo) }, { &info[1], sizeof(procinfo) } };
+	ASSERT(ReadV(finfo, iov, 2)==2*sizeof(procinfo));
+	ASSERT(info[0].pid==0 && info[1].pid==1);
+	ASSERT(ReadV(finfo, iov, 2)==0);
+	ASSERT(WriteV(finfo, iov, 2)==-1);
+
+	ASSERT(Close(finfo)==0);
+	return 0;
+}
+
+
 
 /***********************************************************************************8
 *************************************************/
@@ -786,6 +963,668 @@ BOOT_TEST(test_write_con,
 }
 
 
+BOOT_TEST(test_splice_terminal,
+	"Test that Splice moves bytes between the terminal and other streams.",
+	.minimum_terminals = 1
+	)
+{
+	Fid_t fterm = OpenTerminal(0);
+	ASSERT(fterm!=NOFILE);
+	Fid_t fnull = OpenNull();
+	ASSERT(fnull!=NOFILE);
+
+	/* Through a buffer */
+	sendme(0, "Hello");
+	ASSERT(Splice(fterm, fnull, 5)==5);
+
+	/* Directly from the null device */
+	expect(0, "\0\0\0");
+	ASSERT(Splice(fnull, fterm, 3)==3);
+	return 0;
+}
+
+
+BOOT_TEST(test_vectored_io_terminal,
+	"Test that ReadV and WriteV move a scatter/gather list to and from\n"
+	"terminal 0.",
+	.minimum_terminals = 1
+	)
+{
+	Fid_t fterm = OpenTerminal(0);
+	ASSERT(fterm!=NOFILE);
+
+	char hello[] = "Hello", world[] = " world";
+	iovec_t out[2] = { { hello, 5 }, { world, 6 } };
+	expect(0, "Hello world");
+	ASSERT(WriteV(fterm, out, 2)==11);
+
+	char a[5], b[6];
+	iovec_t in[2] = { { a, 5 }, { b, 6 } };
+	sendme(0, "Hello world");
+	ASSERT(ReadV(fterm, in, 2)==11);
+	ASSERT(memcmp(a, "Hello", 5)==0);
+	ASSERT(memcmp(b, " world", 6)==0);
+	return 0;
+}
+
+
+BOOT_TEST(test_poll_basic,
+	"Test that Poll reports the null device ready, ignores negative fids\n"
+	"and reports closed fids as invalid."
+	)
+{
+	Fid_t fnull = OpenNull();
+	ASSERT(fnull!=NOFILE);
+
+	pollfd_t fds[3] = {
+		{ .fid = fnull, .events = POLL_READ|POLL_WRITE },
+		{ .fid = -1, .events = POLL_READ },
+		{ .fid = 17, .events = POLL_READ }
+	};
+	ASSERT(Poll(fds, 3, TIMEOUT_INFINITE)==2);
+	ASSERT(fds[0].revents == (POLL_READ|POLL_WRITE));
+	ASSERT(fds[1].revents == 0);
+	ASSERT(fds[2].revents == POLL_INVALID);
+
+	/* Only the requested events are returned */
+	fds[0].events = POLL_WRITE;
+	ASSERT(Poll(fds, 1, 0)==1);
+	ASSERT(fds[0].revents == POLL_WRITE);
+
+	ASSERT(Poll(NULL, 1, 0)==-1);
+	ASSERT(Poll(fds, MAX_POLLFD+1, 0)==-1);
+	ASSERT(Poll(NULL, 0, 0)==0);
+	return 0;
+}
+
+
+BOOT_TEST(test_poll_terminal,
+	"Test that Poll waits until terminal 0 is readable, and that the data\n"
+	"is not lost.",
+	.minimum_terminals = 1
+	)
+{
+	Fid_t fterm = OpenTerminal(0);
+	ASSERT(fterm!=NOFILE);
+
+	pollfd_t fds[1] = { { .fid = fterm, .events = POLL_READ } };
+
+	/* Nothing to read yet */
+	ASSERT(Poll(fds, 1, 100)==0);
+	ASSERT(fds[0].revents == 0);
+
+	sendme(0, "Hello");
+	ASSERT(Poll(fds, 1, TIMEOUT_INFINITE)==1);
+	ASSERT(fds[0].revents == POLL_READ);
+
+	/* Still ready, until we read */
+	ASSERT(Poll(fds, 1, 0)==1);
+
+	char buf[5];
+	int count = 0;
+	while(count < 5) {
+		int rc = Read(fterm, buf+count, 5-count);
+		ASSERT(rc > 0);
+		count += rc;
+	}
+	ASSERT(memcmp(buf, "Hello", 5)==0);
+	return 0;
+}
+
+
+BOOT_TEST(test_poll_many_terminals,
+	"Test that a single thread can wait on all the terminals with Poll.",
+	.minimum_terminals = 2
+	)
+{
+	unsigned int nterm = GetTerminalDevices();
+	pollfd_t fds[MAX_TERMINALS];
+	for(unsigned int i=0; i<nterm; i++) {
+		fds[i].fid = OpenTerminal(i);
+		ASSERT(fds[i].fid!=NOFILE);
+		fds[i].events = POLL_READ;
+	}
+
+	sendme(nterm-1, "x");
+	ASSERT(Poll(fds, nterm, TIMEOUT_INFINITE)==1);
+	for(unsigned int i=0; i<nterm-1; i++)
+		ASSERT(fds[i].revents == 0);
+	ASSERT(fds[nterm-1].revents == POLL_READ);
+
+	char c;
+	ASSERT(Read(fds[nterm-1].fid, &c, 1)==1);
+	ASSERT(c=='x');
+	return 0;
+}
+
+
+BOOT_TEST(test_eventq_basic,
+	"Test that an event queue reports registered streams once, when they\n"
+	"become ready, and that closed streams are unregistered."
+	)
+{
+	Fid_t evq = EventQueueCreate();
+	ASSERT(evq!=NOFILE);
+	Fid_t fnull = OpenNull();
+	ASSERT(fnull!=NOFILE);
+
+	pollfd_t ev[4];
+	ASSERT(EventQueueWait(evq, ev, 4, 0)==0);
+
+	ASSERT(EventQueueCtl(evq, EVQ_ADD, fnull, POLL_READ)==0);
+	ASSERT(EventQueueCtl(evq, EVQ_ADD, fnull, POLL_READ)==-1);
+	ASSERT(EventQueueWait(evq, ev, 4, 0)==1);
+	ASSERT(ev[0].fid==fnull);
+	ASSERT(ev[0].events==POLL_READ);
+	ASSERT(ev[0].revents==POLL_READ);
+
+	/* Edge-triggered: no new event */
+	ASSERT(EventQueueWait(evq, ev, 4, 50)==0);
+
+	/* Changing the events re-arms the stream */
+	ASSERT(EventQueueCtl(evq, EVQ_MOD, fnull, POLL_READ|POLL_WRITE)==0);
+	ASSERT(EventQueueWait(evq, ev, 4, 0)==1);
+	ASSERT(ev[0].revents==(POLL_READ|POLL_WRITE));
+
+	ASSERT(EventQueueCtl(evq, EVQ_DEL, fnull, 0)==0);
+	ASSERT(EventQueueCtl(evq, EVQ_DEL, fnull, 0)==-1);
+	ASSERT(EventQueueCtl(evq, EVQ_MOD, fnull, POLL_READ)==-1);
+
+	/* Closing a stream unregisters it */
+	ASSERT(EventQueueCtl(evq, EVQ_ADD, fnull, POLL_READ)==0);
+	ASSERT(Close(fnull)==0);
+	ASSERT(EventQueueWait(evq, ev, 4, 0)==0);
+	fnull = OpenNull();
+	ASSERT(EventQueueCtl(evq, EVQ_DEL, fnull, 0)==-1);
+
+	/* Errors */
+	ASSERT(EventQueueCtl(evq, EVQ_ADD, evq, POLL_READ)==-1);
+	ASSERT(EventQueueCtl(evq, EVQ_ADD, 3000, POLL_READ)==-1);
+	ASSERT(EventQueueCtl(fnull, EVQ_ADD, fnull, POLL_READ)==-1);
+	ASSERT(EventQueueWait(fnull, ev, 4, 0)==-1);
+	ASSERT(EventQueueWait(evq, NULL, 4, 0)==-1);
+	ASSERT(Read(evq, (char*)ev, sizeof(ev))==-1);
+
+	ASSERT(Close(evq)==0);
+	return 0;
+}
+
+
+BOOT_TEST(test_eventq_many_streams,
+	"Test that an event queue returns many ready streams in batches."
+	)
+{
+	Fid_t evq = EventQueueCreate();
+	ASSERT(evq!=NOFILE);
+	Fid_t fnull = OpenNull();
+	ASSERT(fnull!=NOFILE);
+
+	const int N = 1000;
+	for(int i=0; i<N; i++) {
+		ASSERT(Dup2(fnull, 100+i)==0);
+		ASSERT(EventQueueCtl(evq, EVQ_ADD, 100+i, POLL_WRITE)==0);
+	}
+
+	/* The queue is itself pollable */
+	pollfd_t pfd = { .fid = evq, .events = POLL_READ };
+	ASSERT(Poll(&pfd, 1, 0)==1);
+
+	static char seen[1000];
+	memset(seen, 0, sizeof(seen));
+	pollfd_t ev[64];
+	int total = 0;
+	while(total < N) {
+		int n = EventQueueWait(evq, ev, 64, 0);
+		ASSERT(n > 0 && n <= 64);
+		for(int i=0; i<n; i++) {
+			ASSERT(ev[i].fid >= 100 && ev[i].fid < 100+N);
+			ASSERT(! seen[ev[i].fid-100]);
+			ASSERT(ev[i].revents == POLL_WRITE);
+			seen[ev[i].fid-100] = 1;
+		}
+		total += n;
+	}
+	ASSERT(EventQueueWait(evq, ev, 64, 0)==0);
+	ASSERT(Poll(&pfd, 1, 0)==0);
+
+	ASSERT(Close(evq)==0);
+	return 0;
+}
+
+
+BOOT_TEST(test_eventq_terminal,
+	"Test that a thread blocked on an event queue is woken up when a\n"
+	"terminal becomes readable.",
+	.minimum_terminals = 2
+	)
+{
+	Fid_t evq = EventQueueCreate();
+	ASSERT(evq!=NOFILE);
+
+	unsigned int nterm = GetTerminalDevices();
+	Fid_t fterm[MAX_TERMINALS];
+	for(unsigned int i=0; i<nterm; i++) {
+		fterm[i] = OpenTerminal(i);
+		ASSERT(fterm[i]!=NOFILE);
+		ASSERT(EventQueueCtl(evq, EVQ_ADD, fterm[i], POLL_READ)==0);
+	}
+
+	pollfd_t ev[MAX_TERMINALS];
+	ASSERT(EventQueueWait(evq, ev, nterm, 100)==0);
+
+	sendme(1, "x");
+	ASSERT(EventQueueWait(evq, ev, nterm, TIMEOUT_INFINITE)==1);
+	ASSERT(ev[0].fid == fterm[1]);
+	ASSERT(ev[0].revents == POLL_READ);
+
+	char c;
+	ASSERT(Read(fterm[1], &c, 1)==1);
+	ASSERT(c=='x');
+	return 0;
+}
+
+
+BOOT_TEST(test_fid_flags,
+	"Test that the flags of a stream can be set, and are shared by the\n"
+	"copies of the file id."
+	)
+{
+	Fid_t fnull = OpenNull();
+	ASSERT(fnull!=NOFILE);
+
+	ASSERT(GetFidFlags(fnull)==0);
+	ASSERT(SetFidFlags(fnull, FID_NONBLOCK)==0);
+	ASSERT(GetFidFlags(fnull)==FID_NONBLOCK);
+	ASSERT(Dup2(fnull, 10)==0);
+	ASSERT(GetFidFlags(10)==FID_NONBLOCK);
+
+	/* The null device never blocks anyway */
+	char buf[4];
+	ASSERT(Read(fnull, buf, 4)==4);
+	ASSERT(ReadTimed(fnull, buf, 4, 0)==4);
+	ASSERT(WriteTimed(fnull, buf, 4, 0)==4);
+
+	ASSERT(SetFidFlags(fnull, 0x100)==-1);
+	ASSERT(SetFidFlags(NOFILE, 0)==-1);
+	ASSERT(GetFidFlags(NOFILE)==-1);
+	ASSERT(GetFidFlags(11)==-1);
+	ASSERT(ReadTimed(11, buf, 4, 0)==-1);
+	return 0;
+}
+
+
+BOOT_TEST(test_nonblocking_terminal,
+	"Test that a non-blocking read from terminal 0 does not block.",
+	.minimum_terminals = 1
+	)
+{
+	Fid_t fterm = OpenTerminal(0);
+	ASSERT(fterm!=NOFILE);
+	ASSERT(SetFidFlags(fterm, FID_NONBLOCK)==0);
+
+	char buf[5];
+	ASSERT(Read(fterm, buf, 5)==IO_WOULDBLOCK);
+	iovec_t iov = { buf, 5 };
+	ASSERT(ReadV(fterm, &iov, 1)==IO_WOULDBLOCK);
+
+	sendme(0, "Hello");
+	pollfd_t pfd = { .fid = fterm, .events = POLL_READ };
+	int count = 0;
+	while(count < 5) {
+		ASSERT(Poll(&pfd, 1, TIMEOUT_INFINITE)==1);
+		int rc = Read(fterm, buf+count, 5-count);
+		ASSERT(rc > 0 || rc == IO_WOULDBLOCK);
+		if(rc > 0) count += rc;
+	}
+	ASSERT(memcmp(buf, "Hello", 5)==0);
+	ASSERT(Read(fterm, buf, 5)==IO_WOULDBLOCK);
+
+	/* Back to blocking mode */
+	ASSERT(SetFidFlags(fterm, 0)==0);
+	sendme(0, "x");
+	ASSERT(Read(fterm, buf, 1)==1);
+	ASSERT(buf[0]=='x');
+	return 0;
+}
+
+
+BOOT_TEST(test_read_timed_terminal,
+	"Test that a timed read from terminal 0 times out, or returns data\n"
+	"when it arrives in time.",
+	.minimum_terminals = 1
+	)
+{
+	Fid_t fterm = OpenTerminal(0);
+	ASSERT(fterm!=NOFILE);
+
+	char buf[5];
+	ASSERT(ReadTimed(fterm, buf, 5, 0)==IO_TIMEDOUT);
+	ASSERT(ReadTimed(fterm, buf, 5, 100)==IO_TIMEDOUT);
+
+	sendme(0, "Hello");
+	int count = 0;
+	while(count < 5) {
+		int rc = ReadTimed(fterm, buf+count, 5-count, 10000);
+		ASSERT(rc > 0);
+		count += rc;
+	}
+	ASSERT(memcmp(buf, "Hello", 5)==0);
+	return 0;
+}
+
+
+BOOT_TEST(test_aio_basic,
+	"Test that asynchronous requests on non-blocking streams complete at once."
+	)
+{
+	Fid_t ctx = AioCreate();
+	ASSERT(ctx!=NOFILE);
+	Fid_t fnull = OpenNull();
+	ASSERT(fnull!=NOFILE);
+
+	char buf[16];
+	aio_sqe sqe[5] = {
+		{ .opcode = AIO_READ, .fid = fnull, .buf = buf, .len = 16, .user_data = 1 },
+		{ .opcode = AIO_WRITE, .fid = fnull, .buf = buf, .len = 8, .user_data = 2 },
+		{ .opcode = AIO_READ, .fid = 20, .buf = buf, .len = 16, .user_data = 3 },
+		{ .opcode = 100, .fid = fnull, .user_data = 4 },
+		{ .opcode = AIO_CLOSE, .fid = fnull, .user_data = 5 }
+	};
+	ASSERT(AioSubmit(ctx, sqe, 5)==5);
+
+	aio_cqe cqe[8];
+	ASSERT(AioReap(ctx, cqe, 8, 5, 0)==5);
+	int expected[5] = { 16, 8, -1, -1, 0 };
+	for(int i=0; i<5; i++) {
+		ASSERT(cqe[i].user_data == i+1);
+		ASSERT(cqe[i].result == expected[i]);
+	}
+	ASSERT(GetFidFlags(fnull)==-1);
+	ASSERT(AioReap(ctx, cqe, 8, 0, 0)==0);
+
+	/* There is nothing to wait for */
+	ASSERT(AioReap(ctx, cqe, 8, 4, TIMEOUT_INFINITE)==0);
+
+	/* Errors */
+	ASSERT(AioSubmit(NOFILE, sqe, 1)==-1);
+	ASSERT(AioSubmit(ctx, NULL, 1)==-1);
+	ASSERT(AioReap(ctx, cqe, 1, 2, 0)==-1);
+	ASSERT(AioReap(ctx, NULL, 1, 0, 0)==-1);
+
+	ASSERT(Close(ctx)==0);
+	return 0;
+}
+
+
+BOOT_TEST(test_aio_inflight_limit,
+	"Test that a context accepts at most MAX_AIO_INFLIGHT requests until\n"
+	"they are reaped."
+	)
+{
+	Fid_t ctx = AioCreate();
+	ASSERT(ctx!=NOFILE);
+	Fid_t fnull = OpenNull();
+
+	static aio_sqe sqe[MAX_AIO_INFLIGHT+10];
+	for(int i=0; i<MAX_AIO_INFLIGHT+10; i++)
+		sqe[i] = (aio_sqe){ .opcode = AIO_WRITE, .fid = fnull, .buf = &sqe[i], .len = 1, .user_data = i };
+	ASSERT(AioSubmit(ctx, sqe, MAX_AIO_INFLIGHT+10)==MAX_AIO_INFLIGHT);
+
+	aio_cqe cqe[100];
+	ASSERT(AioReap(ctx, cqe, 100, 100, TIMEOUT_INFINITE)==100);
+	ASSERT(AioSubmit(ctx, sqe, 200)==100);
+	ASSERT(Close(ctx)==0);
+	return 0;
+}
+
+
+BOOT_TEST(test_aio_terminal,
+	"Test that an asynchronous read from terminal 0 completes when the\n"
+	"data arrives.",
+	.minimum_terminals = 1
+	)
+{
+	Fid_t ctx = AioCreate();
+	ASSERT(ctx!=NOFILE);
+	Fid_t fterm = OpenTerminal(0);
+	ASSERT(fterm!=NOFILE);
+
+	char buf[5];
+	aio_sqe sqe = { .opcode = AIO_READ, .fid = fterm, .buf = buf, .len = 5, .user_data = 42 };
+	ASSERT(AioSubmit(ctx, &sqe, 1)==1);
+
+	/* The request is in progress, even after its fid is closed */
+	aio_cqe cqe;
+	ASSERT(AioReap(ctx, &cqe, 1, 0, 0)==0);
+	ASSERT(AioReap(ctx, &cqe, 1, 1, 100)==0);
+	ASSERT(Close(fterm)==0);
+
+	sendme(0, "Hello");
+	ASSERT(AioReap(ctx, &cqe, 1, 1, TIMEOUT_INFINITE)==1);
+	ASSERT(cqe.user_data == 42);
+	ASSERT(cqe.result > 0 && cqe.result <= 5);
+	ASSERT(memcmp(buf, "Hello", cqe.result)==0);
+
+	/* Closing the context cancels the requests in progress */
+	fterm = OpenTerminal(0);
+	char rest[5];
+	sqe.buf = rest;
+	sqe.len = 5;
+	sqe.fid = fterm;
+	if(cqe.result == 5) {
+		ASSERT(AioSubmit(ctx, &sqe, 1)==1);
+		ASSERT(AioReap(ctx, &cqe, 1, 0, 0)==0);
+	}
+	ASSERT(Close(ctx)==0);
+	return 0;
+}
+
+
+BOOT_TEST(test_aio_connect,
+	"Test that an asynchronous Connect does not block the submitter, and\n"
+	"that it completes when accepted or when its timeout expires."
+	)
+{
+	Fid_t ctx = AioCreate();
+	ASSERT(ctx!=NOFILE);
+	Fid_t lsock = Socket(100);  ASSERT(lsock!=NOFILE);
+	ASSERT(Listen(lsock)==0);
+	Fid_t cli = Socket(NOPORT);  ASSERT(cli!=NOFILE);
+	Fid_t cli2 = Socket(NOPORT);  ASSERT(cli2!=NOFILE);
+
+	aio_sqe sqe[2] = {
+		{ .opcode = AIO_CONNECT, .fid = cli, .port = 100, .timeout = TIMEOUT_INFINITE, .user_data = 1 },
+		{ .opcode = AIO_CONNECT, .fid = cli2, .port = 100, .timeout = 50, .user_data = 2 }
+	};
+	ASSERT(AioSubmit(ctx, sqe, 2)==2);
+
+	aio_cqe cqe;
+	ASSERT(AioReap(ctx, &cqe, 1, 0, 0)==0);
+
+	/* The first is accepted */
+	Fid_t srv = Accept(lsock);
+	ASSERT(srv!=NOFILE && srv>=0);
+	ASSERT(AioReap(ctx, &cqe, 1, 1, 1000)==1);
+	ASSERT(cqe.user_data == 1 && cqe.result == 0);
+
+	/* The second expires */
+	ASSERT(AioReap(ctx, &cqe, 1, 1, 1000)==1);
+	ASSERT(cqe.user_data == 2 && cqe.result == -1);
+
+	char buf[6];
+	ASSERT(Write(cli, "Hello", 6)==6);
+	ASSERT(Read(srv, buf, 6)==6);
+	ASSERT(Close(ctx)==0);
+	return 0;
+}
+
+
+BOOT_TEST(test_fidopenbuf,
+	"Test that buffered C streams on terminal 0 deliver all the output, and\n"
+	"that a tied output stream is flushed before reading.",
+	.minimum_terminals = 1
+	)
+{
+	Fid_t fterm = OpenTerminal(0);
+	ASSERT(fterm!=NOFILE);
+
+	ASSERT(fidopenbuf(fterm, "w", 42, 0, NULL)==NULL);
+
+	FILE* fout = fidopenbuf(fterm, "w", _IOFBF, 16, NULL);
+	ASSERT(fout!=NULL);
+	FILE* fin = fidopenbuf(fterm, "r", _IONBF, 0, fout);
+	ASSERT(fin!=NULL);
+
+	expect(0, "Name? ");
+	fputs("Name? ", fout);
+	sendme(0, "Bob\n");
+
+	char* line = NULL;
+	size_t len = 0;
+	ASSERT(getline(&line, &len, fin)==4);
+	ASSERT(strcmp(line, "Bob\n")==0);
+	free(line);
+
+	/* Longer than the buffer */
+	expect(0, "Hello Bob, this is a long line of output\n");
+	fprintf(fout, "Hello %s, this is a long line of output\n", "Bob");
+
+	fclose(fin);
+	fclose(fout);
+	return 0;
+}
+
+
+BOOT_TEST(test_iostat_basic,
+	"Test that the I/O statistics stream returns the counters of the device\n"
+	"types and of the open streams.")
+{
+	/* Find the record of a fid, or of a device type if fid==NOFILE */
+	int get_iostat(Fid_t fid, const char* devname, iostat_info* out) {
+		Fid_t fstat = OpenIoStats();
+		ASSERT(fstat!=NOFILE);
+		iostat_info info[4];
+		int found = 0, rc;
+		while((rc = Read(fstat, (char*)info, sizeof(info))) > 0) {
+			ASSERT(rc % sizeof(iostat_info) == 0);
+			for(unsigned int i=0; i<rc/sizeof(iostat_info); i++)
+				if(info[i].fid==fid && (fid!=NOFILE || strcmp(info[i].devname, devname)==0)) {
+					*out = info[i];
+					found = 1;
+				}
+		}
+		ASSERT(rc==0);
+		ASSERT(Close(fstat)==0);
+		return found;
+	}
+
+	iostat_info dev0, dev1, fidinfo;
+	ASSERT(get_iostat(NOFILE, "null", &dev0));
+
+	Fid_t fnull = OpenNull();
+	ASSERT(fnull!=NOFILE);
+	ASSERT(get_iostat(fnull, NULL, &fidinfo));
+	ASSERT(strcmp(fidinfo.devname, "null")==0);
+	ASSERT(fidinfo.stats.reads==0 && fidinfo.stats.writes==0);
+
+	char buf[10];
+	ASSERT(Read(fnull, buf, 10)==10);
+	ASSERT(Write(fnull, buf, 5)==5);
+	ASSERT(Write(fnull, buf, 7)==7);
+
+	ASSERT(get_iostat(fnull, NULL, &fidinfo));
+	ASSERT(fidinfo.stats.reads==1);
+	ASSERT(fidinfo.stats.bytes_read==10);
+	ASSERT(fidinfo.stats.writes==2);
+	ASSERT(fidinfo.stats.bytes_written==12);
+	ASSERT(fidinfo.stats.wakeups==0);
+
+	ASSERT(get_iostat(NOFILE, "null", &dev1));
+	ASSERT(dev1.stats.reads == dev0.stats.reads+1);
+	ASSERT(dev1.stats.bytes_written == dev0.stats.bytes_written+12);
+
+	/* The counters belong to the stream, not the fid */
+	ASSERT(Dup2(fnull, 3)==0);
+	ASSERT(get_iostat(3, NULL, &fidinfo));
+	ASSERT(fidinfo.stats.reads==1);
+	ASSERT(Close(3)==0);
+	ASSERT(Close(fnull)==0);
+
+	/* Short buffers are an error */
+	Fid_t fstat = OpenIoStats();
+	ASSERT(Read(fstat, buf, sizeof(buf))==-1);
+	ASSERT(Write(fstat, buf, 1)==-1);
+	ASSERT(Close(fstat)==0);
+	return 0;
+}
+
+
+BOOT_TEST(test_iostat_terminal,
+	"Test that the time spent blocked on a terminal is accounted.",
+	.minimum_terminals = 1
+	)
+{
+	Fid_t fterm = OpenTerminal(0);
+	ASSERT(fterm!=NOFILE);
+
+	char buf[5];
+	ASSERT(ReadTimed(fterm, buf, 5, 50)==IO_TIMEDOUT);
+
+	Fid_t fstat = OpenIoStats();
+	ASSERT(fstat!=NOFILE);
+	iostat_info info;
+	int found = 0;
+	while(Read(fstat, (char*)&info, sizeof(info)) > 0) {
+		if(info.fid==fterm) {
+			found = 1;
+			ASSERT(strcmp(info.devname, "serial")==0);
+			ASSERT(info.stats.reads==1);
+			ASSERT(info.stats.bytes_read==0);
+			ASSERT(info.stats.wakeups>=1);
+			ASSERT(info.stats.blocked_time >= 40000);
+		}
+	}
+	ASSERT(found);
+	ASSERT(Close(fstat)==0);
+	ASSERT(Close(fterm)==0);
+	return 0;
+}
+
+
+BOOT_TEST(test_iostat_short_wait,
+	"Test that short waits are accounted with a fine-grained clock."
+	)
+{
+	pipe_t p;
+	ASSERT(Pipe(&p)==0);
+
+	int writer(int argl, void* args) {
+		sleep_msec(20);
+		ASSERT(Write(p.write, "x", 1)==1);
+		return 0;
+	}
+	Tid_t t = CreateThread(writer, 0, NULL);
+	char c;
+	ASSERT(Read(p.read, &c, 1)==1);
+	ASSERT(ThreadJoin(t, NULL)==0);
+
+	Fid_t fstat = OpenIoStats();
+	ASSERT(fstat!=NOFILE);
+	iostat_info info;
+	int found = 0;
+	while(Read(fstat, (char*)&info, sizeof(info)) > 0) {
+		if(info.fid==p.read) {
+			found = 1;
+			ASSERT(info.stats.wakeups>=1);
+			ASSERT(info.stats.blocked_time >= 10000 && info.stats.blocked_time < 100000);
+		}
+	}
+	ASSERT(found);
+	ASSERT(Close(fstat)==0);
+	return 0;
+}
+
+
 BOOT_TEST(test_write_con_big,
 	"Test that we can write massively to the console on terminal 0.",
 	.minimum_terminals = 1
@@ -884,6 +1723,9 @@ TEST_SUITE(basic_tests,
 	 &test_cond_timedwait_signal,
 	 &test_cond_timedwait_broadcast,
 	 &test_null_device,
+	 &test_vectored_io,
+	 &test_vectored_io_generic,
+	 &test_splice,
 	 &test_get_terminals,
 	 &test_open_terminals,
 	 &test_dup2_error_on_nonfile,
@@ -897,10 +1739,31 @@ TEST_SUITE(basic_tests,
 	 &test_read_error_on_bad_fid,
 	 &test_read_from_many_terminals,
 	 &test_write_con,
+	 &test_fidopenbuf,
+	 &test_vectored_io_terminal,
+	 &test_splice_terminal,
+	 &test_poll_basic,
+	 &test_poll_terminal,
+	 &test_poll_many_terminals,
+	 &test_eventq_basic,
+	 &test_eventq_many_streams,
+	 &test_eventq_terminal,
+	 &test_fid_flags,
+	 &test_nonblocking_terminal,
+	 &test_read_timed_terminal,
+	 &test_aio_basic,
+	 &test_aio_inflight_limit,
+	 &test_aio_terminal,
+	 &test_aio_connect,
+	 &test_iostat_basic,
+	 &test_iostat_terminal,
+	 &test_iostat_short_wait,
 	 &test_write_con_big,
 	 &test_write_error_on_bad_fid,
 	 &test_write_to_many_terminals,
 	 &test_child_inherits_files,
+	 &test_fid_table_grows,
+	 &test_child_files_copy_on_write,
 	NULL
 };
 
@@ -973,12 +1836,119 @@ BOOT_TEST(test_exit_many_threads,
 
 
 
-TEST_SUITE(thread_tests, 
-	"A suite of tests for threads."
+BOOT_TEST(test_tls_per_thread_values,
+	"Test that each thread sees its own thread-local values."
+	)
+{
+	TlsKey_t key = TlsKeyCreate(NULL);
+	ASSERT(key != NOKEY);
+	ASSERT(TlsGet(key) == NULL);
+
+	int task(int argl, void* args) {
+		ASSERT(TlsGet(key) == NULL);
+		ASSERT(TlsSet(key, args) == 0);
+		for(int i=0;i<10;i++) {
+			fibo(10);
+			ASSERT(TlsGet(key) == args);
+		}
+		return 0;
+	}
+
+	int vals[5];
+	Tid_t t[5];
+	ASSERT(TlsSet(key, &key)==0);
+	for(int i=0;i<5;i++)
+		ASSERT((t[i] = CreateThread(task, 0, &vals[i])) != NOTHREAD);
+	for(int i=0;i<5;i++)
+		ASSERT(ThreadJoin(t[i], NULL)==0);
+	ASSERT(TlsGet(key) == &key);
+
+	/* Deleted keys have no values, and new keys start empty */
+	ASSERT(TlsKeyDelete(key)==0);
+	ASSERT(TlsKeyDelete(key)==-1);
+	ASSERT(TlsGet(key) == NULL);
+	ASSERT(TlsSet(key, &key) == -1);
+	ASSERT(TlsKeyCreate(NULL) == key);
+	ASSERT(TlsGet(key) == NULL);
+
+	ASSERT(TlsGet(-1) == NULL);
+	ASSERT(TlsGet(MAX_TLS_KEYS) == NULL);
+	return 0;
+}
+
+
+BOOT_TEST(test_tls_key_exhaustion,
+	"Test that TlsKeyCreate fails when the keys are exhausted, and\n"
+	"that child processes do not inherit keys."
+	)
+{
+	for(int i=0;i<MAX_TLS_KEYS;i++)
+		ASSERT(TlsKeyCreate(NULL) == i);
+	ASSERT(TlsKeyCreate(NULL) == NOKEY);
+
+	int child(int argl, void* args) {
+		ASSERT(TlsKeyCreate(NULL) == 0);
+		return 0;
+	}
+	int status;
+	WaitChild(Exec(child, 0, NULL), &status);
+	ASSERT(status==0);
+	return 0;
+}
+
+
+BOOT_TEST(test_tls_destructors,
+	"Test that thread-local destructors run when threads exit."
+	)
+{
+	static int destroyed;
+	destroyed = 0;
+
+	TlsKey_t key;
+
+	void destroy(void* value) {
+		ASSERT(value == &destroyed);
+		destroyed++;
+		/* Destructors can make system calls */
+		ASSERT(GetPid() != NOPROC);
+	}
+
+	key = TlsKeyCreate(destroy);
+	ASSERT(key != NOKEY);
+
+	int task(int argl, void* args) {
+		if(argl) ASSERT(TlsSet(key, &destroyed) == 0);
+		return 0;
+	}
+
+	Tid_t t1 = CreateThread(task, 1, NULL);
+	Tid_t t2 = CreateThread(task, 0, NULL);
+	ASSERT(ThreadJoin(t1, NULL)==0);
+	ASSERT(ThreadJoin(t2, NULL)==0);
+	ASSERT(destroyed == 1);
+
+	/* The main thread runs its destructors at Exit */
+	int child(int argl, void* args) {
+		TlsKey_t k = TlsKeyCreate(destroy);
+		ASSERT(TlsSet(k, &destroyed)==0);
+		Exit(0);
+		return 1;
+	}
+	ASSERT(WaitChild(Exec(child, 0, NULL), NULL) != NOPROC);
+	ASSERT(destroyed == 2);
+	return 0;
+}
+
+
+TEST_SUITE(thread_tests, 
+	"A suite of tests for threads."
 	)
 {
 	&test_create_join_thread,
 	&test_exit_many_threads,
+	&test_tls_per_thread_values,
+	&test_tls_key_exhaustion,
+	&test_tls_destructors,
 	NULL
 };
 
@@ -1077,6 +2047,233 @@ BOOT_TEST(test_pipe_close_writer,
 }
 
 
+BOOT_TEST(test_pipe_wraparound,
+	"Test that data is not garbled as the pipe buffer wraps around."
+	)
+{
+	pipe_t pipe;
+	ASSERT(Pipe(&pipe)==0);
+
+	char out[3001], in[3001];
+	unsigned char seq = 0, check = 0;
+	for(int round=0; round<50; round++) {
+		for(int i=0; i<3001; i++) out[i] = seq++;
+		ASSERT(Write(pipe.write, out, 3001)==3001);
+		int count = 0;
+		while(count < 3001) {
+			int rc = Read(pipe.read, in, 1000);
+			ASSERT(rc > 0 && rc <= 1000);
+			for(int i=0; i<rc; i++) ASSERT((unsigned char)in[i] == check++);
+			count += rc;
+		}
+	}
+
+	/* A write larger than the buffer is short */
+	char big[20000];
+	int rc = Write(pipe.write, big, sizeof(big));
+	ASSERT(rc > 0 && rc < sizeof(big));
+	ASSERT(Close(pipe.write)==0);
+	int count = 0;
+	while((rc = Read(pipe.read, big, sizeof(big))) > 0) count += rc;
+	ASSERT(rc==0 && count > 0);
+	ASSERT(Close(pipe.read)==0);
+	return 0;
+}
+
+
+BOOT_TEST(test_pipe_vectored_splice,
+	"Test vectored I/O on pipes, and Splice from a pipe straight into another."
+	)
+{
+	pipe_t p, q;
+	ASSERT(Pipe(&p)==0);
+	ASSERT(Pipe(&q)==0);
+
+	iovec_t out[3] = { { "Hel", 3 }, { "lo ", 3 }, { "world", 6 } };
+	ASSERT(WriteV(p.write, out, 3)==12);
+	char a[4], b[20];
+	iovec_t in[2] = { { a, 4 }, { b, 20 } };
+	ASSERT(ReadV(p.read, in, 2)==12);
+	ASSERT(memcmp(a, "Hell", 4)==0 && strcmp(b, "o world")==0);
+
+	/* The ring wraps around in the middle of the spliced data */
+	static char big[PIPE_DEFAULT_SIZE], check[PIPE_DEFAULT_SIZE];
+	ASSERT(Write(p.write, big, 8000)==8000);
+	ASSERT(Read(p.read, big, 8000)==8000);
+	for(int i=0; i<1000; i++) big[i] = (char) i;
+	ASSERT(Write(p.write, big, 1000)==1000);
+	ASSERT(Splice(p.read, q.write, 2000)==1000);
+	ASSERT(Read(q.read, check, 2000)==1000);
+	ASSERT(memcmp(big, check, 1000)==0);
+
+	/* Data that the destination cannot take stay in the source */
+	ASSERT(SetFidFlags(q.write, FID_NONBLOCK)==0);
+	while(Write(q.write, big, sizeof(big)) > 0);
+	ASSERT(Write(p.write, "abc", 3)==3);
+	ASSERT(Splice(p.read, q.write, 100)==IO_WOULDBLOCK);
+	ASSERT(SetFidFlags(q.write, 0)==0);
+
+	/* A blocking Splice waits for the destination */
+	int drain(int argl, void* args) {
+		sleep_msec(20);
+		ASSERT(Read(q.read, big, sizeof(big))==sizeof(big));
+		return 0;
+	}
+	Tid_t t = CreateThread(drain, 0, NULL);
+	ASSERT(Splice(p.read, q.write, 100)==3);
+	ASSERT(ThreadJoin(t, NULL)==0);
+	ASSERT(Read(q.read, a, 4)==3);
+	ASSERT(memcmp(a, "abc", 3)==0);
+
+	/* In a packet pipe, the segments of a write make one message */
+	pipe_t pk;
+	ASSERT(PipeEx(&pk, 0, PIPE_PACKET)==0);
+	ASSERT(WriteV(pk.write, out, 3)==12);
+	ASSERT(Write(pk.write, "next", 5)==5);
+	ASSERT(Read(pk.read, b, 20)==12);
+	ASSERT(strcmp(b, "Hello world")==0);
+	ASSERT(Splice(pk.read, q.write, 100)==5);
+	ASSERT(Read(q.read, b, 20)==5);
+	ASSERT(strcmp(b, "next")==0);
+
+	/* End of data */
+	ASSERT(Close(p.write)==0);
+	ASSERT(Splice(p.read, q.write, 100)==0);
+	return 0;
+}
+
+
+BOOT_TEST(test_pipe_set_size,
+	"Test that the capacity of a pipe can be set, and that the total capacity\n"
+	"of the pipes is limited."
+	)
+{
+	pipe_t pipe;
+	ASSERT(Pipe(&pipe)==0);
+	ASSERT(PipeGetSize(pipe.read)==PIPE_DEFAULT_SIZE);
+	ASSERT(PipeGetSize(pipe.write)==PIPE_DEFAULT_SIZE);
+	ASSERT(PipeGetSize(NOFILE)==-1);
+	ASSERT(PipeSetSize(PIPE_MAX_SIZE+1, 0)==-1);
+
+	/* Growing keeps the data, and makes room for more */
+	const unsigned int N = 100000;
+	char* buf = malloc(N);
+	char* in = malloc(N);
+	for(int i=0; i<N; i++) buf[i] = i % 251;
+	ASSERT(Write(pipe.write, buf, 5000)==5000);
+	ASSERT(Read(pipe.read, buf+50000, 3000)==3000);
+	ASSERT(Write(pipe.write, buf+5000, N-5000)==PIPE_DEFAULT_SIZE-2000);
+	ASSERT(PipeSetSize(pipe.write, 70000)==0);
+	ASSERT(PipeGetSize(pipe.read)==131072);
+	int count = 5000+PIPE_DEFAULT_SIZE-2000;
+	ASSERT(Write(pipe.write, buf+count, N-count)==N-count);
+
+	/* Shrinking fails while the data do not fit */
+	ASSERT(PipeSetSize(pipe.read, PIPE_MIN_SIZE)==-1);
+	count = 3000;
+	while(count < N) {
+		int rc = Read(pipe.read, in+count, N-count);
+		ASSERT(rc > 0);
+		count += rc;
+	}
+	ASSERT(memcmp(in+3000, buf+3000, N-3000)==0);
+	free(in);
+	free(buf);
+	ASSERT(PipeSetSize(pipe.read, 1)==0);
+	ASSERT(PipeGetSize(pipe.write)==PIPE_MIN_SIZE);
+	ASSERT(Close(pipe.read)==0);
+	ASSERT(Close(pipe.write)==0);
+
+	/* A blocked reader waits for no more than the pipe holds after a shrink */
+	ASSERT(PipeEx(&pipe, 4*PIPE_MIN_SIZE, 0)==0);
+	char data[2*PIPE_MIN_SIZE] = {0};
+	int got = 0;
+	int reader(int argl, void* args) {
+		char rbuf[4*PIPE_MIN_SIZE];
+		got = ReadAtLeast(pipe.read, rbuf, sizeof(rbuf), 2*PIPE_MIN_SIZE, TIMEOUT_INFINITE);
+		return 0;
+	}
+	Tid_t t = CreateThread(reader, 0, NULL);
+	sleep_msec(50);
+	ASSERT(PipeSetSize(pipe.write, PIPE_MIN_SIZE)==0);
+	ASSERT(Write(pipe.write, data, PIPE_MIN_SIZE)==PIPE_MIN_SIZE);
+	ASSERT(Write(pipe.write, data, PIPE_MIN_SIZE)==PIPE_MIN_SIZE);
+	ASSERT(ThreadJoin(t, NULL)==0);
+	ASSERT(got==2*PIPE_MIN_SIZE);
+	ASSERT(Close(pipe.read)==0);
+	ASSERT(Close(pipe.write)==0);
+
+	/* Exhaust the memory limit with big pipes */
+	ASSERT(PipeEx(&pipe, PIPE_MAX_SIZE+1, 0)==-1);
+	pipe_t big[PIPE_MEMORY_LIMIT/PIPE_MAX_SIZE];
+	int nbig = 0;
+	while(nbig < PIPE_MEMORY_LIMIT/PIPE_MAX_SIZE && PipeEx(&big[nbig], PIPE_MAX_SIZE, 0)==0) 
+		nbig++;
+	ASSERT(nbig > 0);
+	ASSERT(PipeEx(&pipe, PIPE_MAX_SIZE, 0)==-1);
+
+	/* Pipes of the default size can still be created, but not grown */
+	ASSERT(PipeEx(&pipe, 0, 0)==0);
+	ASSERT(PipeSetSize(pipe.read, PIPE_MAX_SIZE)==-1);
+	ASSERT(PipeGetSize(pipe.read)==PIPE_DEFAULT_SIZE);
+
+	for(int i=0; i<nbig; i++) {
+		ASSERT(Close(big[i].read)==0);
+		ASSERT(Close(big[i].write)==0);
+	}
+	ASSERT(PipeSetSize(pipe.read, PIPE_MAX_SIZE)==0);
+	return 0;
+}
+
+
+BOOT_TEST(test_pipe_poll,
+	"Test readiness and non-blocking I/O on the two ends of a pipe."
+	)
+{
+	pipe_t pipe;
+	ASSERT(Pipe(&pipe)==0);
+	ASSERT(SetFidFlags(pipe.read, FID_NONBLOCK)==0);
+	ASSERT(SetFidFlags(pipe.write, FID_NONBLOCK)==0);
+
+	pollfd_t pfd[2] = {
+		{ .fid = pipe.read, .events = POLL_READ },
+		{ .fid = pipe.write, .events = POLL_WRITE }
+	};
+	ASSERT(Poll(pfd, 2, 0)==1);
+	ASSERT(pfd[0].revents==0 && pfd[1].revents==POLL_WRITE);
+
+	char buf[1024];
+	ASSERT(Read(pipe.read, buf, sizeof(buf))==IO_WOULDBLOCK);
+	ASSERT(ReadTimed(pipe.read, buf, sizeof(buf), 10)==IO_WOULDBLOCK);
+
+	/* Fill it up */
+	int rc, count = 0;
+	while((rc = Write(pipe.write, buf, sizeof(buf))) > 0) count += rc;
+	ASSERT(rc==IO_WOULDBLOCK && count > 0);
+	ASSERT(Poll(pfd, 2, 0)==1);
+	ASSERT(pfd[0].revents==POLL_READ && pfd[1].revents==0);
+
+	/* Drain it */
+	while((rc = Read(pipe.read, buf, sizeof(buf))) > 0) count -= rc;
+	ASSERT(rc==IO_WOULDBLOCK && count==0);
+
+	/* End of data is reported as a hangup */
+	ASSERT(Close(pipe.write)==0);
+	ASSERT(Poll(pfd, 1, 0)==1);
+	ASSERT(pfd[0].revents==(POLL_READ|POLL_HANGUP));
+	ASSERT(Read(pipe.read, buf, sizeof(buf))==0);
+
+	/* Writing with the read end closed is an error */
+	ASSERT(Pipe(&pipe)==0);
+	ASSERT(Close(pipe.read)==0);
+	pfd[1].fid = pipe.write;
+	ASSERT(Poll(pfd+1, 1, 0)==1);
+	ASSERT(pfd[1].revents & POLL_ERROR);
+	ASSERT(Write(pipe.write, buf, 1)==-1);
+	return 0;
+}
+
+
 /* Takes one integer argument, writes that many bytes to stdout.
  */
 int data_producer(int argl, void* args)
@@ -1122,6 +2319,146 @@ int data_consumer(int argl, void* args)
 }
 
 
+BOOT_TEST(test_pipe_watermarks,
+	"Test that blocked readers and writers of a pipe are woken up according\n"
+	"to its watermarks, and that ReadAtLeast returns enough data."
+	)
+{
+	pipe_t pipe;
+	ASSERT(Pipe(&pipe)==0);
+	ASSERT(SetWatermarks(pipe.read, 0, 1)==-1);
+	ASSERT(SetWatermarks(NOFILE, 1, 1)==-1);
+	ASSERT(SetWatermarks(pipe.write, 100, 4096)==0);
+
+	/* Write 100 bytes in small pieces */
+	int small_writer(int argl, void* args) {
+		for(int i=0; i<10; i++)
+			ASSERT(Write(pipe.write, "0123456789", 10)==10);
+		return 0;
+	}
+
+	char buf[PIPE_DEFAULT_SIZE];
+	Tid_t t = CreateThread(small_writer, 0, NULL);
+	ASSERT(Read(pipe.read, buf, sizeof(buf))==100);
+	ASSERT(ThreadJoin(t, NULL)==0);
+
+	/* Poll and non-blocking reads below the watermark */
+	ASSERT(Write(pipe.write, buf, 50)==50);
+	pollfd_t pfd = { .fid = pipe.read, .events = POLL_READ };
+	ASSERT(Poll(&pfd, 1, 0)==0);
+	ASSERT(ReadTimed(pipe.read, buf, sizeof(buf), 0)==50);
+
+	/* A short read waits only for what it asks */
+	ASSERT(Write(pipe.write, buf, 10)==10);
+	ASSERT(Read(pipe.read, buf, 10)==10);
+
+	/* The writer is woken up when 4096 bytes are free */
+	int rc;
+	while((rc = WriteTimed(pipe.write, buf, sizeof(buf), 0)) > 0);
+	ASSERT(rc==IO_TIMEDOUT);
+	int written = 0;
+	int big_writer(int argl, void* args) {
+		written = Write(pipe.write, buf, 4096);
+		return 0;
+	}
+	t = CreateThread(big_writer, 0, NULL);
+	for(int i=0; i<5; i++)
+		ASSERT(Read(pipe.read, buf, 1000)==1000);
+	ASSERT(ThreadJoin(t, NULL)==0);
+	ASSERT(written==4096);
+	while(ReadTimed(pipe.read, buf, sizeof(buf), 0) > 0);
+
+	/* ReadAtLeast, with the default watermarks */
+	ASSERT(SetWatermarks(pipe.read, 1, 1)==0);
+	ASSERT(ReadAtLeast(pipe.read, buf, 10, 11, 0)==-1);
+	t = CreateThread(small_writer, 0, NULL);
+	ASSERT(ReadAtLeast(pipe.read, buf, sizeof(buf), 100, TIMEOUT_INFINITE)==100);
+	ASSERT(ThreadJoin(t, NULL)==0);
+	ASSERT(Write(pipe.write, buf, 5)==5);
+	ASSERT(ReadAtLeast(pipe.read, buf, sizeof(buf), 10, 20)==5);
+	ASSERT(ReadAtLeast(pipe.read, buf, sizeof(buf), 10, 0)==IO_TIMEDOUT);
+	ASSERT(Write(pipe.write, buf, 5)==5);
+	ASSERT(Close(pipe.write)==0);
+	ASSERT(ReadAtLeast(pipe.read, buf, sizeof(buf), 10, TIMEOUT_INFINITE)==5);
+	ASSERT(ReadAtLeast(pipe.read, buf, sizeof(buf), 10, TIMEOUT_INFINITE)==0);
+	ASSERT(Close(pipe.read)==0);
+	return 0;
+}
+
+
+BOOT_TEST(test_pipe_packet,
+	"Test that a packet pipe preserves the boundaries of writes."
+	)
+{
+	pipe_t pipe;
+	ASSERT(PipeEx(&pipe, 0, 42)==-1);
+	ASSERT(PipeEx(&pipe, 0, PIPE_PACKET)==0);
+	ASSERT(SetWatermarks(pipe.read, 10, 10)==-1);
+
+	char buf[PIPE_DEFAULT_SIZE];
+	ASSERT(Write(pipe.write, "Hello", 5)==5);
+	ASSERT(Write(pipe.write, "World!", 6)==6);
+	ASSERT(Write(pipe.write, buf, 0)==0);
+	ASSERT(Read(pipe.read, buf, sizeof(buf))==5);
+	ASSERT(memcmp(buf, "Hello", 5)==0);
+	ASSERT(Read(pipe.read, buf, sizeof(buf))==6);
+	ASSERT(memcmp(buf, "World!", 6)==0);
+
+	/* The rest of a long message is discarded */
+	ASSERT(Write(pipe.write, "0123456789", 10)==10);
+	ASSERT(Write(pipe.write, "abc", 3)==3);
+	ASSERT(Read(pipe.read, buf, 4)==4);
+	ASSERT(memcmp(buf, "0123", 4)==0);
+	ASSERT(Read(pipe.read, buf, sizeof(buf))==3);
+	ASSERT(memcmp(buf, "abc", 3)==0);
+
+	/* A message must fit whole */
+	ASSERT(Write(pipe.write, buf, PIPE_DEFAULT_SIZE)==-1);
+	ASSERT(Write(pipe.write, buf, 100)==100);
+	ASSERT(WriteTimed(pipe.write, buf, PIPE_DEFAULT_SIZE-100, 0)==IO_TIMEDOUT);
+	ASSERT(Read(pipe.read, buf, sizeof(buf))==100);
+
+	/* A blocked message that no longer fits after a shrink fails */
+	ASSERT(PipeSetSize(pipe.write, 2*PIPE_DEFAULT_SIZE)==0);
+	ASSERT(Write(pipe.write, buf, PIPE_DEFAULT_SIZE-1000)==PIPE_DEFAULT_SIZE-1000);
+	int big = 0;
+	int big_writer(int argl, void* args) {
+		char msg[PIPE_DEFAULT_SIZE+1000] = {0};
+		big = Write(pipe.write, msg, sizeof(msg));
+		return 0;
+	}
+	Tid_t t = CreateThread(big_writer, 0, NULL);
+	sleep_msec(50);
+	ASSERT(PipeSetSize(pipe.write, PIPE_DEFAULT_SIZE)==0);
+	ASSERT(Read(pipe.read, buf, sizeof(buf))==PIPE_DEFAULT_SIZE-1000);
+	ASSERT(ThreadJoin(t, NULL)==0);
+	ASSERT(big==-1);
+
+	/* Messages of many sizes, across the end of the buffer */
+	int writer(int argl, void* args) {
+		char msg[1000];
+		for(int i=1; i<1000; i++) {
+			memset(msg, i, i);
+			ASSERT(Write(pipe.write, msg, i)==i);
+		}
+		return 0;
+	}
+	t = CreateThread(writer, 0, NULL);
+	for(int i=1; i<1000; i++) {
+		ASSERT(Read(pipe.read, buf, sizeof(buf))==i);
+		ASSERT((unsigned char)buf[0]==(unsigned char)i && (unsigned char)buf[i-1]==(unsigned char)i);
+	}
+	ASSERT(ThreadJoin(t, NULL)==0);
+
+	ASSERT(Write(pipe.write, "end", 3)==3);
+	ASSERT(Close(pipe.write)==0);
+	ASSERT(Read(pipe.read, buf, sizeof(buf))==3);
+	ASSERT(Read(pipe.read, buf, sizeof(buf))==0);
+	ASSERT(Close(pipe.read)==0);
+	return 0;
+}
+
+
 BOOT_TEST(test_pipe_single_producer,
 	"Test blocking in the pipe by a single producer single consumer sending 10Mbytes of data."
 	)
@@ -1209,6 +2546,12 @@ TEST_SUITE(pipe_tests,
 	&test_pipe_fails_on_exhausted_fid,
 	&test_pipe_close_reader,
 	&test_pipe_close_writer,
+	&test_pipe_wraparound,
+	&test_pipe_vectored_splice,
+	&test_pipe_poll,
+	&test_pipe_set_size,
+	&test_pipe_watermarks,
+	&test_pipe_packet,
 	&test_pipe_single_producer,
 	&test_pipe_multi_producer,
 	NULL
@@ -1736,6 +3079,686 @@ BOOT_TEST(test_shudown_write,
 }
 
 
+BOOT_TEST(test_socket_poll,
+	"Test readiness and non-blocking Accept on sockets."
+	)
+{
+	Fid_t lsock = Socket(100);  ASSERT(lsock!=NOFILE);
+	ASSERT(Listen(lsock)==0);
+	ASSERT(SetFidFlags(lsock, FID_NONBLOCK)==0);
+	ASSERT(Accept(lsock)==IO_WOULDBLOCK);
+
+	pollfd_t pfd[2] = { { .fid = lsock, .events = POLL_READ } };
+	ASSERT(Poll(pfd, 1, 0)==0);
+
+	/* A pending connection makes the listener readable */
+	Fid_t cli = Socket(NOPORT);  ASSERT(cli!=NOFILE);
+	int connect_thread(int argl, void* args) {
+		ASSERT(Connect(cli, 100, 1000)==0);
+		return 0;
+	}
+	Tid_t t = CreateThread(connect_thread, 0, NULL);
+	ASSERT(Poll(pfd, 1, 1000)==1);
+	ASSERT(pfd[0].revents==POLL_READ);
+
+	Fid_t srv = Accept(lsock);
+	ASSERT(srv!=NOFILE && srv>=0);
+	ASSERT(ThreadJoin(t, NULL)==0);
+	ASSERT(Poll(pfd, 1, 0)==0);
+
+	/* A peer is writable, and readable when data has arrived */
+	pfd[0] = (pollfd_t){ .fid = srv, .events = POLL_READ|POLL_WRITE };
+	pfd[1] = (pollfd_t){ .fid = cli, .events = POLL_READ|POLL_WRITE };
+	ASSERT(Poll(pfd, 2, 0)==2);
+	ASSERT(pfd[0].revents==POLL_WRITE && pfd[1].revents==POLL_WRITE);
+
+	ASSERT(Write(cli, "Hello", 6)==6);
+	ASSERT(Poll(pfd, 2, 0)==2);
+	ASSERT(pfd[0].revents==(POLL_READ|POLL_WRITE));
+
+	/* Shutting down the writer is seen as a hangup by the reader */
+	ASSERT(ShutDown(cli, SHUTDOWN_WRITE)==0);
+	ASSERT(Poll(pfd, 1, 0)==1);
+	ASSERT(pfd[0].revents & POLL_HANGUP);
+
+	char buf[6];
+	ASSERT(Read(srv, buf, 6)==6);
+	ASSERT(Read(srv, buf, 6)==0);
+	return 0;
+}
+
+
+BOOT_TEST(test_connect_nonblocking,
+	"Test that a non-blocking Connect queues its request, reports the outcome\n"
+	"through Poll, and that only one thread at a time connects a socket."
+	)
+{
+	Fid_t lsock = Socket(100);  ASSERT(lsock!=NOFILE);
+	ASSERT(Listen(lsock)==0);
+
+	/* The request stays queued until it is accepted */
+	Fid_t cli = Socket(NOPORT);  ASSERT(cli!=NOFILE);
+	ASSERT(SetFidFlags(cli, FID_NONBLOCK)==0);
+	ASSERT(Connect(cli, 100, 1000)==IO_WOULDBLOCK);
+	ASSERT(Connect(cli, 100, 1000)==IO_WOULDBLOCK);
+	pollfd_t pfd = { .fid = cli, .events = POLL_WRITE|POLL_ERROR };
+	ASSERT(Poll(&pfd, 1, 0)==0);
+
+	Fid_t srv = Accept(lsock);
+	ASSERT(srv!=NOFILE && srv>=0);
+	ASSERT(Poll(&pfd, 1, 0)==1);
+	ASSERT(pfd.revents==POLL_WRITE);
+	ASSERT(Connect(cli, 100, 1000)==0);
+	ASSERT(Connect(cli, 100, 1000)==-1);
+
+	char buf[6];
+	ASSERT(Write(cli, "Hello", 6)==6);
+	ASSERT(Read(srv, buf, 6)==6);
+
+	/* A refused request is an error */
+	Fid_t cli2 = Socket(NOPORT);  ASSERT(cli2!=NOFILE);
+	ASSERT(SetFidFlags(cli2, FID_NONBLOCK)==0);
+	ASSERT(Connect(cli2, 100, 1000)==IO_WOULDBLOCK);
+	ASSERT(Close(lsock)==0);
+	pfd.fid = cli2;
+	ASSERT(Poll(&pfd, 1, 0)==1);
+	ASSERT(pfd.revents==POLL_ERROR);
+	ASSERT(Connect(cli2, 100, 1000)==-1);
+
+	/* An expired or closed request leaves the listener's queue */
+	lsock = Socket(101);  ASSERT(lsock!=NOFILE);
+	ASSERT(Listen(lsock)==0);
+	ASSERT(SetFidFlags(lsock, FID_NONBLOCK)==0);
+	ASSERT(Connect(cli2, 101, 20)==IO_WOULDBLOCK);
+	sleep_msec(40);
+	ASSERT(Connect(cli2, 101, 20)==-1);
+	ASSERT(Accept(lsock)==IO_WOULDBLOCK);
+	ASSERT(Connect(cli2, 101, 1000)==IO_WOULDBLOCK);
+	ASSERT(Close(cli2)==0);
+	ASSERT(Accept(lsock)==IO_WOULDBLOCK);
+
+	/* A second thread cannot connect a socket that is being connected */
+	Fid_t cli3 = Socket(NOPORT);  ASSERT(cli3!=NOFILE);
+	int connect_thread(int argl, void* args) {
+		*(int*)args = Connect(cli3, 101, TIMEOUT_INFINITE);
+		return 0;
+	}
+	int rc = -10;
+	Tid_t t = CreateThread(connect_thread, 0, &rc);
+	sleep_msec(20);
+	ASSERT(Connect(cli3, 101, 1000)==-1);
+	ASSERT(SetFidFlags(lsock, 0)==0);
+	srv = Accept(lsock);
+	ASSERT(srv!=NOFILE && srv>=0);
+	ASSERT(ThreadJoin(t, NULL)==0);
+	ASSERT(rc==0);
+
+	/* Only one connection was made */
+	ASSERT(SetFidFlags(lsock, FID_NONBLOCK)==0);
+	ASSERT(Accept(lsock)==IO_WOULDBLOCK);
+	return 0;
+}
+
+
+/* A socket connecting in its own thread */
+typedef struct {
+	Fid_t cli;
+	port_t port;
+	Tid_t tid;
+	int ok;
+} connect_req;
+
+static int connect_req_thread(int argl, void* args)
+{
+	connect_req* req = args;
+	req->ok = (Connect(req->cli, req->port, 5000)==0);
+	return 0;
+}
+
+/* Start n connections to a port, and give them time to queue their requests */
+static void start_connects(connect_req* req, unsigned int n, port_t port)
+{
+	for(unsigned int i=0; i<n; i++) {
+		req[i].cli = Socket(NOPORT);  ASSERT(req[i].cli!=NOFILE);
+		req[i].port = port;
+		req[i].ok = 0;
+		req[i].tid = CreateThread(connect_req_thread, 0, &req[i]);
+		ASSERT(req[i].tid!=NOTHREAD);
+	}
+	sleep_msec(200);
+}
+
+/* Wait for n connections to finish, and check that they succeeded */
+static void finish_connects(connect_req* req, unsigned int n)
+{
+	for(unsigned int i=0; i<n; i++) {
+		ASSERT(ThreadJoin(req[i].tid, NULL)==0);
+		ASSERT(req[i].ok);
+	}
+}
+
+
+BOOT_TEST(test_accept_many,
+	"Test that AcceptMany takes all the pending connections in one call."
+	)
+{
+	Fid_t lsock = Socket(100);  ASSERT(lsock!=NOFILE);
+	ASSERT(Listen(lsock)==0);
+
+	Fid_t fids[8];
+	ASSERT(AcceptMany(lsock, fids, 0)==-1);
+	ASSERT(AcceptMany(NOFILE, fids, 8)==-1);
+
+	connect_req req[3];
+	start_connects(req, 3, 100);
+	ASSERT(AcceptMany(lsock, fids, 8)==3);
+	finish_connects(req, 3);
+
+	/* Each connection has its own pair */
+	for(int i=0; i<3; i++) {
+		ASSERT(Write(req[i].cli, "abc", 4)==4);
+		int found = 0;
+		for(int j=0; j<3; j++) {
+			char buf[4];
+			if(ReadTimed(fids[j], buf, 4, 0)==4) found++;
+		}
+		ASSERT(found==1);
+	}
+
+	ASSERT(SetFidFlags(lsock, FID_NONBLOCK)==0);
+	ASSERT(AcceptMany(lsock, fids, 8)==IO_WOULDBLOCK);
+	return 0;
+}
+
+
+BOOT_TEST(test_listen_reuseport,
+	"Test that listeners can share a port, and connections are spread over them."
+	)
+{
+	Fid_t l1 = Socket(100);  ASSERT(l1!=NOFILE);
+	Fid_t l2 = Socket(100);  ASSERT(l2!=NOFILE);
+	Fid_t l3 = Socket(100);  ASSERT(l3!=NOFILE);
+
+	ASSERT(ListenEx(l1, LISTEN_BYCORE)==-1);
+	ASSERT(ListenEx(l1, LISTEN_BYCORE|LISTEN_PACKET)==-1);
+	ASSERT(ListenEx(l1, 8)==-1);
+	ASSERT(ListenEx(l1, LISTEN_REUSEPORT)==0);
+	ASSERT(Listen(l3)==-1);
+	ASSERT(ListenEx(l3, LISTEN_REUSEPORT|LISTEN_BYCORE)==-1);
+	ASSERT(ListenEx(l2, LISTEN_REUSEPORT)==0);
+
+	/* Connections are spread in turn */
+	connect_req req[4];
+	start_connects(req, 4, 100);
+
+	Fid_t fids[4];
+	ASSERT(AcceptMany(l1, fids, 4)==2);
+	ASSERT(AcceptMany(l2, fids+2, 2)==2);
+	finish_connects(req, 4);
+
+	/* When a listener goes, the others get all the connections */
+	ASSERT(Close(l1)==0);
+	start_connects(req, 2, 100);
+	ASSERT(AcceptMany(l2, fids, 4)==2);
+	finish_connects(req, 2);
+
+	/* With the last one gone, the port is free */
+	ASSERT(Close(l2)==0);
+	ASSERT(Listen(l3)==0);
+	return 0;
+}
+
+
+BOOT_TEST(test_socket_direct_write,
+	"Test that large writes on sockets are passed to the reader whole and in order."
+	)
+{
+	Fid_t lsock = Socket(100);  ASSERT(lsock!=NOFILE);
+	ASSERT(Listen(lsock)==0);
+	Fid_t cli = Socket(NOPORT);  ASSERT(cli!=NOFILE);
+	Fid_t srv;
+	connect_sockets(cli, lsock, &srv, 100);
+
+	const unsigned int N = 1<<20;
+	char* out = malloc(N);
+	char* in = malloc(N+16);
+	for(unsigned int i=0; i<N; i++) out[i] = (char) (i*7 + i/251);
+
+	/* A small write goes first, then a large one, then a small one */
+	int writer(int argl, void* args) {
+		ASSERT(Write(cli, "head", 4)==4);
+		ASSERT(Write(cli, out, N)==N);
+		ASSERT(Write(cli, "tail", 4)==4);
+		return 0;
+	}
+	Tid_t t = CreateThread(writer, 0, NULL);
+
+	ASSERT(ReadAtLeast(srv, in, 4, 4, TIMEOUT_INFINITE)==4);
+	ASSERT(memcmp(in, "head", 4)==0);
+	unsigned int count = 0;
+	while(count < N+4) {
+		int rc = Read(srv, in+count, N+4-count);
+		ASSERT(rc > 0);
+		count += rc;
+	}
+	ASSERT(memcmp(in, out, N)==0);
+	ASSERT(memcmp(in+N, "tail", 4)==0);
+	ASSERT(ThreadJoin(t, NULL)==0);
+
+	/* A large write that the reader stops taking returns what was read */
+	int partial = 0;
+	int writer2(int argl, void* args) {
+		partial = Write(srv, out, N);
+		return 0;
+	}
+	t = CreateThread(writer2, 0, NULL);
+	ASSERT(ReadAtLeast(cli, in, 1000, 1000, TIMEOUT_INFINITE)==1000);
+	ASSERT(memcmp(in, out, 1000)==0);
+	ASSERT(ShutDown(cli, SHUTDOWN_READ)==0);
+	ASSERT(ThreadJoin(t, NULL)==0);
+	ASSERT(partial >= 1000 && partial < N);
+
+	/* A splice passes on the buffer of a direct writer too */
+	t = CreateThread(writer, 0, NULL);
+	pipe_t p;
+	ASSERT(Pipe(&p)==0);
+	int reader(int argl, void* args) {
+		unsigned int count = 0;
+		while(count < N+8) {
+			int rc = Read(p.read, in+count, N+8-count);
+			ASSERT(rc > 0);
+			count += rc;
+		}
+		return 0;
+	}
+	Tid_t r = CreateThread(reader, 0, NULL);
+	unsigned int moved = 0;
+	while(moved < N+8) {
+		int rc = Splice(srv, p.write, N+8-moved);
+		ASSERT(rc > 0);
+		moved += rc;
+	}
+	ASSERT(ThreadJoin(r, NULL)==0);
+	ASSERT(ThreadJoin(t, NULL)==0);
+	ASSERT(memcmp(in, "head", 4)==0);
+	ASSERT(memcmp(in+4, out, N)==0);
+	ASSERT(memcmp(in+N+4, "tail", 4)==0);
+
+	/* Vectored I/O goes through the pipes of the sockets */
+	iovec_t wv[2] = { { "ab", 2 }, { "cde", 3 } };
+	char x[2], y[8];
+	iovec_t rv[2] = { { x, 2 }, { y, 8 } };
+	ASSERT(WriteV(cli, wv, 2)==5);
+	ASSERT(ReadV(srv, rv, 2)==5);
+	ASSERT(memcmp(x, "ab", 2)==0 && memcmp(y, "cde", 3)==0);
+
+	free(out);
+	free(in);
+	return 0;
+}
+
+
+BOOT_TEST(test_socket_packet,
+	"Test that the connections of a LISTEN_PACKET listener carry messages."
+	)
+{
+	Fid_t lsock = Socket(100);  ASSERT(lsock!=NOFILE);
+	ASSERT(ListenEx(lsock, LISTEN_PACKET)==0);
+	Fid_t cli = Socket(NOPORT);  ASSERT(cli!=NOFILE);
+	Fid_t srv;
+	connect_sockets(cli, lsock, &srv, 100);
+
+	/* Each write is a message, in both directions */
+	ASSERT(Write(cli, "abc", 3)==3);
+	iovec_t iov[2] = { { "de", 2 }, { "fgh", 3 } };
+	ASSERT(WriteV(cli, iov, 2)==5);
+	char buf[16];
+	ASSERT(Read(srv, buf, 16)==3);
+	ASSERT(Read(srv, buf, 16)==5);
+	ASSERT(memcmp(buf, "defgh", 5)==0);
+
+	ASSERT(Write(srv, "reply", 6)==6);
+	ASSERT(Read(cli, buf, 3)==3);
+	ASSERT(SetFidFlags(cli, FID_NONBLOCK)==0);
+	ASSERT(Read(cli, buf, 16)==IO_WOULDBLOCK);
+
+	/* A message must fit in the buffer, and there are no watermarks */
+	static char big[PIPE_DEFAULT_SIZE];
+	ASSERT(Write(cli, big, sizeof(big))==-1);
+	ASSERT(SetWatermarks(cli, 1, 1)==-1);
+
+	/* The end of the messages */
+	ASSERT(ShutDown(cli, SHUTDOWN_WRITE)==0);
+	ASSERT(Read(srv, buf, 16)==0);
+	return 0;
+}
+
+
+BOOT_TEST(test_socket_watermarks,
+	"Test the watermarks of connected sockets."
+	)
+{
+	Fid_t lsock = Socket(100);  ASSERT(lsock!=NOFILE);
+	ASSERT(Listen(lsock)==0);
+	ASSERT(SetWatermarks(lsock, 1, 1)==-1);
+	Fid_t cli = Socket(NOPORT);  ASSERT(cli!=NOFILE);
+	ASSERT(SetWatermarks(cli, 1, 1)==-1);
+	Fid_t srv;
+	connect_sockets(cli, lsock, &srv, 100);
+	ASSERT(SetWatermarks(cli, 0, 1)==-1);
+
+	/* The reader watermark of cli is for the data sent by srv */
+	ASSERT(SetWatermarks(cli, 100, 1)==0);
+	char buf[100] = {0};
+	ASSERT(Write(srv, buf, 50)==50);
+	pollfd_t pfd = { .fid = cli, .events = POLL_READ };
+	ASSERT(Poll(&pfd, 1, 0)==0);
+
+	int got = 0;
+	int reader(int argl, void* args) {
+		char rbuf[200];
+		got = Read(cli, rbuf, sizeof(rbuf));
+		return 0;
+	}
+	Tid_t t = CreateThread(reader, 0, NULL);
+	sleep_msec(50);
+	ASSERT(got==0);
+	ASSERT(Write(srv, buf, 50)==50);
+	ASSERT(ThreadJoin(t, NULL)==0);
+	ASSERT(got==100);
+
+	/* The data sent by cli are not affected */
+	ASSERT(Write(cli, buf, 10)==10);
+	pfd.fid = srv;
+	ASSERT(Poll(&pfd, 1, 0)==1);
+	ASSERT(Read(srv, buf, sizeof(buf))==10);
+	return 0;
+}
+
+
+BOOT_TEST(test_shutdown_wakes_blocked,
+	"Test that ShutDown wakes up the threads blocked on either socket, and that they fail."
+	)
+{
+	Fid_t lsock = Socket(100);  ASSERT(lsock!=NOFILE);
+	ASSERT(Listen(lsock)==0);
+	Fid_t cli = Socket(NOPORT);  ASSERT(cli!=NOFILE);
+	Fid_t srv;
+	connect_sockets(cli, lsock, &srv, 100);
+
+	/* Write until blocked, then until failure. The result goes in *args */
+	int fill(int argl, void* args) {
+		char buf[1024] = {0};
+		int rc;
+		while((rc = Write(argl, buf, sizeof(buf))) > 0);
+		*(int*)args = rc;
+		return 0;
+	}
+	int drain(int argl, void* args) {
+		char buf[1024];
+		*(int*)args = Read(argl, buf, sizeof(buf));
+		return 0;
+	}
+
+	/* A reader and a writer of cli fail */
+	int rc[2];
+	Tid_t t[2];
+	t[0] = CreateThread(drain, cli, rc);
+	t[1] = CreateThread(fill, cli, rc+1);
+	sleep_msec(100);
+	ASSERT(ShutDown(cli, SHUTDOWN_BOTH)==0);
+	for(int i=0; i<2; i++) {
+		ASSERT(ThreadJoin(t[i], NULL)==0);
+		ASSERT(rc[i]==-1);
+	}
+
+	/* The data written by cli before the shutdown are still there */
+	char buf[1024];
+	ASSERT(Read(srv, buf, sizeof(buf))==sizeof(buf));
+
+	/* A writer of the peer fails, and its data are dropped */
+	Fid_t cli2 = Socket(NOPORT);  ASSERT(cli2!=NOFILE);
+	Fid_t srv2;
+	connect_sockets(cli2, lsock, &srv2, 100);
+	t[0] = CreateThread(fill, srv2, rc);
+	sleep_msec(100);
+	ASSERT(ShutDown(cli2, SHUTDOWN_READ)==0);
+	ASSERT(ThreadJoin(t[0], NULL)==0);
+	ASSERT(rc[0]==-1);
+	ASSERT(Read(cli2, buf, sizeof(buf))==-1);
+
+	/* Closing many connections with blocked readers on both sides */
+	const int N = 50;
+	Fid_t c[N], sv[N];
+	Tid_t tc[N], ts[N];
+	int rcc[N], rcs[N];
+	for(int i=0; i<N; i++) {
+		c[i] = Socket(NOPORT);  ASSERT(c[i]!=NOFILE);
+		connect_sockets(c[i], lsock, sv+i, 100);
+		tc[i] = CreateThread(drain, c[i], rcc+i);
+		ts[i] = CreateThread(drain, sv[i], rcs+i);
+	}
+	sleep_msec(100);
+
+	/* The readers of c[i] fail, and the readers of sv[i] get the end of data */
+	for(int i=0; i<N; i++)
+		ASSERT(ShutDown(c[i], SHUTDOWN_READ)==0);
+	for(int i=0; i<N; i++) {
+		ASSERT(ThreadJoin(tc[i], NULL)==0);  ASSERT(rcc[i]==-1);
+		ASSERT(Close(c[i])==0);
+		ASSERT(ThreadJoin(ts[i], NULL)==0);  ASSERT(rcs[i]==0);
+		ASSERT(Close(sv[i])==0);
+	}
+
+	return 0;
+}
+
+
+BOOT_TEST(test_dgram_basic,
+	"Test sending and receiving datagrams."
+	)
+{
+	Fid_t a = SocketDgram(100);  ASSERT(a!=NOFILE);
+	Fid_t b = SocketDgram(NOPORT);  ASSERT(b!=NOFILE);
+	ASSERT(SocketDgram(100)==NOFILE);
+	ASSERT(SocketDgram(MAX_PORT+1)==NOFILE);
+
+	/* Stream sockets have their own ports */
+	Fid_t lsock = Socket(100);  ASSERT(lsock!=NOFILE);
+	ASSERT(Listen(lsock)==0);
+	ASSERT(Listen(a)==-1);
+	ASSERT(Connect(a, 100, 10)==-1);
+
+	ASSERT(SendTo(b, 101, "hello", 6)==-1);
+	ASSERT(SendTo(lsock, 100, "hello", 6)==-1);
+	ASSERT(SendTo(b, 100, "hello", DGRAM_MAX_SIZE+1)==-1);
+	ASSERT(Write(b, "hello", 6)==-1);
+
+	ASSERT(SendTo(b, 100, "hello", 6)==6);
+	ASSERT(SendTo(a, 100, "world!", 7)==7);
+	ASSERT(SendTo(b, 100, "", 0)==0);
+
+	/* Datagrams arrive whole and in order, with the sender's port */
+	char buf[16];
+	port_t port = 0;
+	ASSERT(RecvFrom(a, &port, buf, sizeof(buf))==6);
+	ASSERT(port==NOPORT && strcmp(buf, "hello")==0);
+	ASSERT(RecvFrom(a, &port, buf, 3)==3);
+	ASSERT(port==100 && memcmp(buf, "wor", 3)==0);
+	ASSERT(Read(a, buf, sizeof(buf))==0);
+
+	/* The rest of a datagram was discarded */
+	ASSERT(SetFidFlags(a, FID_NONBLOCK)==0);
+	ASSERT(RecvFrom(a, &port, buf, sizeof(buf))==IO_WOULDBLOCK);
+	ASSERT(RecvFrom(b, &port, buf, sizeof(buf))==-1);
+
+	pollfd_t pfd = { .fid = a, .events = POLL_READ };
+	ASSERT(Poll(&pfd, 1, 0)==0);
+	ASSERT(SendTo(b, 100, "x", 1)==1);
+	ASSERT(Poll(&pfd, 1, 0)==1 && pfd.revents==POLL_READ);
+
+	/* A closed port is free again */
+	ASSERT(Close(a)==0);
+	ASSERT(SendTo(b, 100, "x", 1)==-1);
+	ASSERT(SocketDgram(100)!=NOFILE);
+	return 0;
+}
+
+
+BOOT_TEST(test_dgram_queue,
+	"Test the bounded queue of datagram sockets, with backpressure and with drops."
+	)
+{
+	Fid_t a = SocketDgram(100);  ASSERT(a!=NOFILE);
+	Fid_t b = SocketDgram(200);  ASSERT(b!=NOFILE);
+
+	ASSERT(DgramSetQueue(a, DGRAM_MAX_SIZE-1, DGRAM_DROP)==-1);
+	ASSERT(DgramSetQueue(a, DGRAM_QUEUE_MAX+1, DGRAM_DROP)==-1);
+	ASSERT(DgramSetQueue(a, 0, 2)==-1);
+	ASSERT(DgramSetQueue(a, DGRAM_MAX_SIZE, DGRAM_DROP)==0);
+
+	/* A full queue drops */
+	char msg[1024] = {0};
+	for(int i=0; i<10; i++) {
+		msg[0] = i;
+		ASSERT(SendTo(b, 100, msg, sizeof(msg))==sizeof(msg));
+	}
+	ASSERT(DgramSetQueue(a, DGRAM_MAX_SIZE, DGRAM_BACKPRESSURE)==2);
+
+	char buf[1024];
+	for(int i=0; i<8; i++) {
+		ASSERT(RecvFrom(a, NULL, buf, sizeof(buf))==sizeof(buf));
+		ASSERT(buf[0]==i);
+	}
+
+	/* A full queue blocks, or fails a non-blocking sender */
+	for(int i=0; i<8; i++)
+		ASSERT(SendTo(b, 100, msg, sizeof(msg))==sizeof(msg));
+	ASSERT(SetFidFlags(b, FID_NONBLOCK)==0);
+	ASSERT(SendTo(b, 100, msg, sizeof(msg))==IO_WOULDBLOCK);
+	ASSERT(SetFidFlags(b, 0)==0);
+
+	int sent = 0;
+	int sender(int argl, void* args) {
+		sent = SendTo(b, 100, msg, sizeof(msg));
+		return 0;
+	}
+	Tid_t t = CreateThread(sender, 0, NULL);
+	ASSERT(RecvFrom(a, NULL, buf, sizeof(buf))==sizeof(buf));
+	ASSERT(ThreadJoin(t, NULL)==0);
+	ASSERT(sent==sizeof(msg));
+
+	/* Closing the receiver fails the senders */
+	t = CreateThread(sender, 0, NULL);
+	ASSERT(Close(a)==0);
+	ASSERT(ThreadJoin(t, NULL)==0);
+	ASSERT(sent==-1);
+	return 0;
+}
+
+
+BOOT_TEST(test_dgram_close_while_blocked,
+	"Test that closing a datagram socket with a blocked receiver takes effect when the receiver returns."
+	)
+{
+	Fid_t a = SocketDgram(100);  ASSERT(a!=NOFILE);
+	Fid_t b = SocketDgram(NOPORT);  ASSERT(b!=NOFILE);
+
+	int received = 0;
+	int receiver(int argl, void* args) {
+		char buf[16];
+		received = RecvFrom(a, NULL, buf, sizeof(buf));
+		return 0;
+	}
+	Tid_t t = CreateThread(receiver, 0, NULL);
+	sleep_msec(100);
+
+	/* The socket stays bound until the receiver is done with it */
+	ASSERT(Close(a)==0);
+	ASSERT(SocketDgram(100)==NOFILE);
+	ASSERT(SendTo(b, 100, "hello", 6)==6);
+	ASSERT(ThreadJoin(t, NULL)==0);
+	ASSERT(received==6);
+
+	ASSERT(SendTo(b, 100, "hello", 6)==-1);
+	ASSERT(SocketDgram(100)!=NOFILE);
+	return 0;
+}
+
+
+BOOT_TEST(test_host_socket,
+	"Test that a host program can connect to a host socket and exchange data."
+	)
+{
+	char path[64];
+	sprintf(path, "/tmp/tinyos_hostsock_%d", getpid());
+	Fid_t lsock = HostListen(path);  ASSERT(lsock!=NOFILE);
+	ASSERT(HostAccept(NOFILE)==NOFILE);
+	ASSERT(HostAccept(OpenNull())==NOFILE);
+
+	char buf[16];
+	ASSERT(Read(lsock, buf, sizeof(buf))==-1);
+	ASSERT(SetFidFlags(lsock, FID_NONBLOCK)==0);
+	ASSERT(HostAccept(lsock)==IO_WOULDBLOCK);
+	ASSERT(SetFidFlags(lsock, 0)==0);
+	pollfd_t pfd = { lsock, POLL_READ, 0 };
+	ASSERT(Poll(&pfd, 1, 0)==0);
+
+	/* This is the host program */
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	ASSERT(fd!=-1);
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	strcpy(addr.sun_path, path);
+	ASSERT(connect(fd, (struct sockaddr*) &addr, sizeof(addr))==0);
+	ASSERT(write(fd, "ping", 5)==5);
+
+	/* The pending connection makes the listener readable */
+	ASSERT(Poll(&pfd, 1, 1000)==1 && pfd.revents==POLL_READ);
+	Fid_t conn = HostAccept(lsock);  ASSERT(conn!=NOFILE);
+	ASSERT(Read(conn, buf, sizeof(buf))==5);
+	ASSERT(strcmp(buf, "ping")==0);
+	pfd = (pollfd_t){ conn, POLL_READ|POLL_WRITE, 0 };
+	ASSERT(Poll(&pfd, 1, 0)==1 && pfd.revents==POLL_WRITE);
+	ASSERT(Write(conn, "pong", 5)==5);
+	ASSERT(read(fd, buf, sizeof(buf))==5);
+	ASSERT(strcmp(buf, "pong")==0);
+
+	/* A blocked reader is woken up when the data arrives */
+	int host_writer(int argl, void* args) {
+		Mutex mx = MUTEX_INIT;
+		CondVar cv = COND_INIT;
+		Mutex_Lock(&mx);
+		Cond_TimedWait(&mx, &cv, 100);
+		Mutex_Unlock(&mx);
+		ASSERT(write(fd, "later", 6)==6);
+		return 0;
+	}
+	Tid_t t = CreateThread(host_writer, 0, NULL);
+	ASSERT(Read(conn, buf, sizeof(buf))==6);
+	ASSERT(strcmp(buf, "later")==0);
+	ASSERT(ThreadJoin(t, NULL)==0);
+
+	/* And so is a thread blocked in Poll */
+	pfd = (pollfd_t){ conn, POLL_READ, 0 };
+	t = CreateThread(host_writer, 0, NULL);
+	ASSERT(Poll(&pfd, 1, TIMEOUT_INFINITE)==1 && pfd.revents==POLL_READ);
+	ASSERT(Read(conn, buf, sizeof(buf))==6);
+	ASSERT(ThreadJoin(t, NULL)==0);
+
+	/* The host program goes away */
+	close(fd);
+	pfd = (pollfd_t){ conn, POLL_READ, 0 };
+	ASSERT(Poll(&pfd, 1, 1000)==1 && pfd.revents==POLL_READ);
+	ASSERT(Read(conn, buf, sizeof(buf))==0);
+	ASSERT(Write(conn, "x", 1)==-1);
+	ASSERT(Close(conn)==0);
+
+	ASSERT(Close(lsock)==0);
+	ASSERT(access(path, F_OK)==-1);
+	return 0;
+}
+
+
 
 
 TEST_SUITE(socket_tests,
@@ -1773,6 +3796,21 @@ TEST_SUITE(socket_tests,
 	&test_shudown_read,
 	&test_shudown_write,
 
+	&test_socket_poll,
+	&test_connect_nonblocking,
+	&test_accept_many,
+	&test_listen_reuseport,
+	&test_socket_direct_write,
+	&test_socket_packet,
+	&test_socket_watermarks,
+	&test_shutdown_wakes_blocked,
+
+	&test_dgram_basic,
+	&test_dgram_queue,
+	&test_dgram_close_while_blocked,
+
+	&test_host_socket,
+
 	NULL
 };
 
@@ -1938,6 +3976,39 @@ BARE_TEST(test_parallelism,
 
 
 
+BOOT_TEST(test_concurrent_open_close,
+	"Test that many processes opening and closing files concurrently\n"
+	"never share an FCB by mistake.",
+	.timeout = 30
+	)
+{
+	int opener(int argl, void* args) {
+		for(int round=0; round<200; round++) {
+			Fid_t f[40];
+			for(int i=0; i<40; i++)
+				ASSERT((f[i] = OpenNull()) != NOFILE);
+			/* Each fid still refers to a live null stream */
+			for(int i=0; i<40; i++) {
+				char c = 1;
+				ASSERT(Read(f[i], &c, 1)==1 && c==0);
+			}
+			for(int i=0; i<40; i++)
+				ASSERT(Close(f[i])==0);
+		}
+		return 0;
+	}
+
+	for(int i=0; i<8; i++)
+		ASSERT(Exec(opener, 0, NULL) != NOPROC);
+	for(int i=0; i<8; i++) {
+		int status;
+		ASSERT(WaitChild(NOPROC, &status) != NOPROC);
+		ASSERT(status==0);
+	}
+	return 0;
+}
+
+
 TEST_SUITE(concurrency_tests,
 	"A suite of tests which test the operational concurrency of the kernel."
 	)
@@ -1945,6 +4016,7 @@ TEST_SUITE(concurrency_tests,
 	&test_multitask,
 	&test_preemption,
 	&test_parallelism,
+	&test_concurrent_open_close,
 	NULL
 };
 
@@ -2098,6 +4170,371 @@ TEST_SUITE(io_tests,
 
 
 
+/*********************************************
+ *
+ *
+ *
+ *  Resource limit tests
+ *
+ *
+ *
+ *********************************************/
+
+
+/* Helper: find the info record of a given pid, return 1 on success */
+static int find_procinfo(Pid_t pid, procinfo* info)
+{
+	Fid_t finfo = OpenInfo();
+	ASSERT(finfo!=NOFILE);
+	int found = 0;
+	while(!found && Read(finfo, (char*)info, sizeof(procinfo))==sizeof(procinfo))
+		found = (info->pid == pid);
+	ASSERT(Close(finfo)==0);
+	return found;
+}
+
+
+BOOT_TEST(test_limits_only_lowered,
+	"Test that resource limits can be lowered but not raised."
+	)
+{
+	ASSERT(GetLimit(RLIMIT_FIDS)==MAX_FILEID);
+	ASSERT(GetLimit(RLIMIT_THREADS)==RLIM_INFINITY);
+	ASSERT(SetLimit(RLIMIT_FIDS, 8)==0);
+	ASSERT(GetLimit(RLIMIT_FIDS)==8);
+	ASSERT(SetLimit(RLIMIT_FIDS, 9)==-1);
+	ASSERT(SetLimit(RLIMIT_CPU, 0)==-1);
+	ASSERT(SetLimit(RLIMIT_MAX, 0)==-1);
+	ASSERT(GetLimit(RLIMIT_MAX)==0);
+	return 0;
+}
+
+
+BOOT_TEST(test_limits_inherited,
+	"Test that a child process inherits the resource limits of its parent."
+	)
+{
+	int child(int argl, void* args) {
+		ASSERT(GetLimit(RLIMIT_FIDS)==5);
+		ASSERT(GetLimit(RLIMIT_THREADS)==3);
+		return 0;
+	}
+	ASSERT(SetLimit(RLIMIT_FIDS, 5)==0);
+	ASSERT(SetLimit(RLIMIT_THREADS, 3)==0);
+	int status;
+	WaitChild(Exec(child, 0, NULL), &status);
+	ASSERT(status==0);
+	return 0;
+}
+
+
+BOOT_TEST(test_fid_limit,
+	"Test that the fid limit makes fid allocation and Dup2 fail gracefully."
+	)
+{
+	ASSERT(SetLimit(RLIMIT_FIDS, 4)==0);
+	for(int i=0;i<4;i++)
+		ASSERT(OpenNull()==i);
+	ASSERT(OpenNull()==NOFILE);
+	ASSERT(Dup2(0, 4)==-1);
+	ASSERT(Close(3)==0);
+	ASSERT(OpenNull()==3);
+	return 0;
+}
+
+
+BOOT_TEST(test_thread_limit,
+	"Test that the thread limit makes CreateThread fail gracefully."
+	)
+{
+	int task(int argl, void* args) { return 0; }
+
+	ASSERT(SetLimit(RLIMIT_THREADS, 2)==0);
+	Tid_t t = CreateThread(task, 0, NULL);
+	ASSERT(t!=NOTHREAD);
+	ASSERT(CreateThread(task, 0, NULL)==NOTHREAD);
+	ASSERT(ThreadJoin(t, NULL)==0);
+	return 0;
+}
+
+
+BOOT_TEST(test_kmem_limit,
+	"Test that the kernel memory limit makes Exec, CreateThread, and the\n"
+	"creation or growth of pipes and datagram sockets fail gracefully."
+	)
+{
+	int task(int argl, void* args) { return 0; }
+
+	pipe_t p;
+	ASSERT(Pipe(&p)==0);
+
+	ASSERT(SetLimit(RLIMIT_KMEM, 1024)==0);
+	ASSERT(CreateThread(task, 0, NULL)==NOTHREAD);
+	ASSERT(Exec(task, 0, NULL)==NOPROC);
+
+	pipe_t q;
+	ASSERT(Pipe(&q)==-1);
+	ASSERT(PipeEx(&q, PIPE_MIN_SIZE, 0)==-1);
+	ASSERT(SocketDgram(NOPORT)==NOFILE);
+
+	/* A pipe made before keeps working, but cannot grow */
+	ASSERT(PipeSetSize(p.read, PIPE_MAX_SIZE)==-1);
+	ASSERT(PipeGetSize(p.read)==PIPE_DEFAULT_SIZE);
+	ASSERT(Write(p.write, "x", 1)==1);
+	ASSERT(Close(p.write)==0);
+	ASSERT(Close(p.read)==0);
+	return 0;
+}
+
+
+BOOT_TEST(test_cpu_limit,
+	"Test that a process over its cpu share is throttled, whether it spins\n"
+	"in user code or in system calls."
+	)
+{
+	volatile int stop;
+	int syscalls;
+	int spinner(int argl, void* args) {
+		ASSERT(SetLimit(RLIMIT_CPU, 20)==0);
+		volatile unsigned long x = 0;
+		while(! stop) {
+			if(syscalls) GetPid(); else x++;
+		}
+		return 0;
+	}
+
+	for(syscalls=0; syscalls<2; syscalls++) {
+		stop = 0;
+		Pid_t pid = Exec(spinner, 0, NULL);
+		ASSERT(pid!=NOPROC);
+		sleep_msec(500);
+
+		procinfo info;
+		ASSERT(find_procinfo(pid, &info));
+		stop = 1;
+		ASSERT(WaitChild(pid, NULL)==pid);
+
+		/* A 20% share of 500 msec, with some slack for the last quanta */
+		ASSERT(info.stats.run_time < 250000);
+	}
+	return 0;
+}
+
+
+TEST_SUITE(limit_tests,
+	"A suite of tests for resource limits."
+	)
+{
+	&test_limits_only_lowered,
+	&test_limits_inherited,
+	&test_fid_limit,
+	&test_thread_limit,
+	&test_kmem_limit,
+	&test_cpu_limit,
+	NULL
+};
+
+
+
+/*********************************************
+ *
+ *
+ *
+ *  System information tests
+ *
+ *
+ *
+ *********************************************/
+
+
+BOOT_TEST(test_procinfo_accounting,
+	"Test that the cpu time and system calls of a process are accounted\n"
+	"and returned by OpenInfo."
+	)
+{
+	int child(int argl, void* args) {
+		for(int i=0;i<100;i++)
+			GetPid();
+		/* Burn some cpu */
+		volatile unsigned long x = 0;
+		for(unsigned long i=0; i<20000000ul; i++) x += i;
+		return 0;
+	}
+
+	procinfo info;
+	Pid_t pid = Exec(child, 0, NULL);
+	ASSERT(pid!=NOPROC);
+
+	/* Wait for the child to become a zombie */
+	while(find_procinfo(pid, &info) && info.alive) 
+		fibo(15);
+
+	ASSERT(find_procinfo(pid, &info));
+	ASSERT(info.stats.syscalls >= 100);
+	ASSERT(info.stats.run_time > 0);
+
+	/* Our own syscalls are counted too */
+	ASSERT(find_procinfo(GetPid(), &info));
+	ASSERT(info.stats.syscalls > 0);
+
+	ASSERT(WaitChild(pid, NULL)==pid);
+	return 0;
+}
+
+
+BOOT_TEST(test_info_batched_read,
+	"Test that a Read on an info stream returns many whole records,\n"
+	"each process exactly once."
+	)
+{
+	int child(int argl, void* args) { return 0; }
+
+	Pid_t pids[8];
+	for(int i=0;i<8;i++) 
+		ASSERT((pids[i] = Exec(child, 0, NULL))!=NOPROC);
+
+	Fid_t finfo = OpenInfo();
+	ASSERT(finfo!=NOFILE);
+
+	/* Buffers smaller than a record are rejected */
+	char small[sizeof(procinfo)-1];
+	ASSERT(Read(finfo, small, sizeof(small))==-1);
+
+	/* A buffer with some slack returns only whole records */
+	procinfo table[20];
+	int rc = Read(finfo, (char*)table, sizeof(table)-1);
+	ASSERT(rc == 10*sizeof(procinfo));
+	ASSERT(table[0].pid==0);
+	ASSERT(table[1].pid==1);
+	for(int i=0;i<8;i++) {
+		ASSERT(table[i+2].pid==pids[i]);
+		ASSERT(table[i+2].ppid==1);
+	}
+	ASSERT(Read(finfo, (char*)table, sizeof(table))==0);
+	ASSERT(Close(finfo)==0);
+
+	for(int i=0;i<8;i++) 
+		ASSERT(WaitChild(pids[i], NULL)==pids[i]);
+	return 0;
+}
+
+
+BOOT_TEST(test_info_filter,
+	"Test that OpenInfoFilter returns only the matching processes."
+	)
+{
+	int child(int argl, void* args) { return 0; }
+
+	Pid_t pids[4];
+	for(int i=0;i<4;i++) 
+		ASSERT((pids[i] = Exec(child, 0, NULL))!=NOPROC);
+
+	/* Make sure all children are zombies */
+	procinfo info;
+	for(int i=0;i<4;i++)
+		while(find_procinfo(pids[i], &info) && info.alive) 
+			fibo(15);
+
+	procinfo table[20];
+	procinfo_filter f = { .alive_only = 1, .pid_min = 1, .pid_max = MAX_PROC };
+	Fid_t finfo = OpenInfoFilter(&f);
+	ASSERT(finfo!=NOFILE);
+	ASSERT(Read(finfo, (char*)table, sizeof(table))==sizeof(procinfo));
+	ASSERT(table[0].pid==1);
+	ASSERT(Close(finfo)==0);
+
+	f.alive_only = 0;
+	f.pid_min = pids[1];
+	f.pid_max = pids[2];
+	finfo = OpenInfoFilter(&f);
+	ASSERT(finfo!=NOFILE);
+	ASSERT(Read(finfo, (char*)table, sizeof(table))==2*sizeof(procinfo));
+	ASSERT(table[0].pid==pids[1] && !table[0].alive);
+	ASSERT(table[1].pid==pids[2] && !table[1].alive);
+	ASSERT(Close(finfo)==0);
+
+	f.pid_min = 10; f.pid_max = 5;
+	ASSERT(OpenInfoFilter(&f)==NOFILE);
+
+	for(int i=0;i<4;i++) 
+		ASSERT(WaitChild(pids[i], NULL)==pids[i]);
+	return 0;
+}
+
+
+BOOT_TEST(test_info_consistent_under_churn,
+	"Test that info streams return consistent records while processes\n"
+	"are created and destroyed concurrently.",
+	.timeout = 30
+	)
+{
+	/* Each child gets an argument of argl bytes, all equal to argl */
+	int child(int argl, void* args) { return 0; }
+
+	int done = 0;
+	int spawner(int argl, void* args) {
+		char arg[200];
+		for(int i=0; i<300; i++) {
+			int len = 1 + i % 199;
+			memset(arg, len, len);
+			Pid_t pid = Exec(child, len, arg);
+			ASSERT(pid != NOPROC);
+			if(i % 4 == 3) 
+				while(WaitChild(NOPROC, NULL)!=NOPROC);
+		}
+		while(WaitChild(NOPROC, NULL)!=NOPROC);
+		done = 1;
+		return 0;
+	}
+
+	Tid_t t = CreateThread(spawner, 0, NULL);
+	ASSERT(t != NOTHREAD);
+
+	procinfo table[64];
+	while(! done) {
+		int seen_init = 0;
+		Fid_t finfo = OpenInfo();
+		ASSERT(finfo!=NOFILE);
+		int rc;
+		while((rc = Read(finfo, (char*)table, sizeof(table))) > 0) {
+			ASSERT(rc % sizeof(procinfo) == 0);
+			for(int i=0; i < rc/sizeof(procinfo); i++) {
+				procinfo* info = &table[i];
+				/* Pids may be reused during the snapshot, but init is seen once */
+				if(info->pid == 1) seen_init++;
+
+				if(info->main_task == child) {
+					ASSERT(info->ppid == GetPid());
+					ASSERT(info->argl >= 1 && info->argl < 200);
+					int len = info->argl < PROCINFO_MAX_ARGS_SIZE ? info->argl : PROCINFO_MAX_ARGS_SIZE;
+					for(int j=0; j<len; j++)
+						ASSERT(info->args[j] == (char) info->argl);
+				}
+			}
+		}
+		ASSERT(rc == 0);
+		ASSERT(seen_init == 1);
+		ASSERT(Close(finfo)==0);
+	}
+
+	ASSERT(ThreadJoin(t, NULL)==0);
+	return 0;
+}
+
+
+TEST_SUITE(sysinfo_tests,
+	"A suite of tests for the system information stream."
+	)
+{
+	&test_procinfo_accounting,
+	&test_info_batched_read,
+	&test_info_filter,
+	&test_info_consistent_under_churn,
+	NULL
+};
+
+
+
 /*********************************************
  *
  *
@@ -2120,6 +4557,8 @@ TEST_SUITE(all_tests,
 	&thread_tests,
 	&pipe_tests,
 	&socket_tests,
+	&limit_tests,
+	&sysinfo_tests,
 	NULL
 };
 